@@ -0,0 +1,360 @@
+#pragma once
+#include <cstddef>
+#include <climits>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <deque>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+#include <boost/call_traits.hpp>
+#include <ext/future.hpp>
+
+namespace ext
+{
+	/// Thread safe cache with approximate LRU(CLOCK) eviction, counterpart of ext::manual_lru_cache for concurrent use.
+	///
+	/// Cache is split into shards by key hash, every shard is independently locked with shared_mutex
+	/// and holds maxsize / shards entries, so operations on different shards do not contend at all.
+	/// Instead of relocating entry on every hit, like manual_lru_cache does, each entry has a reference bit:
+	/// hit takes only shared lock and sets the bit with relaxed store, so readers of same shard run in parallel.
+	/// On insert into full shard CLOCK hand walks over entries clearing reference bits, first entry without it is evicted.
+	///
+	/// get_or_load deduplicates concurrent misses: first thread runs loader,
+	/// others threads requesting same key wait for it's result via ext::shared_future.
+	///
+	/// Values are returned by copy - entry can be evicted by other thread at any moment,
+	/// for heavy values use std::shared_ptr<const T> as Value.
+	template <
+		class Key,
+		class Value,
+		class Hash = boost::hash<Key>,
+		class KeyEqual = std::equal_to<>
+	>
+	class concurrent_lru_cache
+	{
+	public:
+		typedef typename boost::call_traits<Key>::param_type key_param;
+		typedef typename boost::call_traits<Value>::param_type value_param;
+
+		typedef Key key_type;
+		typedef Value mapped_type;
+		typedef Hash hasher;
+		typedef KeyEqual key_equal;
+
+	private:
+		static constexpr std::size_t npos = -1;
+
+		struct slot
+		{
+			const key_type * key = nullptr; // points to key of index node, nullptr - slot is free
+			std::optional<mapped_type> value;
+			std::atomic_bool referenced = ATOMIC_VAR_INIT(false);
+
+			slot(const key_type * key, mapped_type && value)
+				: key(key), value(std::move(value)) {}
+		};
+
+		/// cache line aligned, so neighbour shard locks do not false share
+		struct alignas(64) shard
+		{
+			mutable std::shared_mutex mutex;
+			// key -> index of slot in slots
+			std::unordered_map<key_type, std::size_t, hasher, key_equal> index;
+			// deque - slots are not movable and never relocated
+			std::deque<slot> slots;
+			std::vector<std::size_t> free_slots;
+			std::size_t hand = 0;
+			std::size_t maxsize;
+			// get_or_load: loads in progress
+			std::unordered_map<key_type, ext::shared_future<mapped_type>, hasher, key_equal> loading;
+		};
+
+	private:
+		std::unique_ptr<shard[]> m_shards;
+		unsigned m_shard_count;
+		unsigned m_shard_shift;
+		std::size_t m_maxsize;
+		hasher m_hash;
+
+	private:
+		shard & shard_for(key_param key) const noexcept;
+		/// moves CLOCK hand until entry without reference bit is found, returns it's slot index. Shard must be full
+		static std::size_t evict_slot(shard & sh);
+		/// inserts or replaces value, shard must be locked exclusively
+		static void insert_locked(shard & sh, key_type && key, mapped_type && value);
+
+	public:
+		/// returns copy of cached value, or empty optional if there is no such key; takes only shared lock
+		std::optional<mapped_type> find(key_param key) const;
+		bool contains(key_param key) const;
+		/// inserts or replaces value, evicting one entry of the shard if it is full
+		void insert(key_type key, mapped_type value);
+		/// removes entry, returns true if it was present
+		bool erase(key_param key);
+
+		/// returns cached value, or loads it via loader(key), inserts and returns it.
+		/// Concurrent calls for same missing key call loader only once, other callers wait for result.
+		/// If loader throws - exception is rethrown to all waiting callers and nothing is cached.
+		template <class Loader>
+		mapped_type get_or_load(key_param key, Loader && loader);
+
+		void clear();
+		/// number of entries, approximate if there are concurrent modifications
+		std::size_t size() const;
+		std::size_t maxsize() const noexcept { return m_maxsize; }
+		unsigned shards() const noexcept { return m_shard_count; }
+
+	public:
+		/// shards = 0 - 4 * hardware_concurrency. Number of shards is rounded up to power of 2,
+		/// but is not greater than maxsize, every shard holds ceil(maxsize / shards) entries.
+		explicit concurrent_lru_cache(std::size_t maxsize, unsigned shards = 0, hasher hash = {});
+
+		concurrent_lru_cache(const concurrent_lru_cache &) = delete;
+		concurrent_lru_cache & operator =(const concurrent_lru_cache &) = delete;
+	};
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	concurrent_lru_cache<Key, Value, Hash, KeyEqual>::concurrent_lru_cache(std::size_t maxsize, unsigned shards, hasher hash)
+		: m_maxsize(maxsize), m_hash(std::move(hash))
+	{
+		if (maxsize == 0)
+			throw std::invalid_argument("concurrent_lru_cache: CacheMaxSize == 0 is invalid");
+
+		if (shards == 0) shards = 4 * std::max(1u, std::thread::hardware_concurrency());
+		if (shards > maxsize) shards = static_cast<unsigned>(maxsize);
+
+		unsigned bits = 0;
+		while ((1u << bits) < shards) ++bits;
+
+		m_shard_count = 1u << bits;
+		m_shard_shift = sizeof(std::size_t) * CHAR_BIT - bits;
+		m_shards = std::make_unique<shard[]>(m_shard_count);
+
+		auto shard_maxsize = (maxsize + m_shard_count - 1) / m_shard_count;
+		for (unsigned idx = 0; idx < m_shard_count; ++idx)
+			m_shards[idx].maxsize = shard_maxsize;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline auto concurrent_lru_cache<Key, Value, Hash, KeyEqual>::shard_for(key_param key) const noexcept -> shard &
+	{
+		// shard is selected by high bits of mixed hash, unordered_map uses low bits
+		constexpr auto golden = static_cast<std::size_t>(0x9E3779B97F4A7C15ull);
+		std::size_t h = m_hash(key) * golden;
+		return m_shards[m_shard_count == 1 ? 0 : h >> m_shard_shift];
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	std::size_t concurrent_lru_cache<Key, Value, Hash, KeyEqual>::evict_slot(shard & sh)
+	{
+		auto count = sh.slots.size();
+		for (;;)
+		{
+			auto idx = sh.hand;
+			sh.hand = (sh.hand + 1) % count;
+
+			auto & sl = sh.slots[idx];
+			if (not sl.key) continue;
+			// give second chance to recently used entry
+			if (sl.referenced.exchange(false, std::memory_order_relaxed)) continue;
+
+			sh.index.erase(*sl.key);
+			sl.key = nullptr;
+			return idx;
+		}
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void concurrent_lru_cache<Key, Value, Hash, KeyEqual>::insert_locked(shard & sh, key_type && key, mapped_type && value)
+	{
+		auto it = sh.index.find(key);
+		if (it != sh.index.end())
+		{
+			auto & sl = sh.slots[it->second];
+			sl.value = std::move(value);
+			sl.referenced.store(true, std::memory_order_relaxed);
+			return;
+		}
+
+		std::size_t idx = npos;
+		if (not sh.free_slots.empty())
+		{
+			idx = sh.free_slots.back();
+			sh.free_slots.pop_back();
+		}
+		else if (sh.slots.size() >= sh.maxsize)
+			idx = evict_slot(sh);
+
+		try
+		{
+			it = sh.index.emplace(std::move(key), idx).first;
+		}
+		catch (...)
+		{
+			if (idx != npos) sh.free_slots.push_back(idx);
+			throw;
+		}
+
+		try
+		{
+			if (idx == npos)
+			{
+				sh.slots.emplace_back(&it->first, std::move(value));
+				it->second = sh.slots.size() - 1;
+			}
+			else
+			{
+				auto & sl = sh.slots[idx];
+				sl.value = std::move(value);
+				sl.key = &it->first;
+				sl.referenced.store(false, std::memory_order_relaxed);
+			}
+		}
+		catch (...)
+		{
+			sh.index.erase(it);
+			if (idx != npos) sh.free_slots.push_back(idx);
+			throw;
+		}
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	auto concurrent_lru_cache<Key, Value, Hash, KeyEqual>::find(key_param key) const -> std::optional<mapped_type>
+	{
+		auto & sh = shard_for(key);
+		std::shared_lock lk(sh.mutex);
+
+		auto it = sh.index.find(key);
+		if (it == sh.index.end()) return std::nullopt;
+
+		auto & sl = sh.slots[it->second];
+		// check before store, so hot entries do not bounce cache line between readers
+		if (not sl.referenced.load(std::memory_order_relaxed))
+			sl.referenced.store(true, std::memory_order_relaxed);
+
+		return *sl.value;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	bool concurrent_lru_cache<Key, Value, Hash, KeyEqual>::contains(key_param key) const
+	{
+		auto & sh = shard_for(key);
+		std::shared_lock lk(sh.mutex);
+		return sh.index.count(key) != 0;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void concurrent_lru_cache<Key, Value, Hash, KeyEqual>::insert(key_type key, mapped_type value)
+	{
+		auto & sh = shard_for(key);
+		std::unique_lock lk(sh.mutex);
+		insert_locked(sh, std::move(key), std::move(value));
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	bool concurrent_lru_cache<Key, Value, Hash, KeyEqual>::erase(key_param key)
+	{
+		auto & sh = shard_for(key);
+		std::unique_lock lk(sh.mutex);
+
+		auto it = sh.index.find(key);
+		if (it == sh.index.end()) return false;
+
+		auto idx = it->second;
+		auto & sl = sh.slots[idx];
+		sl.key = nullptr;
+		sl.value.reset();
+		sh.free_slots.push_back(idx);
+		sh.index.erase(it);
+		return true;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	template <class Loader>
+	auto concurrent_lru_cache<Key, Value, Hash, KeyEqual>::get_or_load(key_param key, Loader && loader) -> mapped_type
+	{
+		if (auto val = find(key))
+			return std::move(*val);
+
+		auto & sh = shard_for(key);
+		ext::promise<mapped_type> promise;
+
+		{
+			std::unique_lock lk(sh.mutex);
+			// recheck, value could be loaded while lock was released
+			auto it = sh.index.find(key);
+			if (it != sh.index.end())
+				return *sh.slots[it->second].value;
+
+			auto lit = sh.loading.find(key);
+			if (lit != sh.loading.end())
+			{
+				auto f = lit->second;
+				lk.unlock();
+				return f.get();
+			}
+
+			sh.loading.emplace(key, promise.get_future().share());
+		}
+
+		try
+		{
+			mapped_type value = loader(key);
+
+			{
+				std::unique_lock lk(sh.mutex);
+				sh.loading.erase(key);
+				insert_locked(sh, key_type(key), mapped_type(value));
+			}
+
+			promise.set_value(value);
+			return value;
+		}
+		catch (...)
+		{
+			{
+				std::unique_lock lk(sh.mutex);
+				sh.loading.erase(key);
+			}
+
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void concurrent_lru_cache<Key, Value, Hash, KeyEqual>::clear()
+	{
+		for (unsigned idx = 0; idx < m_shard_count; ++idx)
+		{
+			auto & sh = m_shards[idx];
+			std::unique_lock lk(sh.mutex);
+			sh.index.clear();
+			sh.slots.clear();
+			sh.free_slots.clear();
+			sh.hand = 0;
+		}
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	std::size_t concurrent_lru_cache<Key, Value, Hash, KeyEqual>::size() const
+	{
+		std::size_t total = 0;
+		for (unsigned idx = 0; idx < m_shard_count; ++idx)
+		{
+			auto & sh = m_shards[idx];
+			std::shared_lock lk(sh.mutex);
+			total += sh.index.size();
+		}
+
+		return total;
+	}
+}
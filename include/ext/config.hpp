@@ -41,3 +41,21 @@
 
 #define EXT_UNUSED(...) boost::ignore_unused(__VA_ARGS__)
 //#define EXT_UNUSED(...) ((void)(__VA_ARGS__))
+
+
+/// EXT_HAS_COROUTINES - 1 if C++20 coroutines are supported by compiler and standard library, 0 otherwise.
+/// Can be predefined to 0 to disable coroutine support
+
+#ifndef EXT_HAS_COROUTINES
+
+#if defined(__has_include) && defined(__cpp_impl_coroutine)
+#if __has_include(<coroutine>)
+#define EXT_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifndef EXT_HAS_COROUTINES
+#define EXT_HAS_COROUTINES 0
+#endif
+
+#endif // ifndef EXT_HAS_COROUTINES
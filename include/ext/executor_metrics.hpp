@@ -0,0 +1,159 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <climits>
+#include <atomic>
+#include <chrono>
+#include <boost/predef.h>
+
+#if BOOST_COMP_MSVC
+#include <intrin.h>
+#pragma intrinsic(_BitScanReverse64)
+#endif
+
+#if BOOST_ARCH_X86 and (BOOST_COMP_GNUC or BOOST_COMP_CLANG)
+#include <x86intrin.h>
+#define EXT_METRICS_CLOCK_TSC 1
+#elif BOOST_ARCH_X86 and BOOST_COMP_MSVC
+#pragma intrinsic(__rdtsc)
+#define EXT_METRICS_CLOCK_TSC 1
+#endif
+
+/// Instrumentation of ext::thread_pool and ext::threaded_scheduler(metrics and task hooks)
+/// is compiled only if EXT_ENABLE_EXECUTOR_METRICS is defined, otherwise it has no overhead at all.
+/// latency_histogram and task_hooks are always available.
+
+namespace ext
+{
+	/// HDR-style log-linear histogram of durations, nanosecond resolution.
+	/// Every power of 2 range is split into 16 linear sub buckets, so relative error is below 1/16,
+	/// values below 16ns are exact, whole uint64_t range is covered.
+	///
+	/// Histogram has single writer and any number of concurrent readers:
+	/// record is relaxed load + store of one counter, no locked instructions.
+	/// Readers see consistent, but possibly slightly stale counts.
+	/// Histograms of several writers are combined with merge.
+	class latency_histogram
+	{
+	public:
+		static constexpr unsigned sub_bucket_bits = 4;
+		static constexpr unsigned sub_bucket_count = 1u << sub_bucket_bits;
+		static constexpr unsigned bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+	private:
+		std::atomic<std::uint64_t> m_counts[bucket_count] = {};
+
+	private:
+		static unsigned msb(std::uint64_t val) noexcept;
+
+	public:
+		/// bucket index for value
+		static unsigned bucket_index(std::uint64_t val) noexcept;
+		/// highest value, that falls into bucket
+		static std::uint64_t bucket_value(unsigned idx) noexcept;
+
+	public:
+		/// records value, single writer only
+		void record(std::uint64_t nanoseconds) noexcept;
+		void record(std::chrono::nanoseconds val) noexcept { record(static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(0, val.count()))); }
+		/// adds counts of other histogram to this one, this must not be concurrently written
+		void merge(const latency_histogram & other) noexcept;
+		void clear() noexcept;
+
+		/// number of recorded values
+		std::uint64_t count() const noexcept;
+		/// value at given percentile in range [0, 100], with histogram precision; 0 if histogram is empty
+		std::chrono::nanoseconds percentile(double pct) const noexcept;
+		std::chrono::nanoseconds max() const noexcept { return percentile(100); }
+
+	public:
+		latency_histogram() = default;
+		latency_histogram(const latency_histogram & other) noexcept { merge(other); }
+		latency_histogram & operator =(const latency_histogram & other) noexcept { if (this != &other) { clear(); merge(other); } return *this; }
+	};
+
+	/// cheap monotonic clock for per task timestamps of executor metrics.
+	/// On x86 with invariant TSC(on linux - only if kernel itself uses tsc clocksource, so it's synchronized between CPUs)
+	/// reads time stamp counter: several times cheaper than steady_clock::now, otherwise falls back to steady_clock.
+	/// Timestamps are raw ticks, only differences are meaningful, see elapsed.
+	class metrics_clock
+	{
+	public:
+		typedef std::uint64_t time_point;
+
+	private:
+		static bool detect_tsc() noexcept;
+		static double calibrate() noexcept;
+
+	public:
+		/// true if time stamp counter is used
+		static bool uses_tsc() noexcept { static const bool tsc = detect_tsc(); return tsc; }
+		/// nanoseconds per tick, calibrated against steady_clock on first call, which takes about 2ms.
+		/// Executors call it on construction, so calibration does not delay first task
+		static double tick_period() noexcept { static const double period = calibrate(); return period; }
+
+		static time_point now() noexcept;
+		/// duration between timestamps, zero if end is before start
+		static std::chrono::nanoseconds elapsed(time_point start, time_point end) noexcept;
+	};
+
+	/// hooks called by executor worker thread around every task execution, useful for tracing.
+	/// Hooks must be thread safe and should be cheap, they are called on every task.
+	class task_hooks
+	{
+	public:
+		virtual ~task_hooks() = default;
+		virtual void task_begin() noexcept = 0;
+		virtual void task_end() noexcept = 0;
+	};
+
+	/// increments counter, which is written only by one thread: relaxed load + store, no locked instructions
+	inline void metric_add(std::atomic<std::uint64_t> & counter, std::uint64_t val) noexcept
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+	}
+
+	inline unsigned latency_histogram::msb(std::uint64_t val) noexcept
+	{
+	#if BOOST_COMP_GNUC or BOOST_COMP_CLANG
+		return sizeof(unsigned long long) * CHAR_BIT - 1 - __builtin_clzll(val);
+	#elif BOOST_COMP_MSVC
+		unsigned long msb_index;
+		_BitScanReverse64(&msb_index, val);
+		return msb_index;
+	#else
+		unsigned res = 0;
+		while (val >>= 1) ++res;
+		return res;
+	#endif
+	}
+
+	inline unsigned latency_histogram::bucket_index(std::uint64_t val) noexcept
+	{
+		if (val < sub_bucket_count) return static_cast<unsigned>(val);
+
+		// magnitude >= 1, top sub_bucket_bits + 1 bits of value select sub bucket
+		unsigned magnitude = msb(val) - sub_bucket_bits + 1;
+		unsigned sub = static_cast<unsigned>(val >> (magnitude - 1)) - sub_bucket_count;
+		return magnitude * sub_bucket_count + sub;
+	}
+
+	inline auto metrics_clock::now() noexcept -> time_point
+	{
+	#ifdef EXT_METRICS_CLOCK_TSC
+		if (uses_tsc()) return __rdtsc();
+	#endif
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline std::chrono::nanoseconds metrics_clock::elapsed(time_point start, time_point end) noexcept
+	{
+		if (end <= start) return std::chrono::nanoseconds::zero();
+		return std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(static_cast<double>(end - start) * tick_period()));
+	}
+
+	inline void latency_histogram::record(std::uint64_t nanoseconds) noexcept
+	{
+		metric_add(m_counts[bucket_index(nanoseconds)], 1);
+	}
+}
@@ -0,0 +1,421 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+#include <boost/call_traits.hpp>
+#include <boost/core/swap.hpp>
+
+namespace ext
+{
+	/// LRU cache with flat storage, counterpart of ext::manual_lru_cache for small keys and values.
+	///
+	/// manual_lru_cache allocates one multi_index node per entry with hash and list links,
+	/// for int64 -> int64 that is several times more memory than data itself and every lookup chases pointers.
+	/// Here entries are stored in one contiguous array, preallocated for maxsize entries,
+	/// recency list is intrusive with 32-bit prev/next indexes into that array.
+	/// Index is open addressing hash table with linear probing of 8-byte buckets: entry index + hash tag,
+	/// load factor is kept below 1/2, erase uses backward shift, so there are no tombstones.
+	/// Per entry overhead is 8 bytes in entry + 16-32 bytes of buckets, there are no per entry allocations.
+	///
+	/// Only plain LRU eviction by number of entries is supported: no eviction policies, weights or ttl.
+	/// Unlike manual_lru_cache, entries are relocated on erase(last entry is moved into the hole),
+	/// so pointers returned by insert/find_ptr are valid only until next modification of cache.
+	/// Key and Value should be nothrow movable: if move throws, cache stays consistent, but can lose entries.
+	template <
+		class Key,
+		class Value,
+		class Hash = boost::hash<Key>,
+		class KeyEqual = std::equal_to<>
+	>
+	class flat_lru_cache
+	{
+	public:
+		typedef typename boost::call_traits<Key>::param_type key_param;
+		typedef typename boost::call_traits<Value>::param_type value_param;
+
+		typedef Key key_type;
+		typedef Value mapped_type;
+		typedef Hash hasher;
+		typedef KeyEqual key_equal;
+
+	private:
+		typedef std::uint32_t index_type;
+		static constexpr index_type npos = -1;
+		static constexpr std::size_t no_bucket = -1;
+		/// entry indexes must fit into index_type with npos reserved, bucket count into 32 bits of hash tag
+		static constexpr std::size_t max_maxsize = std::size_t(1) << 31;
+
+		struct entry
+		{
+			key_type key;
+			mapped_type value;
+			index_type prev; // more recently used, npos for head
+			index_type next; // less recently used, npos for tail
+
+			entry(key_type && key, mapped_type && value)
+				: key(std::move(key)), value(std::move(value)), prev(npos), next(npos) {}
+		};
+
+		struct bucket
+		{
+			index_type pos = npos;  // index of entry, npos - bucket is empty
+			std::uint32_t tag = 0;  // high 32 bits of mixed hash, bucket home is derived from it
+		};
+
+	private:
+		std::vector<entry> m_entries;
+		std::vector<bucket> m_buckets;
+		unsigned m_bucket_bits = 0;
+		index_type m_head = npos;  // most recently used
+		index_type m_tail = npos;  // least recently used
+		std::size_t m_maxsize;
+		hasher m_hash;
+		key_equal m_equal;
+
+	private:
+		std::uint32_t hash_tag(key_param key) const;
+		std::size_t home(std::uint32_t tag) const noexcept { return tag >> (32 - m_bucket_bits); }
+		std::size_t mask() const noexcept { return m_buckets.size() - 1; }
+
+		/// bucket holding key, or no_bucket
+		std::size_t find_bucket(key_param key, std::uint32_t tag) const;
+		/// bucket referencing entry pos, entry must be indexed
+		std::size_t locate_bucket(index_type pos) const;
+		void insert_bucket(std::uint32_t tag, index_type pos) noexcept;
+		void erase_bucket(std::size_t idx) noexcept;
+		void rehash(std::size_t maxsize);
+
+		void link_front(index_type pos) noexcept;
+		void unlink(index_type pos) noexcept;
+		void touch(index_type pos) noexcept;
+
+		/// removes entry, that is already unlinked and not indexed, by moving last entry into it's place
+		void remove_entry(index_type pos);
+		/// fully removes entry pos: from index, recency list and storage
+		void erase_entry(index_type pos);
+
+	public:
+		/// drops least recently used entry
+		void drop_last();
+		/// inserts or replaces value, evicting least recently used entry if cache is full
+		mapped_type & insert(key_type key, mapped_type data);
+
+		/// returns value by key, throws std::out_of_range if there is no such key
+		mapped_type & at(key_param key);
+		/// returns value by key, nullptr if there is no such key
+		mapped_type * find_ptr(key_param key);
+		/// removes entry, returns true if it was present
+		bool erase(key_param key);
+
+		void clear() noexcept;
+		std::size_t size() const noexcept    { return m_entries.size(); }
+		std::size_t maxsize() const noexcept { return m_maxsize; }
+
+		/// drops least recently used entries, until size is not greater than size
+		void drop_to(std::size_t size);
+		/// changes capacity, evicting least recently used entries if needed; storage and index are reallocated
+		void set_maxsize(std::size_t size);
+
+	public:
+		explicit flat_lru_cache(std::size_t size, hasher hash = {}, key_equal equal = {});
+
+		flat_lru_cache(const flat_lru_cache &) = delete;
+		flat_lru_cache & operator =(const flat_lru_cache &) = delete;
+
+		flat_lru_cache(flat_lru_cache && r) = default;
+		flat_lru_cache & operator =(flat_lru_cache && r) = default;
+
+		void swap(flat_lru_cache & other) noexcept
+		{
+			boost::swap(m_entries, other.m_entries);
+			boost::swap(m_buckets, other.m_buckets);
+			boost::swap(m_bucket_bits, other.m_bucket_bits);
+			boost::swap(m_head, other.m_head);
+			boost::swap(m_tail, other.m_tail);
+			boost::swap(m_maxsize, other.m_maxsize);
+			boost::swap(m_hash, other.m_hash);
+			boost::swap(m_equal, other.m_equal);
+		}
+	};
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline void swap(flat_lru_cache<Key, Value, Hash, KeyEqual> & c1,
+	                 flat_lru_cache<Key, Value, Hash, KeyEqual> & c2) noexcept
+	{
+		c1.swap(c2);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	flat_lru_cache<Key, Value, Hash, KeyEqual>::flat_lru_cache(std::size_t size, hasher hash, key_equal equal)
+		: m_maxsize(0), m_hash(std::move(hash)), m_equal(std::move(equal))
+	{
+		set_maxsize(size);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline std::uint32_t flat_lru_cache<Key, Value, Hash, KeyEqual>::hash_tag(key_param key) const
+	{
+		// boost::hash of integers is identity, mix it, so high bits depend on all bits of key
+		constexpr auto golden = static_cast<std::uint64_t>(0x9E3779B97F4A7C15ull);
+		std::uint64_t h = static_cast<std::uint64_t>(m_hash(key)) * golden;
+		return static_cast<std::uint32_t>(h >> 32);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline std::size_t flat_lru_cache<Key, Value, Hash, KeyEqual>::find_bucket(key_param key, std::uint32_t tag) const
+	{
+		for (auto idx = home(tag);; idx = (idx + 1) & mask())
+		{
+			auto & b = m_buckets[idx];
+			if (b.pos == npos) return no_bucket;
+			if (b.tag == tag and m_equal(m_entries[b.pos].key, key)) return idx;
+		}
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline std::size_t flat_lru_cache<Key, Value, Hash, KeyEqual>::locate_bucket(index_type pos) const
+	{
+		auto idx = home(hash_tag(m_entries[pos].key));
+		while (m_buckets[idx].pos != pos)
+			idx = (idx + 1) & mask();
+
+		return idx;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline void flat_lru_cache<Key, Value, Hash, KeyEqual>::insert_bucket(std::uint32_t tag, index_type pos) noexcept
+	{
+		auto idx = home(tag);
+		while (m_buckets[idx].pos != npos)
+			idx = (idx + 1) & mask();
+
+		m_buckets[idx].pos = pos;
+		m_buckets[idx].tag = tag;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::erase_bucket(std::size_t hole) noexcept
+	{
+		// backward shift: move following entries of the probe sequence into the hole,
+		// unless their home is cyclically in (hole, idx] - then they are already reachable
+		for (auto idx = (hole + 1) & mask(); m_buckets[idx].pos != npos; idx = (idx + 1) & mask())
+		{
+			auto dist = (idx - home(m_buckets[idx].tag)) & mask();
+			if (dist >= ((idx - hole) & mask()))
+			{
+				m_buckets[hole] = m_buckets[idx];
+				hole = idx;
+			}
+		}
+
+		m_buckets[hole].pos = npos;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::rehash(std::size_t maxsize)
+	{
+		// load factor <= 1/2
+		unsigned bits = 1;
+		while ((std::size_t(1) << bits) < 2 * maxsize) ++bits;
+		if (bits == m_bucket_bits and not m_buckets.empty()) return;
+
+		m_buckets.assign(std::size_t(1) << bits, bucket());
+		m_bucket_bits = bits;
+
+		for (index_type pos = 0; pos < m_entries.size(); ++pos)
+			insert_bucket(hash_tag(m_entries[pos].key), pos);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline void flat_lru_cache<Key, Value, Hash, KeyEqual>::link_front(index_type pos) noexcept
+	{
+		auto & e = m_entries[pos];
+		e.prev = npos;
+		e.next = m_head;
+
+		if (m_head != npos) m_entries[m_head].prev = pos;
+		else                m_tail = pos;
+
+		m_head = pos;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline void flat_lru_cache<Key, Value, Hash, KeyEqual>::unlink(index_type pos) noexcept
+	{
+		auto & e = m_entries[pos];
+		if (e.prev != npos) m_entries[e.prev].next = e.next;
+		else                m_head = e.next;
+
+		if (e.next != npos) m_entries[e.next].prev = e.prev;
+		else                m_tail = e.prev;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	inline void flat_lru_cache<Key, Value, Hash, KeyEqual>::touch(index_type pos) noexcept
+	{
+		if (pos == m_head) return;
+		unlink(pos);
+		link_front(pos);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::remove_entry(index_type pos)
+	{
+		index_type last = static_cast<index_type>(m_entries.size() - 1);
+		if (pos != last)
+		{
+			// last entry takes place of removed one: index and neighbours must be repointed
+			auto bidx = locate_bucket(last);
+			auto & e = m_entries[pos];
+			e = std::move(m_entries[last]);
+			m_buckets[bidx].pos = pos;
+
+			if (e.prev != npos) m_entries[e.prev].next = pos;
+			else                m_head = pos;
+
+			if (e.next != npos) m_entries[e.next].prev = pos;
+			else                m_tail = pos;
+		}
+
+		m_entries.pop_back();
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::erase_entry(index_type pos)
+	{
+		erase_bucket(locate_bucket(pos));
+		unlink(pos);
+		remove_entry(pos);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::drop_last()
+	{
+		if (m_tail != npos) erase_entry(m_tail);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	auto flat_lru_cache<Key, Value, Hash, KeyEqual>::insert(key_type key, mapped_type data) -> mapped_type &
+	{
+		auto tag = hash_tag(key);
+		auto idx = find_bucket(key, tag);
+		if (idx != no_bucket)
+		{
+			auto pos = m_buckets[idx].pos;
+			auto & val = m_entries[pos].value;
+			boost::swap(val, data);
+			touch(pos);
+			return val;
+		}
+
+		index_type pos;
+		if (m_entries.size() < m_maxsize)
+		{
+			// storage is reserved for maxsize entries, emplace_back does not reallocate
+			pos = static_cast<index_type>(m_entries.size());
+			m_entries.emplace_back(std::move(key), std::move(data));
+		}
+		else
+		{
+			// reuse slot of least recently used entry
+			pos = m_tail;
+			erase_bucket(locate_bucket(pos));
+			unlink(pos);
+
+			try
+			{
+				auto & e = m_entries[pos];
+				e.key = std::move(key);
+				e.value = std::move(data);
+			}
+			catch (...)
+			{
+				remove_entry(pos);
+				throw;
+			}
+		}
+
+		insert_bucket(tag, pos);
+		link_front(pos);
+		return m_entries[pos].value;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	auto flat_lru_cache<Key, Value, Hash, KeyEqual>::at(key_param key) -> mapped_type &
+	{
+		auto * val = find_ptr(key);
+		if (val)
+			return *val;
+		else
+			throw std::out_of_range("flat_lru_cache out of range");
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	auto flat_lru_cache<Key, Value, Hash, KeyEqual>::find_ptr(key_param key) -> mapped_type *
+	{
+		auto idx = find_bucket(key, hash_tag(key));
+		if (idx == no_bucket) return nullptr;
+
+		auto pos = m_buckets[idx].pos;
+		touch(pos);
+		return &m_entries[pos].value;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	bool flat_lru_cache<Key, Value, Hash, KeyEqual>::erase(key_param key)
+	{
+		auto idx = find_bucket(key, hash_tag(key));
+		if (idx == no_bucket) return false;
+
+		auto pos = m_buckets[idx].pos;
+		erase_bucket(idx);
+		unlink(pos);
+		remove_entry(pos);
+		return true;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::clear() noexcept
+	{
+		m_entries.clear();
+		for (auto & b : m_buckets) b.pos = npos;
+		m_head = m_tail = npos;
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::drop_to(std::size_t size)
+	{
+		while (m_entries.size() > size)
+			erase_entry(m_tail);
+	}
+
+	template <class Key, class Value, class Hash, class KeyEqual>
+	void flat_lru_cache<Key, Value, Hash, KeyEqual>::set_maxsize(std::size_t size)
+	{
+		if (size == 0)
+			throw std::invalid_argument("flat_lru_cache: CacheMaxSize == 0 is invalid");
+		if (size > max_maxsize)
+			throw std::length_error("flat_lru_cache: CacheMaxSize is too big");
+
+		drop_to(size);
+
+		if (size != m_entries.capacity())
+		{
+			// storage capacity is exactly maxsize, so insert never reallocates
+			std::vector<entry> entries;
+			entries.reserve(size);
+			for (auto & e : m_entries)
+				entries.push_back(std::move(e));
+
+			m_entries = std::move(entries);
+		}
+
+		rehash(size);
+		m_maxsize = size;
+	}
+}
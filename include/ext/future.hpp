@@ -18,6 +18,7 @@
 #include <system_error> // for std::error_code
 #include <exception>    // for std::exception_ptr and others
 
+#include <array>    // used by when_all
 #include <vector>   // used in when_any_result
 #include <iterator> // iterator_traits
 
@@ -67,6 +68,7 @@ namespace ext
 		promise_already_satisfied  = 3,
 		no_state                   = 4,
 		cancelled                  = 5,
+		timeout                    = 6,
 	};
 
 	const std::error_category & future_category();
@@ -169,9 +171,18 @@ namespace ext
 
 
 	bool init_future_library(std::unique_ptr<continuation_waiters_pool> pool);
-	bool init_future_library(unsigned waiter_slots = 0);
+	/// waiter_slots == 0 - waiters are allocated with new/delete, otherwise arena pool with given number of slots is used.
+	/// spin_count > 0 - adaptive_continuation_waiter is used, spinning given number of iterations before blocking,
+	/// see adaptive_continuation_waiter
+	bool init_future_library(unsigned waiter_slots = 0, unsigned spin_count = 0);
 	void free_future_library();
 
+	/// creates continuation_waiters_pool, where every thread caches few waiters in thread local free list
+	/// and uses shared, mutex guarded, free list of up to waiter_slots waiters only on cache overflow/underflow,
+	/// so concurrently waiting threads do not contend. When shared list is empty - waiters are allocated with new, so pool is never exhausted.
+	/// spin_count has same meaning as in init_future_library. Use with init_future_library(std::unique_ptr<continuation_waiters_pool>)
+	std::unique_ptr<continuation_waiters_pool> make_thread_cached_waiters_pool(unsigned waiter_slots, unsigned spin_count = 0);
+
 
 	/// returns immediately satisfied future holding val
 	template <class Type>
@@ -233,6 +244,24 @@ namespace ext
 			ext::future<std::tuple<std::decay_t<Futures>...>>
 		>;
 
+	/// when_all for fixed size batch: state and all continuations are allocated in one memory block
+	template <class Future, std::size_t N>
+	auto when_all(std::array<Future, N> futures) ->
+		std::enable_if_t<
+			is_future_type<Future>::value,
+			ext::future<std::array<Future, N>>
+		>;
+
+	/// calls func(index, future) for every future as soon as it becomes ready, from thread satisfying it,
+	/// without waiting for others. Deferred futures are passed immediately.
+	/// Returned future becomes ready after all calls are done; if func throws - first exception is stored into returned future.
+	template <class InputIterator, class Functor>
+	auto when_each(InputIterator first, InputIterator last, Functor && func) ->
+		std::enable_if_t<
+			is_future_type<typename std::iterator_traits<InputIterator>::value_type>::value,
+			ext::future<void>
+		>;
+
 
 	template <class Future>
 	auto unwrap_future(Future f) ->
@@ -310,11 +339,14 @@ namespace ext
 	// * continuation_task        - shared_state derived class used for continuations
 	// * continuation_waiter      - shared_state derived abstract class used as continuations which for wait functionality
 	// * continuation_waiter_impl - implementation of continuation_waiter using std::mutex and std::condition_variable
+	// * adaptive_continuation_waiter - continuation_waiter spinning for a while before blocking
 	// * packaged_task_base       - packaged_task implementation interface
 	// * packaged_task_impl       - packaged_task implementation
 	//
 	// * when_(any/all)_task               - classes for implementing when_all/any functions
 	// * when_(any/all)_task_continuation  - classes for implementing when_all/any functions
+	// * when_all_slot_continuation, slotted_task - when_all/when_each continuations placed in memory block of parent state
+	// * cancellation_state, cancellation_link     - cancellation_source state and with_cancellation ties, internal to future.cpp
 
 	class shared_state_basic;
 	template <class Type> class shared_state;
@@ -322,6 +354,7 @@ namespace ext
 
 	class continuation_waiter;
 	class continuation_waiter_impl;
+	class adaptive_continuation_waiter;
 	class unwrap_continuation;
 	template <class>        class packaged_task_base;
 	template <class, class> class packaged_task_impl;
@@ -332,9 +365,19 @@ namespace ext
 
 	class when_any_task_continuation;
 	class when_all_task_continuation;
+	class when_all_slot_continuation;
 
 	template <class> class when_any_task;
 	template <class> class when_all_task;
+	template <class, class> class when_each_task;
+	template <class> class slotted_task;
+	class cancellation_state;
+
+	/// ties future state to cancellation_source state, see ext::with_cancellation
+	void tie_cancellation(shared_state_basic & state, shared_state_basic & source);
+	/// ties derived state to cancellation_source state parent is tied to, returns false if parent is not tied.
+	/// Used by then, when_all, thread_pool::submit(future, ...), so derived futures inherit cancellation token of parent.
+	bool inherit_cancellation(shared_state_basic & parent, shared_state_basic & derived);
 
 
 
@@ -364,47 +407,46 @@ namespace ext
 	/// in shared_state_basic itself, and instead hold them in continuation object.
 	/// continuation_waiter is acquired from waiter pool, when wait request is issued.
 	/// It is shared between multiple wait calls, and released when there are none.
-	/// There is always no more than 1 continuation_waiter for given future(shared_state_basic) object,
-	/// and if it's present - it's always at the head of continuation chain.
+	/// Waiter is pushed as head of continuation chain and is shared while it stays at the head.
 	/// This allows easy sharing on continuation_waiter and removing it, when not needed.
 	/// 
 	///
-	/// While atomic pointers are used, single linked list is NOT lock-free.
-	/// Lock-free implementation would be very hard, if possible.
+	/// Continuation slist is a lock-free Treiber stack: continuation is attached by CAS of head,
+	/// sealed by exchanging head with special ready value, when shared_state become ready.
+	/// All new submitted continuations after that see ready value and are executed immediately.
+	/// So continuation submission and transition to fulfilled state are ordered by single atomic head,
+	/// and attaching never waits for other threads.
 	/// 
-	/// Instead we use pointer locking:
+	/// Waiter management uses pointer locking:
 	/// locking pointer - is a spin-lock loop trying to set low bit to 1, while expecting it to be 0.
-	/// Assuming not high concurrency(see above) it should posses no problems.
-	/// 
-	/// Also when shared_state become ready, all new submitted continuations must be executed immediately.
-	/// There is a race condition here. While we are adding new continuation - we could become ready.
-	/// To prevent this, continuation submission and transition to fulfilled state must be done in single atomic step.
-	/// This is done by locking head and replacing it with special ready value.
+	/// Lock bit excludes only other waiter management and transition to ready state,
+	/// continuations are pushed regardless of it, preserving the bit.
+	/// Waiters are marked in slist with second low bit, so they are recognized without dynamic_cast.
 	/// 
 	/// Simplified algorithms:
 	/// Wherever there is a waiting request:
 	/// 1. lock slist head.
 	/// 2. if special ready value - waiting is not needed - return.
 	/// 3. if head is a waiter continuation:
-	///    * if so, it's refcount is increased and object returned to caller(caller waits on it).
-	///    * if not - waiter object is acquired from pool and placed as new head,
+	///    * if so, it's refcount is increased and object returned to caller(caller waits on it), head is unlocked.
+	///    * if not - waiter object is acquired from pool and pushed as new head, unlocking head in same CAS,
 	///      after that it's returned to caller.
-	/// 4. unlock head
+	/// 
+	/// Whenever waiting is finished:
+	/// 1. lock slist head, if ready value - waiter is already fired by continuation chain, just release it.
+	/// 2. if there are no more waiting callers and waiter is still at head - detach it with CAS and return to pool,
+	///    if continuations were pushed over it - it stays in slist until chain is run, and it's returned to pool from there.
+	/// 3. unlock head
 	/// 
 	/// Whenever new continuation is added - new object is created,
-	/// 1. lock slist head.
-	/// 2. if special ready value - execute continuation immediately and return.
-	/// 3. checked if it is continuation_waiter:
-	///    * if so - continuation inserted after head,
-	///    * if not - continuation added as new head.
-	/// 4. unlock head
+	/// 1. if special ready value - execute continuation immediately and return.
+	/// 2. push continuation as new head with CAS, if head became ready concurrently - execute continuation immediately.
 	/// 
 	/// we hold state as atomic std::uintptr_t:
-	/// * 0x0      - future_status::ready, unlocked
-	/// * 0x1      - future_status::ready, locked
+	/// * 0x0      - future_status::ready
 	/// * 0xFF..FF - waiting result and no continuations, locked
 	///   0xFF..FE - waiting result and no continuations, unlocked, also initial value
-	/// * other    - waiting result and this is head of slist(pointer to next continuation)
+	/// * other    - waiting result and this is head of slist(pointer to next continuation, waiter bit, lock bit)
 	/// 
 	/// When shared_state becomes ready, state changes to future_status::ready
 	/// and previous val is head of continuation slist which must be executed.
@@ -414,6 +456,8 @@ namespace ext
 	class shared_state_basic
 	{
 		using self_type = shared_state_basic;
+		// detaches dead links from it's continuation list, see future.cpp
+		friend cancellation_state;
 
 	protected:
 		using continuation_type = shared_state_basic;
@@ -431,6 +475,8 @@ namespace ext
 		static constexpr std::uintptr_t ready = 0;
 		/// mask to extract lock state
 		static constexpr std::uintptr_t lock_mask = 1;
+		/// mask marking continuation_waiter pointer in continuation slist
+		static constexpr std::uintptr_t waiter_mask = 2;
 		/// special value indication this the end of continuation chain
 		static constexpr std::uintptr_t not_a_continuation = ~lock_mask;
 		/// initial value of fsnext
@@ -461,7 +507,9 @@ namespace ext
 		static std::uintptr_t signal_future(std::atomic_uintptr_t & fstnext) noexcept;
 		/// attaches continuation to a continuation list with head.
 		/// if successful(shared_state was not ready)           - increments continuation refcount and returns true.
-		/// if not(shared_state was or became ready in process) - fires continuation immediately, refcount is not incremented, returns false
+		/// if not(shared_state was ready)                      - fires continuation immediately, refcount is not incremented, returns false
+		/// if shared_state became ready in process            - calls continuate and release for already taken reference, like run_continuations, returns false.
+		/// Lock-free: never waits for other threads.
 		static bool attach_continuation(std::atomic_uintptr_t & head, continuation_type * continuation, shared_state_basic * caller) noexcept;
 		/// runs continuations slist pointed by addr(checks if addr is_continuation - not ready val), typically should be called after signal_future.
 		/// for each item in list continuate and release are called, than next item is taken from m_fstnext.
@@ -473,10 +521,14 @@ namespace ext
 		/// release waiter, it there no more usages - detaches to from continuation list,
 		/// and release it to waiter objects pool. waiter must be acquired by acquire_waiter call.
 		static void release_waiter(std::atomic_uintptr_t & head, continuation_waiter * waiter) noexcept;
+		/// finds in continuation list cancellation_source state, future is tied to via ext::with_cancellation.
+		/// Returns null if there is none, or shared_state is ready. Locks list only if it's not empty.
+		static auto tied_cancellation(std::atomic_uintptr_t & head) -> ext::intrusive_ptr<shared_state_basic>;
 
 	protected:
 		static bool is_waiter(continuation_type * ptr) noexcept;
 		static bool is_continuation(std::uintptr_t fstate) noexcept { return fstate < ~lock_mask; }
+		static bool is_waiter(std::uintptr_t fstate) noexcept { return is_continuation(fstate) and (fstate & waiter_mask); }
 		static future_state pstatus(unsigned promise_state) noexcept { return static_cast<future_state>(promise_state & status_mask); }
 
 		/// re-inits this shared_state_basic as deferred, should be called from constructor of derived class.
@@ -506,6 +558,8 @@ namespace ext
 		/// release waiter, it there no more usages - detaches to from internal continuation list,
 		/// and release it to waiter objects pool
 		virtual void release_waiter(continuation_waiter * waiter) noexcept;
+		/// cancellation_source state this future is tied to via ext::with_cancellation, null if none
+		virtual auto tied_cancellation() -> ext::intrusive_ptr<shared_state_basic>;
 
 	public:
 		/// continuation support, must be implemented only by classes used as continuations.
@@ -914,6 +968,45 @@ namespace ext
 		virtual void reset() noexcept override;
 	};
 
+	/// continuation_waiter spinning with pause instruction for spin_count iterations, before blocking.
+	/// Futures completing within microseconds are waited without any system calls on both sides:
+	/// continuate touches mutex and condition_variable only if waiting thread already blocked.
+	class adaptive_continuation_waiter : public continuation_waiter
+	{
+	public:
+		/// about several microseconds on modern x86
+		static constexpr unsigned default_spin_count = 1000;
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_var;
+		std::atomic_bool m_ready = ATOMIC_VAR_INIT(false);
+		std::atomic_bool m_parked = ATOMIC_VAR_INIT(false); // some thread blocked, or going to block, on m_var
+		unsigned m_spin_count;
+
+		using unique_lock = std::unique_lock<std::mutex>;
+
+	private:
+		/// spins until ready or spin_count exhausted or timeout_point reached, returns m_ready
+		bool spin(std::chrono::steady_clock::time_point timeout_point) noexcept;
+
+	public:
+		/// waiting functions: waits until object become ready by execute call
+		virtual void wait_ready() noexcept override;
+		virtual bool wait_ready(std::chrono::steady_clock::time_point timeout_point) noexcept override;
+		virtual bool wait_ready(std::chrono::steady_clock::duration   timeout_duration) noexcept override;
+
+	public:
+		/// sets ready flag, fires condition_variable only if there are blocked threads
+		virtual void continuate(shared_state_basic * caller) noexcept override;
+		/// reset waiter, after that it can be used again
+		virtual void reset() noexcept override;
+
+	public:
+		adaptive_continuation_waiter(unsigned spin_count = default_spin_count) noexcept
+			: m_spin_count(spin_count) {}
+	};
+
 
 	template <class Ret, class ... Args>
 	class packaged_task_base<Ret(Args...)> : public shared_state<Ret>
@@ -1017,6 +1110,7 @@ namespace ext
 		using base_type::acquire_waiter;
 		using base_type::release_waiter;
 		using base_type::run_continuations;
+		using base_type::tied_cancellation;
 
 	protected:
 		/// like shared_state_basic::m_fsnext, see shared_state_basic class description.
@@ -1024,6 +1118,13 @@ namespace ext
 		/// It's needed because user can wait on this future, or even cancel it.
 		/// This should not affect parent future.
 		std::atomic_uintptr_t m_task_next = ATOMIC_VAR_INIT(fsnext_init);
+		/// parent state, held until it becomes ready, set only when this continuation is it's only consumer(future::then).
+		/// Cancelling such continuation cancels parent too, so cancellation of chain tail reaches it's head.
+		std::atomic<shared_state_basic *> m_upstream = ATOMIC_VAR_INIT(nullptr);
+
+	protected:
+		/// releases parent state, if it's still held, see m_upstream
+		void release_upstream() noexcept;
 
 	protected:
 		/// set future status to ready and runs continuations
@@ -1041,13 +1142,21 @@ namespace ext
 		/// and release it to waiter objects pool
 		void release_waiter(continuation_waiter * waiter) noexcept override
 		{ return release_waiter(m_task_next, waiter); }
+		/// finds cancellation_source state in internal continuation list
+		auto tied_cancellation() -> ext::intrusive_ptr<shared_state_basic> override
+		{ return tied_cancellation(m_task_next); }
 
 	public:
+		bool cancel() noexcept override;
 		void continuate(shared_state_basic * caller) noexcept override;
 
+		/// sets parent state for cancellation propagation, see m_upstream, must be called before attaching to parent
+		void set_upstream(shared_state_basic * parent) noexcept;
+
 	public:
 		// inherit constructors
 		using base_type::base_type;
+		~continuation_task() noexcept { release_upstream(); }
 	};
 
 	/// implements continuations(future::then, shared_future::then) for deferred futures
@@ -1132,6 +1241,13 @@ namespace ext
 				ext::future<std::tuple<std::decay_t<Futures>...>>
 			>;
 
+		template <class Future, std::size_t N>
+		friend auto when_all(std::array<Future, N> futures) ->
+			std::enable_if_t<
+				is_future_type<Future>::value,
+				ext::future<std::array<Future, N>>
+			>;
+
 	private:
 		using base_type = shared_state_unexceptional<Type>;
 		using self_type = when_all_task;
@@ -1147,6 +1263,8 @@ namespace ext
 		//void set_value(std::remove_const_t<value_type> && val) override { std::terminate(); }
 		//void set_value(const value_type & val) override { std::terminate(); }
 		void notify_satisfied(std::size_t index) noexcept override;
+		/// cancels also input futures, except shared ones - they can have other consumers
+		bool cancel() noexcept override;
 
 	public:
 		when_all_task(Type && val, std::size_t count) : m_count(count) { new (&m_val) Type(std::move(val)); }
@@ -1188,6 +1306,83 @@ namespace ext
 			: m_parent(std::move(parent)) {}
 	};
 
+	/// continuation of when_all/when_each placed in memory block of parent state, see slotted_task.
+	/// It does not have own reference count: addref/release are forwarded to parent, which owns and destroys it.
+	class when_all_slot_continuation : public continuation_base
+	{
+		using base_type        = continuation_base;
+		using self_type        = when_all_slot_continuation;
+		using parent_task_type = shared_state_basic;
+
+	protected:
+		parent_task_type * m_parent;
+		std::size_t m_index;
+
+	public:
+		void continuate(shared_state_basic * caller) noexcept override { m_parent->notify_satisfied(m_index); }
+
+	public:
+		unsigned addref() noexcept override           { return m_parent->addref(); }
+		unsigned addref(unsigned n) noexcept override { return m_parent->addref(n); }
+		unsigned release() noexcept override          { return m_parent->release(); }
+		unsigned use_count() const noexcept override  { return m_parent->use_count(); }
+
+	public:
+		when_all_slot_continuation(parent_task_type * parent, std::size_t index) noexcept
+			: m_parent(parent), m_index(index) {}
+	};
+
+	/// Base state with count when_all_slot_continuation's placed right after it in same memory block,
+	/// so aggregating functions make one allocation instead of one per input. Created only via make.
+	template <class Base>
+	class slotted_task final : public Base
+	{
+		using base_type = Base;
+		using self_type = slotted_task;
+
+	protected:
+		std::size_t m_slots_count;
+
+	protected:
+		static std::size_t slots_offset() noexcept;
+
+		template <class ... Args>
+		slotted_task(std::size_t count, Args && ... args);
+
+	public:
+		when_all_slot_continuation * slots() noexcept;
+		~slotted_task() noexcept;
+
+		static void operator delete(void * ptr) noexcept { ::operator delete(ptr); }
+
+		template <class ... Args>
+		static auto make(std::size_t count, Args && ... args) -> ext::intrusive_ptr<slotted_task>;
+	};
+
+	/// shared state returned by when_each call.
+	template <class Future, class Functor>
+	class when_each_task : public shared_state<void>
+	{
+	private:
+		using base_type = shared_state<void>;
+		using self_type = when_each_task;
+
+	protected:
+		std::vector<Future> m_futures;
+		Functor m_func;
+		std::atomic_size_t m_count;
+		std::atomic_bool m_failed = ATOMIC_VAR_INIT(false);
+		std::exception_ptr m_error; // written by first failed call, published by m_count decrement
+
+	public:
+		std::vector<Future> & futures() noexcept { return m_futures; }
+		void notify_satisfied(std::size_t index) noexcept override;
+
+	public:
+		when_each_task(std::vector<Future> && futures, Functor && func)
+			: m_futures(std::move(futures)), m_func(std::move(func)), m_count(m_futures.size()) {}
+	};
+
 
 	/// unwrap_future continuation for implementing unwrap functionality.
 	class unwrap_continuation : public ext::continuation_base
@@ -1203,6 +1398,7 @@ namespace ext
 		using base_type::acquire_waiter;
 		using base_type::release_waiter;
 		using base_type::run_continuations;
+		using base_type::tied_cancellation;
 
 	protected:
 		/// like shared_state_basic::m_fsnext, see shared_state_basic class description.
@@ -1229,6 +1425,9 @@ namespace ext
 		/// and release it to waiter objects pool
 		void release_waiter(continuation_waiter * waiter) noexcept override
 		{ return release_waiter(m_task_next, waiter); }
+		/// finds cancellation_source state in internal continuation list
+		auto tied_cancellation() -> ext::intrusive_ptr<shared_state_basic> override
+		{ return tied_cancellation(m_task_next); }
 
 	public:
 		bool cancel() noexcept override;
@@ -1381,8 +1580,12 @@ namespace ext
 		if (is_deferred()) wait();
 
 	    using ct_type = continuation_task<decltype(wrapped), return_type>;
-		state = make_intrusive<ct_type>(std::move(wrapped));
+		auto task = make_intrusive<ct_type>(std::move(wrapped));
+		// parent future is consumed, so it's cancelled together with continuation
+		task->set_upstream(this);
+		state = std::move(task);
 
+		ext::inherit_cancellation(*this, *state);
 		add_continuation(state.get());
 		return {state};
 	}
@@ -1406,6 +1609,7 @@ namespace ext
 	    using ct_type = continuation_task<decltype(wrapped), return_type>;
 		state = make_intrusive<ct_type>(std::move(wrapped));
 
+		ext::inherit_cancellation(*this, *state);
 		add_continuation(state.get());
 		return {state};
 	}
@@ -1861,6 +2065,39 @@ namespace ext
 	void continuation_task<Functor, Type>::continuate(shared_state_basic * caller) noexcept
 	{
 		this->execute(caller);
+		release_upstream();
+	}
+
+	template <class Functor, class Type>
+	bool continuation_task<Functor, Type>::cancel() noexcept
+	{
+		if (not base_type::cancel())
+			return false;
+
+		// parent is still pending and we are it's only consumer - nobody needs it anymore
+		if (auto * parent = m_upstream.exchange(nullptr, std::memory_order_acq_rel))
+		{
+			parent->cancel();
+			parent->release();
+		}
+
+		return true;
+	}
+
+	template <class Functor, class Type>
+	void continuation_task<Functor, Type>::set_upstream(shared_state_basic * parent) noexcept
+	{
+		assert(not m_upstream.load(std::memory_order_relaxed));
+		parent->addref();
+		m_upstream.store(parent, std::memory_order_relaxed);
+	}
+
+	template <class Functor, class Type>
+	void continuation_task<Functor, Type>::release_upstream() noexcept
+	{
+		// either continuate or cancel, whoever comes first
+		if (auto * parent = m_upstream.exchange(nullptr, std::memory_order_acq_rel))
+			parent->release();
 	}
 
 	template <class Functor, class Type>
@@ -1891,6 +2128,108 @@ namespace ext
 		}
 	}
 
+	template <class Type>
+	inline void cancel_inputs(ext::future<Type> & f) noexcept { if (f.valid()) f.handle()->cancel(); }
+
+	template <class Type>
+	inline void cancel_inputs(ext::shared_future<Type> &) noexcept {}
+
+	template <class Future>
+	void cancel_inputs(std::vector<Future> & futures) noexcept
+	{
+		for (auto & f : futures) cancel_inputs(f);
+	}
+
+	template <class Future, std::size_t N>
+	void cancel_inputs(std::array<Future, N> & futures) noexcept
+	{
+		for (auto & f : futures) cancel_inputs(f);
+	}
+
+	template <class ... Futures>
+	void cancel_inputs(std::tuple<Futures...> & futures) noexcept
+	{
+		std::apply([](auto & ... f) { (cancel_inputs(f), ...); }, futures);
+	}
+
+	template <class Type>
+	bool when_all_task<Type>::cancel() noexcept
+	{
+		if (not base_type::cancel())
+			return false;
+
+		// we are cancelled - m_val will not be given away, inputs are accessed only by us
+		cancel_inputs(m_val);
+		return true;
+	}
+
+	template <class Future, class Functor>
+	void when_each_task<Future, Functor>::notify_satisfied(std::size_t index) noexcept
+	{
+		try
+		{
+			m_func(index, std::move(m_futures[index]));
+		}
+		catch (...)
+		{
+			if (not m_failed.exchange(true, std::memory_order_relaxed))
+				m_error = std::current_exception();
+		}
+
+		if (m_count.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+		// we are the only one satisfying this state, so no promise_already_satisfied
+		if (m_error) this->set_exception(std::move(m_error));
+		else         this->set_value();
+	}
+
+	template <class Base>
+	inline std::size_t slotted_task<Base>::slots_offset() noexcept
+	{
+		constexpr auto align = alignof(when_all_slot_continuation);
+		return (sizeof(self_type) + align - 1) / align * align;
+	}
+
+	template <class Base>
+	inline when_all_slot_continuation * slotted_task<Base>::slots() noexcept
+	{
+		return reinterpret_cast<when_all_slot_continuation *>(reinterpret_cast<char *>(this) + slots_offset());
+	}
+
+	template <class Base>
+	template <class ... Args>
+	slotted_task<Base>::slotted_task(std::size_t count, Args && ... args)
+		: base_type(std::forward<Args>(args)...), m_slots_count(count)
+	{
+		auto * slots = this->slots();
+		for (std::size_t idx = 0; idx < count; ++idx)
+			new (slots + idx) when_all_slot_continuation(this, idx);
+	}
+
+	template <class Base>
+	slotted_task<Base>::~slotted_task() noexcept
+	{
+		auto * slots = this->slots();
+		for (std::size_t idx = 0; idx < m_slots_count; ++idx)
+			slots[idx].~when_all_slot_continuation();
+	}
+
+	template <class Base>
+	template <class ... Args>
+	auto slotted_task<Base>::make(std::size_t count, Args && ... args) -> ext::intrusive_ptr<slotted_task>
+	{
+		void * ptr = ::operator new(slots_offset() + count * sizeof(when_all_slot_continuation));
+		try
+		{
+			return ext::intrusive_ptr<self_type>(new (ptr) self_type(count, std::forward<Args>(args)...), ext::noaddref);
+		}
+		catch (...)
+		{
+			::operator delete(ptr);
+			throw;
+		}
+	}
+
 	template <class Type>
 	void when_any_task<Type>::notify_satisfied(std::size_t index) noexcept
 	{
@@ -1955,6 +2294,15 @@ namespace ext
 			return self.m_ptr->template add_unique_continuation<value_type>(std::forward<Functor>(continuation));
 		}
 
+		/// continuation is executed by executor, when this future becomes ready, see ext::inline_executor
+		template <class Executor, class Functor>
+		auto then(Executor & executor, Functor && continuation) ->
+			ext::future<std::invoke_result_t<std::decay_t<Functor>, ext::future<value_type>>>
+		{
+			assert(valid());
+			return executor.submit(std::move(*this), std::forward<Functor>(continuation));
+		}
+
 	public:
 		future() = default;
 		future(intrusive_ptr ptr) noexcept : m_ptr(std::move(ptr)) {}
@@ -2011,6 +2359,15 @@ namespace ext
 			return m_ptr->template add_shared_continuation<value_type>(std::forward<Functor>(continuation));
 		}
 
+		/// continuation is executed by executor, when this future becomes ready, see ext::inline_executor
+		template <class Executor, class Functor>
+		auto then(Executor & executor, Functor && continuation) ->
+			ext::future<std::invoke_result_t<std::decay_t<Functor>, ext::shared_future<value_type>>>
+		{
+			assert(valid());
+			return executor.submit(*this, std::forward<Functor>(continuation));
+		}
+
 	public:
 		shared_future() = default;
 		// shared_future can only be constructed by moving future
@@ -2034,6 +2391,20 @@ namespace ext
 		return m_ptr->get<void>();
 	}
 
+	/// Executor for future::then(executor, continuation), runs continuation in thread which fulfills future,
+	/// same as then(continuation).
+	/// Any class with method submit(future, continuation), returning future of continuation result,
+	/// can be used as an executor, for example ext::thread_pool.
+	class inline_executor
+	{
+	public:
+		template <class Future, class Functor>
+		auto submit(Future future, Functor && continuation)
+		{
+			return future.then(std::forward<Functor>(continuation));
+		}
+	};
+
 	/************************************************************************/
 	/*                   promise<Type>                                      */
 	/************************************************************************/
@@ -2552,19 +2923,20 @@ namespace ext
 		if (futures.empty())
 			return make_ready_future<result_type>(std::move(futures));
 
-		auto state = ext::make_intrusive<state_type>(std::move(futures), futures.size());
+		auto count = futures.size();
+		auto state = slotted_task<state_type>::make(count, std::move(futures), count);
+		auto * slots = state->slots();
+		bool tied = false;
 		for (const auto & f : state->m_val)
 		{
+			tied = tied or ext::inherit_cancellation(*f.handle(), *state);
 			if (f.is_deferred())
 				state->notify_satisfied(0);
 			else
-			{
-				auto cont = ext::make_intrusive<when_all_task_continuation>(state);
-				f.handle()->add_continuation(cont.get());
-			}
+				f.handle()->add_continuation(slots++);
 		}
 
-		return {state};
+		return {std::move(state)};
 	}
 
 	template <class ... Futures>
@@ -2580,19 +2952,83 @@ namespace ext
 		std::initializer_list<ext::shared_state_basic *> handles = {futures.handle().get()...};
 		result_type ftuple {std::forward<Futures>(futures)...};
 
-		auto state = ext::make_intrusive<state_type>(std::move(ftuple), sizeof...(futures));
+		auto state = slotted_task<state_type>::make(sizeof...(futures), std::move(ftuple), sizeof...(futures));
+		auto * slots = state->slots();
+		bool tied = false;
 		for (auto * handle : handles)
 		{
+			tied = tied or ext::inherit_cancellation(*handle, *state);
 			if (handle->is_deferred())
 				state->notify_satisfied(0);
 			else
+				handle->add_continuation(slots++);
+		}
+
+		return {std::move(state)};
+	}
+
+	template <class Future, std::size_t N>
+	auto when_all(std::array<Future, N> futures) ->
+		std::enable_if_t<
+			is_future_type<Future>::value,
+			ext::future<std::array<Future, N>>
+		>
+	{
+	    using result_type = std::array<Future, N>;
+	    using state_type  = when_all_task<result_type>;
+
+		if constexpr (N == 0)
+			return make_ready_future<result_type>(std::move(futures));
+		else
+		{
+			auto state = slotted_task<state_type>::make(N, std::move(futures), N);
+			auto * slots = state->slots();
+			bool tied = false;
+			for (const auto & f : state->m_val)
 			{
-				auto cont = ext::make_intrusive<when_all_task_continuation>(state);
-				handle->add_continuation(cont.get());
+				tied = tied or ext::inherit_cancellation(*f.handle(), *state);
+				if (f.is_deferred())
+					state->notify_satisfied(0);
+				else
+					f.handle()->add_continuation(slots++);
 			}
+
+			return {std::move(state)};
 		}
+	}
 
-		return {state};
+	template <class InputIterator, class Functor>
+	auto when_each(InputIterator first, InputIterator last, Functor && func) ->
+		std::enable_if_t<
+			is_future_type<typename std::iterator_traits<InputIterator>::value_type>::value,
+			ext::future<void>
+		>
+	{
+	    using value_type = typename std::iterator_traits<InputIterator>::value_type;
+	    using state_type = when_each_task<value_type, std::decay_t<Functor>>;
+
+		std::vector<value_type> futures;
+		ext::try_reserve(futures, first, last);
+
+		for (; first != last; ++first)
+			futures.push_back(*first);
+
+		if (futures.empty())
+			return make_ready_future();
+
+		auto count = futures.size();
+		auto state = slotted_task<state_type>::make(count, std::move(futures), std::decay_t<Functor>(std::forward<Functor>(func)));
+		auto * slots = state->slots();
+		for (std::size_t idx = 0; idx < count; ++idx)
+		{
+			auto & f = state->futures()[idx];
+			if (f.is_deferred())
+				state->notify_satisfied(idx);
+			else
+				f.handle()->add_continuation(slots + idx);
+		}
+
+		return {std::move(state)};
 	}
 
 
@@ -2629,6 +3065,98 @@ namespace ext
 		promise.handle()->add_continuation(cont.get());
 	}
 
+	/************************************************************************/
+	/*                cancellation_source/cancellation_token                */
+	/************************************************************************/
+	/// Cancellation token, shared by whole chain of asynchronous operations:
+	/// futures of chain stages, when_all inputs, thread_pool tasks, etc are tied to token via with_cancellation,
+	/// and single cancellation_source::request_cancellation cancels them all - upstream and downstream,
+	/// not yet started tasks are not executed at all.
+	/// Futures derived from tied future via then, when_all, thread_pool::submit(future, ...) inherit it's token,
+	/// derived futures are tied later - so they are cancelled before their parents.
+	///
+	/// Token is a shared reference to the cancellation_source state, which is a shared_state<void> promise:
+	/// request_cancellation cancels it and callbacks are it's continuations,
+	/// so registering callback and requesting cancellation are lock-free.
+	/// with_cancellation ties are released when tied future becomes ready, and are detached from source state in batches,
+	/// so long-lived source does not accumulate them. Callbacks of on_cancellation are released only
+	/// when cancellation is requested or source is destroyed.
+	class cancellation_token
+	{
+		friend class cancellation_source;
+
+	public:
+		using intrusive_ptr = ext::intrusive_ptr<ext::shared_state_basic>;
+
+	private:
+		intrusive_ptr m_ptr;
+
+	private:
+		explicit cancellation_token(intrusive_ptr ptr) noexcept : m_ptr(std::move(ptr)) {}
+
+	public:
+		// low-level accessor
+		const intrusive_ptr & handle() const noexcept { return m_ptr; }
+
+	public:
+		/// token is associated with cancellation_source, default constructed token is never cancelled
+		bool can_be_cancelled() const noexcept { return static_cast<bool>(m_ptr); }
+		bool is_cancellation_requested() const noexcept { return m_ptr and m_ptr->is_cancelled(); }
+
+		/// attaches callback, run when cancellation is requested, from thread requesting cancellation.
+		/// If cancellation already requested - functor is run immediately.
+		/// If source is destroyed without requesting cancellation - callback is released without being called.
+		template <class Functor>
+		void on_cancellation(Functor functor) const;
+
+	public:
+		cancellation_token() noexcept = default;
+	};
+
+	/// source of cancellation_token, see cancellation_token description.
+	/// Like promise it's move only, destroying source without requesting cancellation releases callbacks of all tokens.
+	class cancellation_source
+	{
+		ext::promise<void> m_promise;
+
+	public:
+		cancellation_token token() const noexcept { return cancellation_token(m_promise.handle()); }
+		/// requests cancellation, returns false if it was already requested
+		bool request_cancellation() { return m_promise.cancel(); }
+		bool is_cancellation_requested() const noexcept { return m_promise.is_cancelled(); }
+
+	public:
+		cancellation_source();
+	};
+
+	template <class Functor>
+	void cancellation_token::on_cancellation(Functor functor) const
+	{
+		using return_type = std::invoke_result_t<Functor>;
+		static_assert(std::is_same_v<return_type, void>);
+
+		if (not m_ptr) return;
+
+		using continuation_type = cancellation_continuation<Functor>;
+		auto cont = ext::make_intrusive<continuation_type>(std::move(functor));
+		m_ptr->add_continuation(cont.get());
+	}
+
+	/// ties future to cancellation token: when cancellation is requested, future is cancelled,
+	/// tie is released when future becomes ready. Already tied future is not tied twice.
+	/// Returns same future, so it can be used inline in chains:
+	///   auto f = ext::with_cancellation(pool.submit(...).then(...), token);
+	/// Cancelling future does not request cancellation of token.
+	template <class Future>
+	auto with_cancellation(Future f, const cancellation_token & token) ->
+		std::enable_if_t<is_future_type<Future>::value, Future>
+	{
+		if (token.can_be_cancelled() and not f.is_ready() and not (f.handle()->tied_cancellation() == token.handle()))
+			ext::tie_cancellation(*f.handle(), *token.handle());
+
+		return f;
+	}
+
 	/************************************************************************/
 	/*                   swap non member functions                          */
 	/************************************************************************/
@@ -0,0 +1,149 @@
+#pragma once
+#include <ext/config.hpp>
+#include <ext/future.hpp>
+
+#if EXT_HAS_COROUTINES
+#include <coroutine>
+
+namespace ext
+{
+	/// C++20 coroutines support for ext::future/ext::shared_future.
+	///
+	///   ext::task<int> foo(ext::future<int> f)
+	///   {
+	///       int val = co_await std::move(f);
+	///       co_return val + 1;
+	///   }
+	///
+	/// co_await on not ready future attaches continuation directly to it's shared state,
+	/// coroutine is resumed by thread which fulfills future, right after result becomes available.
+	/// Awaiter object itself is the continuation and lives in coroutine frame - no additional allocations are made.
+	/// If future is deferred - it's evaluated in awaiting thread, like on wait call.
+	///
+	/// co_await on future consumes it, like future::get, co_await on shared_future - does not.
+	/// Cancelled/abandoned futures throw from co_await, same as from get.
+
+	template <class Future>
+	class future_awaiter : public continuation_base
+	{
+		Future & m_future;
+		std::coroutine_handle<> m_coro;
+		// set by whichever comes first: await_suspend after attaching or release from run_continuations,
+		// second one resumes coroutine.
+		std::atomic_bool m_resumable = ATOMIC_VAR_INIT(false);
+
+	public:
+		// Awaiter lives in coroutine frame, it's lifetime is not controlled by refcount.
+		// run_continuations calls continuate and than release, after that it does not touch continuation,
+		// so coroutine is resumed from release - resuming from continuate could destroy frame before release call.
+		// If future is already ready - attach_continuation calls only continuate and returns false,
+		// if it became ready while attaching - continuate and release and returns false, release does not resume then.
+		unsigned addref() noexcept override           { return 2; }
+		unsigned addref(unsigned n) noexcept override { return 1 + n; }
+		unsigned use_count() const noexcept override  { return 1; }
+		unsigned release() noexcept override;
+
+		void continuate(shared_state_basic * caller) noexcept override {}
+
+	public:
+		bool await_ready();
+		bool await_suspend(std::coroutine_handle<> coro) noexcept;
+		decltype(auto) await_resume() { return m_future.get(); }
+
+	public:
+		future_awaiter(Future & future) noexcept
+			: m_future(future) { assert(m_future.valid()); }
+	};
+
+	template <class Future>
+	unsigned future_awaiter<Future>::release() noexcept
+	{
+		if (m_resumable.exchange(true, std::memory_order_acq_rel))
+			m_coro.resume();
+
+		return 1;
+	}
+
+	template <class Future>
+	bool future_awaiter<Future>::await_ready()
+	{
+		// if deferred - become ready, same as in wait
+		if (m_future.is_deferred()) m_future.wait();
+		return m_future.is_ready();
+	}
+
+	template <class Future>
+	bool future_awaiter<Future>::await_suspend(std::coroutine_handle<> coro) noexcept
+	{
+		m_coro = coro;
+
+		// already ready - resume immediately
+		if (not m_future.handle()->add_continuation(this))
+			return false;
+
+		// if future became ready concurrently, and release was already called - resume immediately,
+		// otherwise release will resume coroutine.
+		return not m_resumable.exchange(true, std::memory_order_acq_rel);
+	}
+
+	template <class Type>
+	inline auto operator co_await(ext::future<Type> & future) noexcept { return future_awaiter<ext::future<Type>>(future); }
+
+	template <class Type>
+	inline auto operator co_await(ext::future<Type> && future) noexcept { return future_awaiter<ext::future<Type>>(future); }
+
+	template <class Type>
+	inline auto operator co_await(ext::shared_future<Type> & future) noexcept { return future_awaiter<ext::shared_future<Type>>(future); }
+
+	template <class Type>
+	inline auto operator co_await(ext::shared_future<Type> && future) noexcept { return future_awaiter<ext::shared_future<Type>>(future); }
+
+
+	template <class Type> class task;
+
+	/// promise_type of ext::task, holds shared state of produced future
+	template <class Type>
+	class task_promise_base
+	{
+	protected:
+		ext::intrusive_ptr<ext::shared_state<Type>> m_state = ext::make_intrusive<ext::shared_state<Type>>();
+
+	public:
+		// coroutine starts eagerly, frame is destroyed on completion, result is kept in shared state
+		std::suspend_never initial_suspend() const noexcept { return {}; }
+		std::suspend_never final_suspend() const noexcept   { return {}; }
+
+		ext::task<Type> get_return_object() const noexcept  { return ext::task<Type>(m_state); }
+		void unhandled_exception() noexcept                 { m_state->set_exception(std::current_exception()); }
+	};
+
+	template <class Type>
+	class task_promise : public task_promise_base<Type>
+	{
+	public:
+		template <class Arg>
+		void return_value(Arg && arg) { this->m_state->set_value(std::forward<Arg>(arg)); }
+	};
+
+	template <>
+	class task_promise<void> : public task_promise_base<void>
+	{
+	public:
+		void return_void() { this->m_state->set_value(); }
+	};
+
+	/// Coroutine return type, which is an ext::future fulfilled with coroutine result(or exception).
+	/// Coroutine starts executing immediately on call, and runs until first suspension point.
+	/// Can be used anywhere ext::future can(moved into it), including co_await in other coroutines.
+	template <class Type>
+	class task : public ext::future<Type>
+	{
+	public:
+		using promise_type = task_promise<Type>;
+
+	public:
+		using ext::future<Type>::future;
+	};
+}
+
+#endif // EXT_HAS_COROUTINES
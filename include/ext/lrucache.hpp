@@ -1,6 +1,11 @@
 #pragma once
+#include <cstdint>
 #include <vector>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
 #include <functional>
+#include <chrono>
 #include <ext/utility.hpp> //for ext::first_el для batch_lru_cache
 
 #include <boost/multi_index_container.hpp>
@@ -24,13 +29,483 @@ namespace ext
 	/// для получения данных используется не std::function, а функтор
 	/// специальные функторы function_acquire/batch_function_acquire позволяют не писать новый функтор,
 	/// а просто передать некое выражение в std::function<bool (Key, Val)>/std::function<bool (Key, vector<pair<Key, Val>> & )>
+	///
+	/// политика вытеснения задается параметром шаблона EvictionPolicy:
+	///   lru_eviction     - строгий LRU, по умолчанию
+	///   clock_eviction   - CLOCK(second chance), попадание не перемещает элемент, только ставит бит
+	///   slru_eviction    - segmented LRU, устойчив к однократному сканированию
+	///   tinylfu_eviction - W-TinyLFU: окно LRU + SLRU с фильтром допуска по частоте(count-min sketch)
+	///
+	/// политика - тип с вложенными entry_data(данные политики в каждом элементе кеша) и
+	/// template <class Sequence, class Hasher> class policy, где Sequence - sequenced индекс кеша.
+	/// policy(capacity, hasher) должен предоставлять:
+	///   set_capacity(n)             - изменение емкости кеша
+	///   inserted(seq, it)           - новый элемент добавлен в конец seq
+	///   accessed(seq, it)           - попадание по элементу
+	///   victim(seq, exclude)        - элемент для вытеснения, не равный exclude(только что вставленный или seq.end())
+	///   erased(seq, it)             - элемент сейчас будет удален
+	///   cleared()                   - кеш очищен
+	/// все элементы кеша хранятся в одном списке seq, политики делят его на сегменты,
+	/// так что дополнительных аллокаций нет.
+	///
+	/// емкость кеша может задаваться в весах, а не в числе элементов: параметр шаблона Weigher,
+	/// выражение std::size_t w = Weigher(key, value) должно быть валидным, например размер значения в байтах.
+	/// По умолчанию unit_weigher - вес каждого элемента 1, емкость - число элементов.
+	/// Вес вычисляется при вставке и запоминается в элементе, изменение значения через указатель/ссылку вес не меняет.
+	/// Размеры сегментов политик считаются в элементах от емкости, так что с весами они приблизительны.
+	///
+	/// элементы могут иметь срок жизни: параметр шаблона Expiry = ttl_expiry<Clock>, по умолчанию no_expiry - бессрочно.
+	/// Срок задается для кеша(set_ttl) или для элемента(insert с ttl), просроченный элемент удаляется при обращении к нему,
+	/// а чтобы просроченные элементы не занимали емкость - есть инкрементальная очистка expire(max_work),
+	/// которая может вызываться и автоматически при вставке(set_sweep_step).
+	/// Clock - монотонные часы со статическим now(), для тестов можно подставить свои.
+
+	/// вес любого элемента - 1, емкость кеша - число элементов
+	struct unit_weigher
+	{
+		template <class Key, class Value>
+		constexpr std::size_t operator()(const Key & key, const Value & value) const noexcept { return 1; }
+	};
+
+	/// элементы бессрочны, время не хранится и не проверяется
+	struct no_expiry {};
+
+	/// элементы имеют срок жизни по часам Clock
+	template <class Clock = std::chrono::steady_clock>
+	struct ttl_expiry
+	{
+		typedef Clock clock;
+	};
+
+	namespace detail
+	{
+		/// срок жизни элемента кеша, для no_expiry не хранится
+		template <class Expiry>
+		struct lru_expiry_holder;
+
+		template <>
+		struct lru_expiry_holder<no_expiry>
+		{
+			static constexpr bool enabled = false;
+			typedef std::chrono::steady_clock clock;
+
+			static clock::time_point now() noexcept { return {}; }
+			bool expired(clock::time_point now) const noexcept { return false; }
+			void set_expiry(clock::time_point tp) const noexcept {}
+		};
+
+		template <class Clock>
+		struct lru_expiry_holder<ttl_expiry<Clock>>
+		{
+			static constexpr bool enabled = true;
+			typedef Clock clock;
+
+			mutable typename clock::time_point m_expires = clock::time_point::max();
+
+			static typename clock::time_point now() { return clock::now(); }
+			bool expired(typename clock::time_point now) const noexcept { return m_expires <= now; }
+			void set_expiry(typename clock::time_point tp) const noexcept { m_expires = tp; }
+		};
+
+		/// вес элемента кеша, для unit_weigher не хранится
+		template <class Weigher>
+		struct lru_weight_holder
+		{
+			mutable std::size_t m_weight = 0;
+
+			std::size_t weight() const noexcept { return m_weight; }
+			void set_weight(std::size_t weight) const noexcept { m_weight = weight; }
+		};
+
+		template <>
+		struct lru_weight_holder<unit_weigher>
+		{
+			std::size_t weight() const noexcept { return 1; }
+			void set_weight(std::size_t weight) const noexcept {}
+		};
+	}
+
+	/// строгий LRU: попадание перемещает элемент в конец списка, вытесняется первый
+	struct lru_eviction
+	{
+		struct entry_data {};
+
+		template <class Sequence, class Hasher>
+		class policy
+		{
+			typedef typename Sequence::iterator iterator;
+
+		public:
+			void set_capacity(std::size_t capacity) noexcept {}
+			void inserted(Sequence & seq, iterator it) noexcept {}
+			void accessed(Sequence & seq, iterator it) noexcept { seq.relocate(seq.end(), it); }
+			void erased(Sequence & seq, iterator it) noexcept {}
+			void cleared() noexcept {}
+
+			iterator victim(Sequence & seq, iterator exclude) noexcept
+			{
+				auto it = seq.begin();
+				return it != exclude ? it : std::next(it);
+			}
+
+		public:
+			policy(std::size_t capacity, const Hasher & hash) noexcept {}
+		};
+	};
+
+	/// CLOCK: попадание только ставит бит обращения, без перемещения по списку.
+	/// Вытесняется первый элемент без бита, элементы с битом сбрасывают его и переносятся в конец(второй шанс)
+	struct clock_eviction
+	{
+		struct entry_data
+		{
+			bool referenced = false;
+		};
+
+		template <class Sequence, class Hasher>
+		class policy
+		{
+			typedef typename Sequence::iterator iterator;
+
+		public:
+			void set_capacity(std::size_t capacity) noexcept {}
+			void inserted(Sequence & seq, iterator it) noexcept {}
+			void accessed(Sequence & seq, iterator it) noexcept { it->meta.referenced = true; }
+			void erased(Sequence & seq, iterator it) noexcept {}
+			void cleared() noexcept {}
+
+			iterator victim(Sequence & seq, iterator exclude) noexcept
+			{
+				for (;;)
+				{
+					auto it = seq.begin();
+					if (it != exclude and not it->meta.referenced)
+						return it;
+
+					it->meta.referenced = false;
+					seq.relocate(seq.end(), it);
+				}
+			}
+
+		public:
+			policy(std::size_t capacity, const Hasher & hash) noexcept {}
+		};
+	};
+
+	/// segmented LRU: новые элементы попадают в испытательный сегмент(probation),
+	/// повторное обращение переводит элемент в защищенный(protected), не больше protected_ratio емкости,
+	/// вытесненные из защищенного возвращаются в испытательный. Вытесняется LRU элемент испытательного сегмента,
+	/// так что однократное сканирование не вымывает часто используемые элементы.
+	/// Список: [probation | protected]
+	struct slru_eviction
+	{
+		static constexpr unsigned protected_percent = 80;
+
+		struct entry_data
+		{
+			bool is_protected = false;
+		};
+
+		template <class Sequence, class Hasher>
+		class policy
+		{
+			typedef typename Sequence::iterator iterator;
+
+		private:
+			iterator m_protected; // первый элемент защищенного сегмента, валиден если m_protected_count != 0
+			std::size_t m_protected_count = 0;
+			std::size_t m_protected_max;
+
+		private:
+			iterator protected_begin(Sequence & seq) const noexcept { return m_protected_count ? m_protected : seq.end(); }
+
+			/// LRU элементы защищенного сегмента становятся MRU испытательного, оставаясь на месте
+			void demote() noexcept
+			{
+				while (m_protected_count > m_protected_max)
+				{
+					m_protected->meta.is_protected = false;
+					++m_protected, --m_protected_count;
+				}
+			}
+
+		public:
+			/// при уменьшении емкости лишние элементы защищенного сегмента переводятся в испытательный при следующей вставке
+			void set_capacity(std::size_t capacity) noexcept { m_protected_max = capacity * protected_percent / 100; }
+			void cleared() noexcept { m_protected_count = 0; }
+
+			void inserted(Sequence & seq, iterator it) noexcept
+			{
+				demote();
+				seq.relocate(protected_begin(seq), it);
+			}
+
+			void accessed(Sequence & seq, iterator it) noexcept
+			{
+				if (it->meta.is_protected)
+				{
+					if (it == m_protected and m_protected_count > 1) ++m_protected;
+					seq.relocate(seq.end(), it);
+					return;
+				}
+
+				it->meta.is_protected = true;
+				seq.relocate(seq.end(), it);
+				if (m_protected_count++ == 0) m_protected = it;
+				demote();
+			}
+
+			void erased(Sequence & seq, iterator it) noexcept
+			{
+				if (not it->meta.is_protected) return;
+				if (it == m_protected) ++m_protected;
+				--m_protected_count;
+			}
+
+			iterator victim(Sequence & seq, iterator exclude) noexcept
+			{
+				auto it = seq.begin();
+				return it != exclude ? it : std::next(it);
+			}
+
+		public:
+			policy(std::size_t capacity, const Hasher & hash) noexcept { set_capacity(capacity); }
+		};
+	};
+
+	/// count-min sketch 4-битных счетчиков для оценки частоты обращений к ключам(используется W-TinyLFU).
+	/// Когда число инкрементов достигает 10 * capacity, все счетчики делятся пополам - старая история забывается.
+	class frequency_sketch
+	{
+		static constexpr unsigned depth = 4;
+		static constexpr unsigned max_count = 15;
+
+		std::vector<std::uint8_t> m_table;
+		std::size_t m_mask = 0;
+		std::size_t m_additions = 0;
+		std::size_t m_sample_size = 0;
+
+	private:
+		std::size_t index(std::size_t hash, unsigned row) const noexcept
+		{
+			static constexpr std::uint64_t seeds[depth] = {
+				0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull, 0x9ae16a3b2f90404full, 0xcbf29ce484222325ull,
+			};
+
+			std::uint64_t h = (static_cast<std::uint64_t>(hash) + seeds[row]) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 32;
+			return row * (m_mask + 1) + (static_cast<std::size_t>(h) & m_mask);
+		}
+
+		void reset() noexcept
+		{
+			for (auto & counter : m_table) counter >>= 1;
+			m_additions /= 2;
+		}
+
+	public:
+		/// пересоздает таблицу под заданное число элементов, история теряется
+		void resize(std::size_t capacity)
+		{
+			std::size_t width = 16;
+			while (width < capacity) width *= 2;
+
+			m_table.assign(width * depth, 0);
+			m_mask = width - 1;
+			m_additions = 0;
+			m_sample_size = 10 * std::max<std::size_t>(capacity, 1);
+		}
+
+		void clear() noexcept
+		{
+			std::fill(m_table.begin(), m_table.end(), 0);
+			m_additions = 0;
+		}
+
+		/// оценка частоты, не меньше реальной(с учетом делений пополам)
+		unsigned frequency(std::size_t hash) const noexcept
+		{
+			unsigned result = max_count;
+			for (unsigned row = 0; row < depth; ++row)
+				result = std::min<unsigned>(result, m_table[index(hash, row)]);
+
+			return result;
+		}
+
+		void increment(std::size_t hash) noexcept
+		{
+			for (unsigned row = 0; row < depth; ++row)
+			{
+				auto & counter = m_table[index(hash, row)];
+				if (counter < max_count) ++counter;
+			}
+
+			if (++m_additions >= m_sample_size)
+				reset();
+		}
+
+	public:
+		explicit frequency_sketch(std::size_t capacity = 0) { resize(capacity); }
+	};
+
+	/// W-TinyLFU: новые элементы попадают в маленькое окно LRU(window_percent емкости),
+	/// вытесненный из окна кандидат переходит в основную часть - SLRU [probation | protected].
+	/// Когда кеш переполнен, кандидат(MRU испытательного сегмента) сравнивается с LRU элементом испытательного сегмента
+	/// по частоте из frequency_sketch, вытесняется более редкий.
+	/// Окно позволяет принять всплески новых ключей, фильтр по частоте - не пускать однократно используемые ключи в основную часть.
+	/// Список: [probation | protected | window]
+	struct tinylfu_eviction
+	{
+		static constexpr unsigned window_percent = 1;
+		static constexpr unsigned protected_percent = 80;
+
+		enum segment_type : unsigned char { window, probation, protection };
+
+		struct entry_data
+		{
+			std::size_t hash = 0;
+			segment_type segment = window;
+		};
+
+		template <class Sequence, class Hasher>
+		class policy
+		{
+			typedef typename Sequence::iterator iterator;
+
+		private:
+			Hasher m_hash;
+			frequency_sketch m_sketch;
+
+			// первые элементы сегментов, валидны если соответствующий счетчик != 0
+			iterator m_protected, m_window;
+			std::size_t m_protected_count = 0, m_window_count = 0;
+			std::size_t m_protected_max, m_window_max;
+
+		private:
+			iterator window_begin(Sequence & seq) const noexcept { return m_window_count ? m_window : seq.end(); }
+			iterator protected_begin(Sequence & seq) const noexcept { return m_protected_count ? m_protected : window_begin(seq); }
+
+			/// LRU элементы защищенного сегмента становятся MRU испытательного, оставаясь на месте
+			void demote() noexcept
+			{
+				while (m_protected_count > m_protected_max)
+				{
+					m_protected->meta.segment = probation;
+					++m_protected, --m_protected_count;
+				}
+			}
+
+		public:
+			/// при уменьшении емкости сегменты приводятся к новым размерам при следующей вставке
+			void set_capacity(std::size_t capacity)
+			{
+				m_window_max = std::max<std::size_t>(1, capacity * window_percent / 100);
+				auto main_max = capacity > m_window_max ? capacity - m_window_max : 0;
+				m_protected_max = main_max * protected_percent / 100;
+				m_sketch.resize(capacity);
+			}
+
+			void cleared() noexcept
+			{
+				m_protected_count = m_window_count = 0;
+				m_sketch.clear();
+			}
+
+			void inserted(Sequence & seq, iterator it) noexcept
+			{
+				it->meta.hash = m_hash(it->key);
+				it->meta.segment = window;
+				m_sketch.increment(it->meta.hash);
+
+				demote();
+				if (m_window_count++ == 0) m_window = it;
+
+				// LRU элементы окна переходят в испытательный сегмент кандидатами
+				while (m_window_count > m_window_max)
+				{
+					auto candidate = m_window;
+					++m_window, --m_window_count;
+
+					candidate->meta.segment = probation;
+					seq.relocate(protected_begin(seq), candidate);
+				}
+			}
+
+			void accessed(Sequence & seq, iterator it) noexcept
+			{
+				m_sketch.increment(it->meta.hash);
+
+				switch (it->meta.segment)
+				{
+					case window:
+						if (it == m_window and m_window_count > 1) ++m_window;
+						seq.relocate(seq.end(), it);
+						return;
+
+					case protection:
+						if (it == m_protected and m_protected_count > 1) ++m_protected;
+						seq.relocate(window_begin(seq), it);
+						return;
+
+					case probation:
+						it->meta.segment = protection;
+						seq.relocate(window_begin(seq), it);
+						if (m_protected_count++ == 0) m_protected = it;
+						demote();
+						return;
+				}
+			}
+
+			void erased(Sequence & seq, iterator it) noexcept
+			{
+				switch (it->meta.segment)
+				{
+					case window:
+						if (it == m_window) ++m_window;
+						--m_window_count;
+						return;
+
+					case protection:
+						if (it == m_protected) ++m_protected;
+						--m_protected_count;
+						return;
+
+					case probation:
+						return;
+				}
+			}
+
+			iterator victim(Sequence & seq, iterator exclude) noexcept
+			{
+				auto victim = seq.begin();
+				if (victim == exclude) ++victim;
+				if (victim->meta.segment != probation) return victim;
+
+				auto candidate = std::prev(protected_begin(seq));
+				if (candidate == victim or candidate == exclude) return victim;
+
+				// допускается только кандидат, используемый чаще вытесняемого
+				if (m_sketch.frequency(candidate->meta.hash) > m_sketch.frequency(victim->meta.hash))
+					return victim;
+				else
+					return candidate;
+			}
+
+		public:
+			policy(std::size_t capacity, const Hasher & hash)
+				: m_hash(hash) { set_capacity(capacity); }
+		};
+	};
 
 	/// кеш с ручной подгрузкой данных
 	template <
 		class Key,
 		class Value,
 		class Hash = boost::hash<Key>,
-		class KeyEqual = std::equal_to<>
+		class KeyEqual = std::equal_to<>,
+		class EvictionPolicy = lru_eviction,
+		class Weigher = unit_weigher,
+		class Expiry = no_expiry
 	>
 	class manual_lru_cache
 	{
@@ -42,12 +517,25 @@ namespace ext
 		typedef Value mapped_type;
 		typedef Hash hasher;
 		typedef KeyEqual key_equal;
+		typedef EvictionPolicy eviction_policy;
+		typedef Weigher weigher;
+		typedef Expiry expiry;
 
 	private:
-		struct entry
+		typedef detail::lru_expiry_holder<expiry> expiry_holder;
+
+	public:
+		typedef typename expiry_holder::clock clock;
+		typedef typename clock::duration duration;
+		typedef typename clock::time_point time_point;
+
+	private:
+		struct entry : detail::lru_weight_holder<weigher>, expiry_holder
 		{
 			key_type key;
 			mapped_type value;
+			// данные политики вытеснения, не участвуют в индексе
+			mutable typename eviction_policy::entry_data meta;
 
 			entry(key_type && key, mapped_type && value)
 				: key(std::move(key)), value(std::move(value)) {}
@@ -70,50 +558,125 @@ namespace ext
 
 		typedef typename cache_container::template nth_index<ByCode>::type  code_view;
 		typedef typename cache_container::template nth_index<ByPos>::type   pos_view;
+		typedef typename eviction_policy::template policy<pos_view, hasher> policy_type;
 
 	private:
 		cache_container m_cache;
-		std::size_t m_cache_maxsize;
+		std::size_t m_cache_maxsize; // в весах, для unit_weigher - в элементах
+		std::size_t m_weight = 0;    // суммарный вес элементов
+		policy_type m_policy;
+		weigher m_weigher;
+
+		// срок жизни по умолчанию, очистка при вставке и позиция очистки - номер корзины хеш индекса
+		duration m_ttl = duration::max();
+		std::size_t m_sweep_step = 0;
+		std::size_t m_sweep_bucket = 0;
+
+		static time_point deadline(duration ttl)
+		{
+			auto now = clock::now();
+			return ttl >= time_point::max() - now ? time_point::max() : now + ttl;
+		}
+
+		void erase_entry(typename code_view::iterator it)
+		{
+			auto & pv = m_cache.template get<ByPos>();
+			auto posIt = m_cache.template project<ByPos>(it);
+			m_policy.erased(pv, posIt);
+			m_weight -= it->weight();
+			m_cache.erase(it);
+		}
 
 		void touch(typename code_view::iterator it)
 		{
 			auto & pv = m_cache.template get<ByPos>();
 			auto posIt = m_cache.template project<ByPos>(it);
-			// перемещаем элемент по it в конец списка
-			pv.relocate(pv.end(), posIt);
+			// для LRU - перемещаем элемент по it в конец списка
+			m_policy.accessed(pv, posIt);
 		}
 
-	public:
-		/// скидывает наиболее давно используемый элемент
-		void drop_last()
+		/// вытесняет элемент, выбранный политикой, кроме exclude
+		void evict(typename pos_view::iterator exclude)
 		{
 			auto & pv = m_cache.template get<ByPos>();
-			pv.pop_front();
+			auto it = m_policy.victim(pv, exclude);
+			m_policy.erased(pv, it);
+			m_weight -= it->weight();
+			pv.erase(it);
 		}
 
-		mapped_type & insert(key_type key, mapped_type data)
+		/// вытесняет элементы, пока вес превышает емкость, кроме exclude -
+		/// элемент тяжелее всей емкости остается в кеше один
+		void evict_overweight(typename pos_view::iterator exclude)
+		{
+			while (m_weight > m_cache_maxsize and m_cache.size() > 1)
+				evict(exclude);
+		}
+
+		mapped_type & insert_impl(key_type && key, mapped_type && data, time_point expires)
 		{
+			// до вставки, чтобы не удалить вставляемый элемент с нулевым сроком
+			if constexpr (expiry_holder::enabled)
+				if (m_sweep_step) expire(m_sweep_step);
+
+			std::size_t weight = m_weigher(static_cast<const key_type &>(key), static_cast<const mapped_type &>(data));
+
 			bool inserted;
 			typename code_view::iterator pos;
 			std::tie(pos, inserted) = m_cache.emplace(std::move(key), std::move(data));
+			auto posIt = m_cache.template project<ByPos>(pos);
 			
 			if (!inserted) {
 				// const_cast is safe because our index is only by key
 				auto & val = const_cast<mapped_type &>(pos->value);
 				boost::swap(val, data);
+				m_weight = m_weight - pos->weight() + weight;
+				pos->set_weight(weight);
+				pos->set_expiry(expires);
 				touch(pos);
+				evict_overweight(posIt);
 				return val;
 			}
 			else {
 				BOOST_ASSERT_MSG(m_cache_maxsize > 0, "lru_cache can't work with CacheMaxSize == 0");
-				if (m_cache_maxsize < m_cache.size())
-					drop_last();
+				pos->set_weight(weight);
+				pos->set_expiry(expires);
+				m_weight += weight;
+				m_policy.inserted(m_cache.template get<ByPos>(), posIt);
+				evict_overweight(posIt);
 				
 				// const_cast is safe because our index is only by key
 				return const_cast<mapped_type &>(pos->value);
 			}
 		}
 
+	public:
+		/// скидывает элемент, выбранный политикой вытеснения, для LRU - наиболее давно используемый
+		void drop_last()
+		{
+			if (m_cache.empty()) return;
+
+			auto & pv = m_cache.template get<ByPos>();
+			evict(pv.end());
+		}
+
+		/// вставляет или заменяет элемент, вытесняя столько элементов, сколько нужно, чтобы вес не превышал емкость.
+		/// Для кеша со сроком жизни - срок элемента ttl(), отсчитывается заново и при замене
+		mapped_type & insert(key_type key, mapped_type data)
+		{
+			if constexpr (expiry_holder::enabled)
+				return insert_impl(std::move(key), std::move(data), deadline(m_ttl));
+			else
+				return insert_impl(std::move(key), std::move(data), time_point());
+		}
+
+		/// вставляет или заменяет элемент с собственным сроком жизни, только для ttl_expiry
+		mapped_type & insert(key_type key, mapped_type data, duration ttl)
+		{
+			static_assert(expiry_holder::enabled, "lru_cache: ttl requires ttl_expiry");
+			return insert_impl(std::move(key), std::move(data), deadline(ttl));
+		}
+
 		/// получает данные по ключу, если таких данных нет, то throws std::out_of_range
 		mapped_type & at(key_param key)
 		{
@@ -123,12 +686,17 @@ namespace ext
 			else
 				throw std::out_of_range("lru_cache out of range");
 		}
-		/// получает данные по ключу, если таких данных нет, то returns nullptr
+		/// получает данные по ключу, если таких данных нет(или срок элемента истек), то returns nullptr
 		mapped_type * find_ptr(key_param key)
 		{
 			auto it = m_cache.find(key);
 			if (it == m_cache.end())
 				return nullptr;
+			else if (it->expired(expiry_holder::now()))
+			{
+				erase_entry(it);
+				return nullptr;
+			}
 			else
 			{
 				touch(it);
@@ -138,16 +706,20 @@ namespace ext
 		}
 
 		/// сбрасывает кеш
-		void clear()                 { m_cache.clear(); }
+		void clear()                 { m_cache.clear(); m_policy.cleared(); m_weight = 0; }
+		/// число элементов
 		std::size_t size() const     { return m_cache.size(); }
+		/// емкость в весах, для unit_weigher - в элементах
 		std::size_t maxsize() const  { return m_cache_maxsize; }
+		/// суммарный вес элементов, для unit_weigher равен size()
+		std::size_t weight() const   { return m_weight; }
 
-		/// скидывает элменты так что бы размер кеша не превышал size
+		/// скидывает элменты так что бы число элементов кеша не превышало size
 		void drop_to(std::size_t size)
 		{
 			auto & pv = m_cache.template get<ByPos>();
 			for (auto cursz = m_cache.size(); cursz > size; --cursz)
-				pv.pop_front();
+				evict(pv.end());
 		}
 
 		void set_maxsize(std::size_t size)
@@ -155,12 +727,68 @@ namespace ext
 			if (size == 0)
 				throw std::invalid_argument("lru_cache: CacheMaxSize == 0 is invalid");
 			
-			drop_to(size);
+			m_policy.set_capacity(size);
 			m_cache_maxsize = size;
+
+			auto & pv = m_cache.template get<ByPos>();
+			while (m_weight > size)
+				evict(pv.end());
+		}
+
+		/// срок жизни элементов, вставляемых без явного ttl, duration::max() - бессрочно(по умолчанию).
+		/// Только для ttl_expiry, уже вставленные элементы не меняются
+		void set_ttl(duration ttl)
+		{
+			static_assert(expiry_holder::enabled, "lru_cache: ttl requires ttl_expiry");
+			m_ttl = ttl;
+		}
+
+		duration ttl() const { return m_ttl; }
+
+		/// каждая вставка дополнительно выполняет expire(step), 0 - отключено(по умолчанию)
+		void set_sweep_step(std::size_t step)
+		{
+			static_assert(expiry_holder::enabled, "lru_cache: sweep requires ttl_expiry");
+			m_sweep_step = step;
 		}
 
-		explicit manual_lru_cache(std::size_t size)
-			: m_cache_maxsize(size) {}
+		/// инкрементальная очистка: удаляет просроченные элементы, выполняя не больше max_work шагов
+		/// (шаг - просмотр элемента или корзины хеш индекса), продолжает с места предыдущего вызова.
+		/// Возвращает число удаленных элементов
+		std::size_t expire(std::size_t max_work = -1)
+		{
+			static_assert(expiry_holder::enabled, "lru_cache: expire requires ttl_expiry");
+
+			auto & cv = m_cache.template get<ByCode>();
+			auto now = expiry_holder::now();
+			auto bucket_count = cv.bucket_count();
+			std::size_t removed = 0;
+
+			if (m_sweep_bucket >= bucket_count) m_sweep_bucket = 0;
+			for (std::size_t visited = 0; max_work and visited < bucket_count; ++visited)
+			{
+				auto bucket = m_sweep_bucket;
+				m_sweep_bucket = (bucket + 1) % bucket_count;
+				--max_work;
+
+				// erase не инвалидирует итераторы других элементов
+				for (auto lit = cv.begin(bucket); max_work and lit != cv.end(bucket); --max_work)
+				{
+					auto & item = *lit++;
+					if (item.expired(now))
+					{
+						erase_entry(cv.iterator_to(item));
+						++removed;
+					}
+				}
+			}
+
+			return removed;
+		}
+
+		/// size - емкость в весах Weigher, для unit_weigher - в элементах
+		explicit manual_lru_cache(std::size_t size, weigher w = weigher())
+			: m_cache_maxsize(size), m_policy(size, m_cache.hash_function()), m_weigher(std::move(w)) {}
 
 		manual_lru_cache(const manual_lru_cache &) = delete;
 		manual_lru_cache & operator =(const manual_lru_cache &) = delete;
@@ -172,12 +800,18 @@ namespace ext
 		{
 			boost::swap(m_cache, other.m_cache);
 			boost::swap(m_cache_maxsize, other.m_cache_maxsize);
+			boost::swap(m_weight, other.m_weight);
+			boost::swap(m_policy, other.m_policy);
+			boost::swap(m_weigher, other.m_weigher);
+			boost::swap(m_ttl, other.m_ttl);
+			boost::swap(m_sweep_step, other.m_sweep_step);
+			boost::swap(m_sweep_bucket, other.m_sweep_bucket);
 		}
 	};
 
-	template <class Key, class Value, class Hash, class KeyEqual>
-	inline void swap(manual_lru_cache<Key, Value, Hash, KeyEqual> & c1,
-	                 manual_lru_cache<Key, Value, Hash, KeyEqual> & c2) noexcept
+	template <class Key, class Value, class Hash, class KeyEqual, class EvictionPolicy, class Weigher, class Expiry>
+	inline void swap(manual_lru_cache<Key, Value, Hash, KeyEqual, EvictionPolicy, Weigher, Expiry> & c1,
+	                 manual_lru_cache<Key, Value, Hash, KeyEqual, EvictionPolicy, Weigher, Expiry> & c2) noexcept
 	{
 		c1.swap(c2);
 	}
@@ -190,13 +824,20 @@ namespace ext
 		class Value,
 		class Hash = boost::hash<Key>,
 		class KeyEqual = std::equal_to<>,
-		class Acquire = std::function<Value(const Key &)>
+		class Acquire = std::function<Value(const Key &)>,
+		class EvictionPolicy = lru_eviction,
+		class Weigher = unit_weigher,
+		class Expiry = no_expiry
 	>
-	class lru_cache : private manual_lru_cache<Key, Value, Hash, KeyEqual>
+	class lru_cache : private manual_lru_cache<Key, Value, Hash, KeyEqual, EvictionPolicy, Weigher, Expiry>
 	{
-		typedef manual_lru_cache<Key, Value, Hash, KeyEqual> base_type;
+		typedef manual_lru_cache<Key, Value, Hash, KeyEqual, EvictionPolicy, Weigher, Expiry> base_type;
 		
 	public:
+		using typename base_type::eviction_policy;
+		using typename base_type::weigher;
+		using typename base_type::expiry;
+		using typename base_type::duration;
 		using typename base_type::key_type;
 		using typename base_type::mapped_type;
 		using typename base_type::hasher;
@@ -216,11 +857,16 @@ namespace ext
 		using base_type::clear;
 		using base_type::size;
 		using base_type::maxsize;
+		using base_type::weight;
 		using base_type::drop_last;
 		using base_type::drop_to;
 		using base_type::set_maxsize;
+		using base_type::set_ttl;
+		using base_type::ttl;
+		using base_type::set_sweep_step;
+		using base_type::expire;
 	
-		/// получает данные по ключу
+		/// получает данные по ключу, просроченные данные получаются заново
 		mapped_type & at(key_param key)
 		{
 			auto * val = base_type::find_ptr(key);
@@ -228,8 +874,8 @@ namespace ext
 			return *val;
 		}
 
-		explicit lru_cache(std::size_t size, Acquire ac)
-			: base_type(size), m_Acquire(std::move(ac)) {}
+		explicit lru_cache(std::size_t size, Acquire ac, weigher w = weigher())
+			: base_type(size, std::move(w)), m_Acquire(std::move(ac)) {}
 
 		lru_cache(const lru_cache &) = delete;
 		lru_cache & operator =(const lru_cache &) = delete;
@@ -244,9 +890,9 @@ namespace ext
 		}
 	};
 
-	template <class Key, class Value, class Hash, class KeyEqual, class Acquire>
-	inline void swap(lru_cache<Key, Value, Hash, KeyEqual, Acquire> & c1,
-	                 lru_cache<Key, Value, Hash, KeyEqual, Acquire> & c2) noexcept
+	template <class Key, class Value, class Hash, class KeyEqual, class Acquire, class EvictionPolicy, class Weigher, class Expiry>
+	inline void swap(lru_cache<Key, Value, Hash, KeyEqual, Acquire, EvictionPolicy, Weigher, Expiry> & c1,
+	                 lru_cache<Key, Value, Hash, KeyEqual, Acquire, EvictionPolicy, Weigher, Expiry> & c2) noexcept
 	{
 		c1.swap(c2);
 	}
@@ -0,0 +1,163 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace ext
+{
+	/// Bounded lock-free multi producer, multi consumer queue, see:
+	///   "Bounded MPMC queue", D. Vyukov, 1024cores.net
+	///
+	/// Queue is a ring buffer of cells, every cell holds a sequence number,
+	/// which tells if cell is ready for producer(sequence == position) or for consumer(sequence == position + 1).
+	/// Producers and consumers reserve positions with CAS on enqueue/dequeue counters, no locks are taken.
+	///
+	/// try_push/try_pop never block: try_push returns false if queue is full, try_pop returns false if queue is empty.
+	/// Type must be nothrow move constructible, typically it is a pointer.
+	template <class Type>
+	class mpmc_queue
+	{
+		static_assert(std::is_nothrow_move_constructible_v<Type>, "mpmc_queue: Type must be nothrow move constructible");
+
+	public:
+		using value_type = Type;
+
+	private:
+		// avoid false sharing between producers and consumers counters
+		static constexpr std::size_t cache_line_size = 64;
+		static constexpr std::size_t default_capacity = 1024;
+
+		struct cell
+		{
+			std::atomic_size_t sequence;
+			std::aligned_storage_t<sizeof(value_type), alignof(value_type)> storage;
+
+			value_type * value() noexcept { return std::launder(reinterpret_cast<value_type *>(&storage)); }
+		};
+
+	private:
+		alignas(cache_line_size) std::unique_ptr<cell[]> m_cells;
+		std::size_t m_mask;
+
+		alignas(cache_line_size) std::atomic_size_t m_enqueue_pos = ATOMIC_VAR_INIT(0);
+		alignas(cache_line_size) std::atomic_size_t m_dequeue_pos = ATOMIC_VAR_INIT(0);
+
+	public:
+		/// pushes item, returns false if queue is full, in that case val is not moved from
+		bool try_push(value_type & val) noexcept;
+		bool try_push(value_type && val) noexcept { return try_push(val); }
+		/// pops item, returns false if queue is empty
+		bool try_pop(value_type & val) noexcept;
+
+		/// approximate number of items, exact only if there are no concurrent operations
+		std::size_t size() const noexcept;
+		bool empty() const noexcept { return size() == 0; }
+		std::size_t capacity() const noexcept { return m_mask + 1; }
+
+	public:
+		/// capacity is rounded up to power of 2, minimum 2
+		mpmc_queue(std::size_t capacity = default_capacity);
+		~mpmc_queue() noexcept;
+
+		mpmc_queue(mpmc_queue &&) = delete;
+		mpmc_queue & operator =(mpmc_queue &&) = delete;
+	};
+
+	template <class Type>
+	bool mpmc_queue<Type>::try_push(value_type & val) noexcept
+	{
+		cell * c;
+		std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			c = &m_cells[pos & m_mask];
+			std::size_t seq = c->sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+
+			if (diff == 0)
+			{	// cell is free, try to reserve it
+				if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				// cell still holds item from previous lap - queue is full
+				return false;
+			else
+				// other producer took this position
+				pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		}
+
+		new (&c->storage) value_type(std::move(val));
+		c->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <class Type>
+	bool mpmc_queue<Type>::try_pop(value_type & val) noexcept
+	{
+		cell * c;
+		std::size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			c = &m_cells[pos & m_mask];
+			std::size_t seq = c->sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+
+			if (diff == 0)
+			{	// cell is filled, try to reserve it
+				if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				// cell is not yet filled - queue is empty
+				return false;
+			else
+				// other consumer took this position
+				pos = m_dequeue_pos.load(std::memory_order_relaxed);
+		}
+
+		auto * ptr = c->value();
+		val = std::move(*ptr);
+		ptr->~value_type();
+
+		// free cell for producer on next lap
+		c->sequence.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <class Type>
+	std::size_t mpmc_queue<Type>::size() const noexcept
+	{
+		auto dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+		auto enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+	}
+
+	template <class Type>
+	mpmc_queue<Type>::mpmc_queue(std::size_t capacity)
+	{
+		// capacity must be power of 2
+		std::size_t cap = 2;
+		while (cap < capacity) cap *= 2;
+
+		m_cells = std::make_unique<cell[]>(cap);
+		m_mask = cap - 1;
+
+		for (std::size_t idx = 0; idx != cap; ++idx)
+			m_cells[idx].sequence.store(idx, std::memory_order_relaxed);
+	}
+
+	template <class Type>
+	mpmc_queue<Type>::~mpmc_queue() noexcept
+	{
+		auto first = m_dequeue_pos.load(std::memory_order_relaxed);
+		auto last = m_enqueue_pos.load(std::memory_order_relaxed);
+
+		for (; first != last; ++first)
+			m_cells[first & m_mask].value()->~value_type();
+	}
+}
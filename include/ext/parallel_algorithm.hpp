@@ -0,0 +1,385 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <optional>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <ext/future.hpp>
+#include <ext/thread_pool.hpp>
+
+namespace ext
+{
+	/// Parallel algorithms executed on ext::thread_pool.
+	///
+	/// Range [first, last) is processed in chunks, distributed dynamically between participants:
+	/// calling thread and up to pool.get_nworkers() helper tasks submitted into pool.
+	/// Chunks are distributed with guided scheduling: each taken chunk is remaining / (2 * participants),
+	/// but not less than grain. So at first big contiguous chunks are taken, and chunks shrink near the end for load balancing.
+	/// grain == 0 means choose automatically.
+	///
+	/// Calling thread participates in processing until there are no more chunks to take,
+	/// after that function returns future, which becomes ready when every helper task has either finished
+	/// or was abandoned by pool(thread_pool::clear or destruction) without running.
+	/// So waiting on future from inside pool worker is safe even if helpers never get a worker, pool clear releases them.
+	/// If there are no workers in pool - whole range is processed by calling thread.
+	///
+	/// If functor throws - no more chunks are taken, future holds first thrown exception.
+	/// If returned future is cancelled - no more chunks are taken.
+	/// Iterators must be random access, range and functors must live until future becomes ready.
+
+	namespace parallel_detail
+	{
+		/// base state of parallel algorithm, also a shared state of returned future.
+		template <class Result>
+		class loop_state : public ext::shared_state<Result>
+		{
+		protected:
+			std::size_t m_size;
+			std::size_t m_grain;
+			std::size_t m_participants;
+
+			std::atomic_size_t m_next = ATOMIC_VAR_INIT(0);   // start of next not taken chunk
+			std::atomic_size_t m_active = ATOMIC_VAR_INIT(1); // participants not yet finished, initially calling thread
+
+			std::mutex m_mutex; // guards m_exception and derived classes data
+			std::exception_ptr m_exception;
+
+		protected:
+			/// takes next chunk [first, last), returns false if there are no more
+			bool take(std::size_t & first, std::size_t & last) noexcept;
+			/// stores first exception and stops chunks distribution
+			void fail(std::exception_ptr ex) noexcept;
+
+			/// participant body, processes chunks until there are no more
+			virtual void run() noexcept = 0;
+			/// called by last finished participant, should fulfill promise
+			virtual void complete() noexcept = 0;
+
+		public:
+			/// participates in processing, last finished participant completes the promise
+			void participate() noexcept;
+			/// registers new participant(before submitting it into thread_pool)
+			void enter() noexcept { m_active.fetch_add(1, std::memory_order_relaxed); }
+			/// unregisters participant, which will not run
+			void leave() noexcept;
+
+		public:
+			loop_state(std::size_t size, std::size_t grain, std::size_t participants) noexcept;
+		};
+
+		template <class Result>
+		loop_state<Result>::loop_state(std::size_t size, std::size_t grain, std::size_t participants) noexcept
+			: m_size(size), m_grain(grain), m_participants(participants)
+		{
+			// automatic grain: no more than 32 chunks per participant on average
+			if (m_grain == 0) m_grain = std::max<std::size_t>(1, size / (participants * 32));
+		}
+
+		template <class Result>
+		bool loop_state<Result>::take(std::size_t & first, std::size_t & last) noexcept
+		{
+			// cancelled
+			if (this->is_ready()) return false;
+
+			std::size_t cur = m_next.load(std::memory_order_relaxed);
+			do {
+				if (cur >= m_size) return false;
+
+				auto remaining = m_size - cur;
+				auto chunk = std::max(m_grain, remaining / (2 * m_participants));
+				last = cur + std::min(chunk, remaining);
+			} while (not m_next.compare_exchange_weak(cur, last, std::memory_order_relaxed));
+
+			first = cur;
+			return true;
+		}
+
+		template <class Result>
+		void loop_state<Result>::fail(std::exception_ptr ex) noexcept
+		{
+			m_next.store(m_size, std::memory_order_relaxed);
+
+			std::lock_guard lk(m_mutex);
+			if (not m_exception) m_exception = std::move(ex);
+		}
+
+		template <class Result>
+		void loop_state<Result>::participate() noexcept
+		{
+			run();
+			leave();
+		}
+
+		template <class Result>
+		void loop_state<Result>::leave() noexcept
+		{
+			// acq_rel: last participant must see results of all others
+			if (m_active.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+			if (m_exception)
+				this->set_exception(m_exception);
+			else
+				complete();
+		}
+
+		template <class RandomAccessIterator, class Functor>
+		class for_each_state : public loop_state<void>
+		{
+			RandomAccessIterator m_first;
+			Functor m_func;
+
+		protected:
+			void run() noexcept override;
+			void complete() noexcept override { this->set_value(); }
+
+		public:
+			for_each_state(RandomAccessIterator first, std::size_t size, Functor func, std::size_t grain, std::size_t participants)
+				: loop_state(size, grain, participants), m_first(first), m_func(std::move(func)) {}
+		};
+
+		template <class RandomAccessIterator, class Functor>
+		void for_each_state<RandomAccessIterator, Functor>::run() noexcept
+		{
+			try
+			{
+				std::size_t first, last;
+				while (take(first, last))
+				{
+					auto it = m_first + first;
+					for (; first != last; ++first, ++it)
+						m_func(*it);
+				}
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+		}
+
+		template <class RandomAccessIterator, class OutputIterator, class Functor>
+		class transform_state : public loop_state<OutputIterator>
+		{
+			using base_type = loop_state<OutputIterator>;
+
+			RandomAccessIterator m_first;
+			OutputIterator m_dest;
+			Functor m_func;
+
+		protected:
+			void run() noexcept override;
+			void complete() noexcept override;
+
+		public:
+			transform_state(RandomAccessIterator first, std::size_t size, OutputIterator dest, Functor func, std::size_t grain, std::size_t participants)
+				: base_type(size, grain, participants), m_first(first), m_dest(dest), m_func(std::move(func)) {}
+		};
+
+		template <class RandomAccessIterator, class OutputIterator, class Functor>
+		void transform_state<RandomAccessIterator, OutputIterator, Functor>::run() noexcept
+		{
+			try
+			{
+				std::size_t first, last;
+				while (this->take(first, last))
+				{
+					auto it = m_first + first;
+					auto out = m_dest + first;
+					for (; first != last; ++first, ++it, ++out)
+						*out = m_func(*it);
+				}
+			}
+			catch (...)
+			{
+				this->fail(std::current_exception());
+			}
+		}
+
+		template <class RandomAccessIterator, class OutputIterator, class Functor>
+		void transform_state<RandomAccessIterator, OutputIterator, Functor>::complete() noexcept
+		{
+			try
+			{
+				this->set_value(m_dest + this->m_size);
+			}
+			catch (...)
+			{
+				this->set_exception(std::current_exception());
+			}
+		}
+
+		template <class RandomAccessIterator, class Type, class BinaryOperation>
+		class reduce_state : public loop_state<Type>
+		{
+			using base_type = loop_state<Type>;
+
+			RandomAccessIterator m_first;
+			Type m_init;
+			BinaryOperation m_op;
+			std::optional<Type> m_result; // guarded by m_mutex
+
+		protected:
+			void run() noexcept override;
+			void complete() noexcept override;
+
+		public:
+			reduce_state(RandomAccessIterator first, std::size_t size, Type init, BinaryOperation op, std::size_t grain, std::size_t participants)
+				: base_type(size, grain, participants), m_first(first), m_init(std::move(init)), m_op(std::move(op)) {}
+		};
+
+		template <class RandomAccessIterator, class Type, class BinaryOperation>
+		void reduce_state<RandomAccessIterator, Type, BinaryOperation>::run() noexcept
+		{
+			try
+			{
+				// every participant reduces own chunks locally, and merges result once at the end
+				std::optional<Type> local;
+				std::size_t first, last;
+
+				while (this->take(first, last))
+				{
+					auto it = m_first + first;
+					auto end = m_first + last;
+
+					Type acc = *it++;
+					for (; it != end; ++it)
+						acc = m_op(std::move(acc), *it);
+
+					local = local ? m_op(std::move(*local), std::move(acc)) : std::move(acc);
+				}
+
+				if (not local) return;
+
+				std::lock_guard lk(this->m_mutex);
+				m_result = m_result ? m_op(std::move(*m_result), std::move(*local)) : std::move(*local);
+			}
+			catch (...)
+			{
+				this->fail(std::current_exception());
+			}
+		}
+
+		template <class RandomAccessIterator, class Type, class BinaryOperation>
+		void reduce_state<RandomAccessIterator, Type, BinaryOperation>::complete() noexcept
+		{
+			try
+			{
+				if (m_result)
+					this->set_value(m_op(std::move(m_init), std::move(*m_result)));
+				else
+					this->set_value(std::move(m_init));
+			}
+			catch (...)
+			{
+				this->set_exception(std::current_exception());
+			}
+		}
+
+		/// helper task body, owns participant registration: if task is destroyed without running
+		/// (abandoned by thread_pool, or failed to be posted) - participant leaves, so result still becomes ready
+		template <class State>
+		class helper
+		{
+			ext::intrusive_ptr<State> m_state;
+
+		public:
+			void operator()() { std::exchange(m_state, nullptr)->participate(); }
+
+		public:
+			helper(ext::intrusive_ptr<State> state) noexcept
+				: m_state(std::move(state)) { m_state->enter(); }
+
+			~helper() { if (m_state) m_state->leave(); }
+
+			helper(helper && other) noexcept = default;
+			helper & operator =(helper && other) = delete;
+		};
+
+		/// runs state with helpers from pool and calling thread, returns future
+		template <class Result, class State>
+		ext::future<Result> run(thread_pool & pool, ext::intrusive_ptr<State> state, unsigned helpers)
+		{
+			ext::future<Result> result {state};
+
+			for (unsigned i = 0; i < helpers; ++i)
+			{
+				try
+				{
+					// calling thread is still a participant, so if helper leaves here - it can't become last
+					pool.post(helper<State>(state));
+				}
+				catch (...)
+				{
+					break;
+				}
+			}
+
+			state->participate();
+			return result;
+		}
+
+		template <class RandomAccessIterator>
+		inline std::size_t range_size(RandomAccessIterator first, RandomAccessIterator last)
+		{
+			using iter_cat = typename std::iterator_traits<RandomAccessIterator>::iterator_category;
+			static_assert(std::is_convertible_v<iter_cat, std::random_access_iterator_tag>, "not a random access iterator");
+
+			return static_cast<std::size_t>(last - first);
+		}
+
+		inline unsigned helpers_count(thread_pool & pool, std::size_t size, std::size_t grain)
+		{
+			std::size_t helpers = pool.get_nworkers();
+			if (grain) helpers = std::min(helpers, (size + grain - 1) / grain - 1);
+			return static_cast<unsigned>(std::min(helpers, size - 1));
+		}
+	}
+
+	/// calls func(*it) for every element of [first, last) in parallel.
+	template <class RandomAccessIterator, class Functor>
+	ext::future<void> parallel_for(thread_pool & pool, RandomAccessIterator first, RandomAccessIterator last, Functor func, std::size_t grain = 0)
+	{
+		using state_type = parallel_detail::for_each_state<RandomAccessIterator, Functor>;
+
+		auto size = parallel_detail::range_size(first, last);
+		if (size == 0) return ext::make_ready_future();
+
+		auto helpers = parallel_detail::helpers_count(pool, size, grain);
+		auto state = ext::make_intrusive<state_type>(first, size, std::move(func), grain, helpers + 1);
+		return parallel_detail::run<void>(pool, std::move(state), helpers);
+	}
+
+	/// assigns *(dest + i) = func(*(first + i)) for every element of [first, last) in parallel.
+	/// Returns future holding iterator past last written element.
+	template <class RandomAccessIterator, class OutputIterator, class Functor>
+	ext::future<OutputIterator> parallel_transform(thread_pool & pool, RandomAccessIterator first, RandomAccessIterator last, OutputIterator dest, Functor func, std::size_t grain = 0)
+	{
+		using state_type = parallel_detail::transform_state<RandomAccessIterator, OutputIterator, Functor>;
+
+		auto size = parallel_detail::range_size(first, last);
+		if (size == 0) return ext::make_ready_future(dest);
+
+		auto helpers = parallel_detail::helpers_count(pool, size, grain);
+		auto state = ext::make_intrusive<state_type>(first, size, dest, std::move(func), grain, helpers + 1);
+		return parallel_detail::run<OutputIterator>(pool, std::move(state), helpers);
+	}
+
+	/// reduces [first, last) with init using op in parallel, order of reduction is unspecified:
+	/// op must be associative and commutative, like for std::reduce.
+	template <class RandomAccessIterator, class Type, class BinaryOperation = std::plus<>>
+	ext::future<Type> parallel_reduce(thread_pool & pool, RandomAccessIterator first, RandomAccessIterator last, Type init, BinaryOperation op = {}, std::size_t grain = 0)
+	{
+		using state_type = parallel_detail::reduce_state<RandomAccessIterator, Type, BinaryOperation>;
+
+		auto size = parallel_detail::range_size(first, last);
+		if (size == 0) return ext::make_ready_future(std::move(init));
+
+		auto helpers = parallel_detail::helpers_count(pool, size, grain);
+		auto state = ext::make_intrusive<state_type>(first, size, std::move(init), std::move(op), grain, helpers + 1);
+		return parallel_detail::run<Type>(pool, std::move(state), helpers);
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <new>
+
+namespace ext
+{
+	/// Size-classed allocator for small short living objects, like thread_pool tasks.
+	///
+	/// Sizes are rounded up to granularity, every size class has:
+	///  - per thread cache: single linked list of free blocks, no locks, no atomics;
+	///  - global depot: list of batches of free blocks, guarded by mutex.
+	/// Freed block goes into cache of freeing thread, when cache grows over cache_limit -
+	/// batch of blocks is moved into depot, where it can be taken by other thread whose cache is empty.
+	/// So objects allocated in one thread and freed in other(submitter and worker) circulate through depot,
+	/// and in steady state no calls to ::operator new/delete are made.
+	///
+	/// Blocks are never returned to system while in depot(up to depot_limit batches per size class),
+	/// thread cache is flushed into depot on thread exit.
+	/// Sizes greater than max_size are forwarded to ::operator new/delete.
+	class small_object_allocator
+	{
+	public:
+		static constexpr std::size_t granularity = 16;
+		static constexpr std::size_t max_size = 512;
+		static constexpr std::size_t size_classes = max_size / granularity;
+
+		static constexpr std::size_t batch_size = 32;
+		static constexpr std::size_t cache_limit = 2 * batch_size;
+		static constexpr std::size_t depot_limit = 64;
+
+	public:
+		/// allocates block of at least size bytes, aligned as by ::operator new, throws std::bad_alloc
+		static void * allocate(std::size_t size);
+		/// deallocates block previously allocated with allocate, size must be same
+		static void deallocate(void * ptr, std::size_t size) noexcept;
+	};
+
+	/// base class providing class level operator new/delete via small_object_allocator.
+	/// Works for polymorphic hierarchies: deletion via virtual destructor passes size of most derived class.
+	/// Over-aligned types are forwarded to aligned ::operator new/delete.
+	class small_object
+	{
+	public:
+		static void * operator new(std::size_t size) { return small_object_allocator::allocate(size); }
+		static void operator delete(void * ptr, std::size_t size) noexcept { small_object_allocator::deallocate(ptr, size); }
+
+		static void * operator new(std::size_t size, std::align_val_t al) { return ::operator new(size, al); }
+		static void operator delete(void * ptr, std::size_t size, std::align_val_t al) noexcept { ::operator delete(ptr, size, al); }
+	};
+}
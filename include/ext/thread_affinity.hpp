@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <thread>
+
+namespace ext
+{
+	/// set of logical CPU numbers
+	typedef std::vector<unsigned> cpu_set;
+
+	/// pins thread to given CPUs, returns false if failed or not supported on this platform.
+	/// On windows only CPUs of first processor group(0-63) are supported
+	bool set_thread_affinity(std::thread & thr, const cpu_set & cpus);
+	/// returns CPUs current thread is allowed to run on, empty set if not supported on this platform
+	cpu_set get_thread_affinity();
+	/// returns number of CPU current thread is running on, -1 if not supported on this platform
+	int current_cpu() noexcept;
+
+	/// returns CPUs of every NUMA node having CPUs, ordered by node number.
+	/// Node numbers can be sparse and memory only nodes are skipped, so index in result is not a node number.
+	/// On non NUMA systems or if topology can't be detected - single node with all CPUs
+	std::vector<cpu_set> numa_nodes();
+
+	/// splits cpus into single CPU sets: {{c0}, {c1}, ...}, useful for round-robin pinning of workers over a mask
+	std::vector<cpu_set> round_robin_affinity(const cpu_set & cpus);
+}
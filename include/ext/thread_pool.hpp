@@ -1,12 +1,20 @@
 ﻿#pragma once
 #include <memory>
+#include <algorithm>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <chrono>
+#include <optional>
 
 #include <boost/intrusive/list.hpp>
 #include <ext/intrusive_ptr.hpp>
 #include <ext/future.hpp>
+#include <ext/work_stealing_deque.hpp>
+#include <ext/mpmc_queue.hpp>
+#include <ext/small_object_allocator.hpp>
+#include <ext/thread_affinity.hpp>
+#include <ext/executor_metrics.hpp>
 
 namespace ext
 {
@@ -16,6 +24,41 @@ namespace ext
 	/// Number of running threads can be controlled via set_nworkers/get_nworkers methods.
 	/// By default thread_pool constructed with 0 workers, you must explicitly set number you want.
 	/// 
+	/// By default all tasks are placed into single FIFO queue, guarded by mutex.
+	/// With work_stealing option every worker owns a lock-free Chase-Lev deque:
+	/// tasks submitted from worker thread go to it's own deque, tasks submitted from other threads go to shared queue,
+	/// idle workers steal tasks from deques of other workers.
+	/// With lockfree_queue option tasks submitted from non worker threads go to bounded lock-free MPMC queue,
+	/// so submitters and workers do not serialize on a mutex, if queue is full - tasks go to shared queue.
+	/// Idle workers spin for a while polling queue before going to sleep on condition variable.
+	/// 
+	/// Tasks can be submitted with priority: high, normal(default) or low, every priority is a separate lane.
+	/// Normal lane are queues described above, high and low lanes are FIFO queues guarded by mutex.
+	/// By default dequeueing is strict: high lane first, than normal, than low.
+	/// With weighted_priority option lanes are served in weighted round robin by lane_weights,
+	/// so lower lanes are not starved when higher ones are saturated.
+	/// 
+	/// Workers can be pinned to CPUs, see set_worker_affinity.
+	/// With numa_aware option workers are distributed round-robin over NUMA nodes and pinned to node CPUs,
+	/// shared queue is split into per node queues: task submitted from worker goes to it's node queue,
+	/// from other thread - to queue of node of current CPU; worker takes tasks from own node queue first,
+	/// than from other nodes. In work_stealing mode worker deques are local by nature, node queues replace shared queue only.
+	/// 
+	/// If EXT_ENABLE_EXECUTOR_METRICS is defined, thread_pool collects metrics, see metrics method:
+	/// per worker counters and histograms of queue latency and run time, written by worker without locks.
+	/// Also hooks can be installed, called around every task, see set_task_hooks.
+	/// Timestamps are taken with ext::metrics_clock(TSC where reliable): on submit, when worker dequeues task
+	/// and after task execution. Metrics are not free, cost is dominated by those three clock reads,
+	/// see thread_pool_submit_benchmark; with steady_clock fallback it's noticeably more.
+	/// Enable metrics where tasks are not very fine grained.
+	/// 
+	/// Tasks can be submitted with cancellation_token: when cancellation is requested task future is cancelled,
+	/// and task still sitting in a queue is dropped by worker without execution, see submit(cancellation_token, ...).
+	/// 
+	/// Optionally number of workers can be managed automatically, see set_autoscale:
+	/// supervisor thread adds worker when tasks are waiting longer than wait_threshold with no idle workers,
+	/// worker idle longer than idle_timeout retires itself, number of workers stays in [min_workers, max_workers].
+	/// 
 	/// All methods are thread-safe
 	class thread_pool
 	{
@@ -23,11 +66,86 @@ namespace ext
 			boost::intrusive::link_mode<boost::intrusive::link_mode_type::normal_link>
 		> hook_type;
 
+	public:
+		/// construction options
+		enum options : unsigned
+		{
+			/// single shared FIFO queue, default
+			fifo          = 0,
+			/// per worker deques with work stealing, see class description
+			work_stealing = 1u << 0,
+			/// bounded lock-free queue for submitted tasks with spin-then-park waiting, see class description.
+			/// Can be combined with work_stealing
+			lockfree_queue = 1u << 1,
+			/// weighted round robin dequeueing of priority lanes instead of strict, see class description
+			weighted_priority = 1u << 2,
+			/// per NUMA node shared queues and worker placement, see class description
+			numa_aware = 1u << 3,
+		};
+
+		/// task priority lanes
+		enum class priority : unsigned
+		{
+			high   = 0,
+			normal = 1,
+			low    = 2,
+		};
+
+		static constexpr unsigned priority_lanes = 3;
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		/// counters of worker
+		struct worker_metrics
+		{
+			std::uint64_t executed = 0;
+			std::uint64_t steals = 0;
+			/// tasks dropped without execution, because they were cancelled while in queue
+			std::uint64_t cancelled = 0;
+			/// time spent sleeping waiting for tasks, spinning is not included
+			std::chrono::nanoseconds idle_time = std::chrono::nanoseconds::zero();
+		};
+
+		/// snapshot of thread_pool metrics, see metrics method
+		struct metrics_type
+		{
+			/// running workers
+			std::vector<worker_metrics> workers;
+			/// sum over stopped and retired workers
+			worker_metrics retired;
+			/// time from placing task into queue till it's execution start, all workers
+			ext::latency_histogram queue_latency;
+			/// task execution time, all workers
+			ext::latency_histogram run_time;
+		};
+	#endif
+
+		/// auto-scaling policy, see set_autoscale
+		struct autoscale_options
+		{
+			unsigned min_workers = 0;
+			unsigned max_workers = std::max(1u, std::thread::hardware_concurrency());
+			/// tasks pending this long with no idle workers cause new worker creation, also supervisor check period
+			std::chrono::steady_clock::duration wait_threshold = std::chrono::milliseconds(10);
+			/// worker idle this long is retired
+			std::chrono::steady_clock::duration idle_timeout = std::chrono::seconds(10);
+		};
+
+		/// weighted_priority mode: out of every 7 dequeues worker prefers high lane 4 times, normal - 2, low - 1.
+		/// If preferred lane is empty - lanes are tried in strict order
+		static constexpr unsigned lane_weights[priority_lanes] = {4, 2, 1};
+
 	private:
 		/// base interface for submitted tasks,
 		/// tasks are hold in intrusive linked list.
-		class task_base : public hook_type
+		/// Task is also a shared state of returned future, single object is allocated via small_object_allocator,
+		/// so steady state submission does not call ::operator new.
+		class task_base : public hook_type, public ext::small_object
 		{
+		public:
+		#ifdef EXT_ENABLE_EXECUTOR_METRICS
+			// time of placing into queue, for queue latency
+			ext::metrics_clock::time_point enqueued;
+		#endif
+
 		public:
 			virtual ~task_base() = default;
 
@@ -38,6 +156,8 @@ namespace ext
 			virtual void task_release() noexcept = 0;
 			virtual void task_abandone() noexcept = 0;
 			virtual void task_execute() noexcept = 0;
+			/// task result is already cancelled, so there is no need to execute it
+			virtual bool task_cancelled() const noexcept = 0;
 
 		public:
 			friend inline void intrusive_ptr_add_ref(task_base * ptr) noexcept { ptr->task_addref(); }
@@ -58,6 +178,7 @@ namespace ext
 			void task_release() noexcept override { base_type::release(); }
 			void task_abandone() noexcept override { base_type::release_promise(); }
 			void task_execute() noexcept override { base_type::execute(); }
+			bool task_cancelled() const noexcept override { return base_type::is_cancelled(); }
 
 		public:
 			// inherit constructors
@@ -69,24 +190,89 @@ namespace ext
 			friend inline void intrusive_ptr_use_count(const task_impl * ptr) noexcept {}
 		};
 
-		class delayed_task_continuation :
-			public ext::continuation_base,
-			public hook_type
+		/// implementation of task_base for post: no shared state and promise, just a functor.
+		/// Task is owned only by tasks queue, ownership is transferred under queue synchronization,
+		/// so reference counter is not atomic.
+		template <class Functor>
+		class post_task_impl : public task_base
+		{
+			unsigned m_refs = 1;
+			Functor m_func;
+
+		public:
+			void task_addref()  noexcept override { ++m_refs; }
+			void task_release() noexcept override { if (--m_refs == 0) delete this; }
+			void task_abandone() noexcept override {}
+			void task_execute() noexcept override { m_func(); }
+			bool task_cancelled() const noexcept override { return false; }
+
+		public:
+			post_task_impl(Functor func)
+				: m_func(std::move(func)) {}
+		};
+
+		/// base of tasks submitted with parent future(see submit(future, ...)).
+		/// Such task is itself a continuation of parent future: when parent becomes ready - it's placed into tasks list,
+		/// so no additional service objects are allocated.
+		class delayed_task_base : public task_base
 		{
 			friend thread_pool;
 
+		protected:
 			thread_pool * m_owner;
-			ext::intrusive_ptr<task_base> m_task;
+			// set by whoever comes first: fire or thread_pool::clear, see m_delayed description
+			std::atomic_bool m_taken = ATOMIC_VAR_INIT(false);
+
+		protected:
+			bool take() noexcept { return not m_taken.exchange(true, std::memory_order_acq_rel); }
+			/// moves task from delayed list into tasks list, called when parent future becomes ready
+			void fire() noexcept;
 
 		public:
-			void continuate(shared_state_basic * caller) noexcept override;
-			void abandone() noexcept;
+			delayed_task_base(thread_pool * owner) noexcept
+				: m_owner(owner) {}
+		};
+
+		/// implementation of delayed_task_base templated by Functor,
+		/// Functor is called with parent shared state, which is ignored - parent future is captured by Functor itself.
+		template <class Functor, class ResultType>
+		class delayed_task_impl :
+			public delayed_task_base,
+			public ext::continuation_task<Functor, ResultType>
+		{
+			typedef ext::continuation_task<Functor, ResultType> base_type;
 
 		public:
-			delayed_task_continuation(thread_pool * owner, ext::intrusive_ptr<task_base> task)
-				: m_owner(owner), m_task(std::move(task)) {}
+			void task_addref()  noexcept override { base_type::addref(); }
+			void task_release() noexcept override { base_type::release(); }
+			void task_abandone() noexcept override { base_type::release_promise(); }
+			void task_execute() noexcept override { base_type::execute(nullptr); }
+			bool task_cancelled() const noexcept override { return base_type::is_cancelled(); }
+
+			void continuate(shared_state_basic * caller) noexcept override { base_type::release_upstream(); fire(); }
+
+		public:
+			delayed_task_impl(thread_pool * owner, Functor func) noexcept
+				: delayed_task_base(owner), base_type(std::move(func)) {}
+
+		public:
+			friend inline void intrusive_ptr_add_ref(delayed_task_impl * ptr) noexcept { ptr->task_addref(); }
+			friend inline void intrusive_ptr_release(delayed_task_impl * ptr) noexcept { ptr->task_release(); }
+			friend inline void intrusive_ptr_use_count(const delayed_task_impl * ptr) noexcept {}
 		};
 		
+		/// per worker task deque, used in work_stealing mode.
+		/// Deques are hold in grow-only single linked list and are never freed until thread_pool destruction,
+		/// so they can be safely traversed by stealing workers without locking.
+		/// Each deque is owned by at most one worker, ownership is transferred under m_mutex.
+		class worker_deque : public ext::work_stealing_deque<task_base *>
+		{
+			friend thread_pool;
+
+			worker_deque * m_next = nullptr; // immutable after being published in m_deques
+			bool m_owned = false;            // guarded by thread_pool::m_mutex
+		};
+
 		/// thread worker object, also a future. When thread is finished - future becomes fulfilled
 		class worker : public ext::shared_state_unexceptional<void>
 		{
@@ -97,6 +283,25 @@ namespace ext
 			thread_pool * m_parent;
 			std::thread m_thread;
 			std::atomic_bool m_stop_request = ATOMIC_VAR_INIT(false);
+			// owned deque in work_stealing mode, otherwise nullptr
+			worker_deque * m_deque = nullptr;
+			// number of executed tasks, selects preferred lane in weighted_priority mode
+			unsigned m_dequeues = 0;
+			// position in m_workers at creation, selects cpu set from worker affinity and NUMA node
+			unsigned m_slot;
+			// numa_aware mode: index of NUMA node in m_nodes
+			unsigned m_node = 0;
+
+		#ifdef EXT_ENABLE_EXECUTOR_METRICS
+			// written only by worker thread, read by thread_pool::metrics
+			std::atomic<std::uint64_t> m_executed = ATOMIC_VAR_INIT(0);
+			std::atomic<std::uint64_t> m_steals = ATOMIC_VAR_INIT(0);
+			std::atomic<std::uint64_t> m_cancelled = ATOMIC_VAR_INIT(0);
+			std::atomic<std::uint64_t> m_idle_ns = ATOMIC_VAR_INIT(0);
+			ext::latency_histogram m_queue_latency, m_run_time;
+			// metrics are moved into thread_pool::m_retired_metrics on thread exit, guarded by m_mutex
+			bool m_metrics_retired = false;
+		#endif
 
 		private:
 			static void thread_func(ext::intrusive_ptr<worker> self);
@@ -105,7 +310,7 @@ namespace ext
 			bool stop_request() noexcept;
 
 		public:
-			worker(thread_pool * parent);
+			worker(thread_pool * parent, unsigned slot);
 		};
 
 	private:
@@ -114,36 +319,77 @@ namespace ext
 
 		typedef boost::intrusive::list<
 			task_base, item_list_option,
-			boost::intrusive::constant_time_size<false>
+			boost::intrusive::constant_time_size<true>
 		> task_list_type;
 
 		typedef boost::intrusive::list <
-			delayed_task_continuation, item_list_option,
+			delayed_task_base, item_list_option,
 			boost::intrusive::constant_time_size<false>
-		> delayed_task_continuation_list;
+		> delayed_task_list_type;
+
+	private:
+		// lockfree_queue mode: capacity of lock-free queue
+		static constexpr std::size_t lockfree_queue_capacity = 1024;
+		// lockfree_queue mode: how many times idle worker polls for tasks before going to sleep
+		static constexpr unsigned spin_count = 128;
+		// lockfree_queue mode: worker checks shared queue every n-th task, even if lock-free queue is not empty,
+		// so tasks overflowed from lock-free queue or added by delayed continuations are not starved
+		static constexpr unsigned shared_queue_check_period = 64;
 
 	private:
-		// linked list of task
+		// construction options, see options enum
+		const unsigned m_options;
+
+		// linked list of task, in work_stealing mode - shared queue for tasks submitted from non worker threads
 		task_list_type m_tasks;
+		// high and low priority lanes, normal priority tasks go to m_tasks, deques or lock-free queue
+		task_list_type m_high_tasks, m_low_tasks;
+		// sizes of m_high_tasks and m_low_tasks, changed under m_mutex,
+		// read without lock by work_stealing/lockfree_queue workers to not lock m_mutex when lanes are empty
+		std::atomic_size_t m_high_count = ATOMIC_VAR_INIT(0), m_low_count = ATOMIC_VAR_INIT(0);
+		// lockfree_queue mode: queue for submitted tasks, otherwise nullptr.
+		// If it's full - tasks go to m_tasks
+		std::unique_ptr<ext::mpmc_queue<task_base *>> m_queue;
+
+		/// numa_aware mode: shared queue of NUMA node
+		struct node_queue
+		{
+			task_list_type tasks;
+			ext::cpu_set cpus;
+		};
 
-		// delayed tasks are little tricky, for every one - we create a service continuation,
-		// which when fired, adds task to task_list.
+		// numa_aware mode: queues of every NUMA node, otherwise empty. Lists are guarded by m_mutex
+		std::vector<node_queue> m_nodes;
+		// numa_aware mode: NUMA node index by CPU number
+		std::vector<unsigned> m_cpu_nodes;
+		// cpu sets workers are pinned to: worker uses m_affinity[slot % size], guarded by m_mutex
+		std::vector<ext::cpu_set> m_affinity;
+
+		// work_stealing mode: head of grow-only list of worker deques, see worker_deque.
+		std::atomic<worker_deque *> m_deques = ATOMIC_VAR_INIT(nullptr);
+		// number of workers waiting on m_event, changed under m_mutex.
+		// Bulk submission wakes no more than that; in work_stealing mode
+		// submitting into worker deque notifies m_event only if there are sleeping workers.
+		std::atomic_uint m_sleeping = ATOMIC_VAR_INIT(0);
+
+		// delayed tasks are little tricky, every one is a continuation of it's parent future,
+		// which when fired, moves task into task_list.
 		// Those can work and fire when we are being destructed,
 		// thread_pool lifetime should not linger on delayed_task - they should become abandoned.
 		// Nevertheless we have lifetime problem.
 		//
-		// so we store those active service continuations in a list:
-		//  - When continuation is fired it checks if it's taken(future internal helper flag):
+		// so we store those active delayed tasks in a list:
+		//  - When task is fired it checks if it's taken(delayed_task_base::take):
 		//    * if yes - thread_pool is gone, nothing to do;
-		//    * if not - thread_pool is still there and we should add task to a list;
+		//    * if not - thread_pool is still there and we should move task to a list;
 		// 
-		//  - When destructing where are checking each continuation if it's taken(future internal helper flag):
-		//   * if successful - service continuation is sort of cancelled and it will not access thread_pool
-		//   * if not - continuation is firing right now somewhere in the middle,
+		//  - When destructing where are checking each task if it's taken:
+		//   * if successful - task is abandoned and it will not access thread_pool
+		//   * if not - task is firing right now somewhere in the middle,
 		//     so destructor must wait until it finishes and then complete destruction.
-		delayed_task_continuation_list m_delayed;
+		delayed_task_list_type m_delayed;
 
-		// how many delayed_continuations were not "taken/cancelled" at destruction,
+		// how many delayed tasks were not "taken/cancelled" at destruction,
 		// and how many we must wait - it's sort of a semaphore.
 		std::size_t m_delayed_count = 0;
 
@@ -154,17 +400,96 @@ namespace ext
 		std::vector<worker_ptr> m_workers;
 		std::size_t m_pending = 0;
 
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		// metrics of finished workers, guarded by m_mutex
+		worker_metrics m_retired_metrics;
+		ext::latency_histogram m_retired_queue_latency, m_retired_run_time;
+		// user task hooks, see set_task_hooks
+		std::atomic<ext::task_hooks *> m_hooks = ATOMIC_VAR_INIT(nullptr);
+	#endif
+
+		// autoscale policy, if enabled, guarded by m_mutex
+		std::optional<autoscale_options> m_autoscale;
+		// supervisor thread, running while autoscale is enabled, see supervisor_func
+		std::thread m_supervisor;
+		bool m_supervisor_stop = false;
+		std::condition_variable m_supervisor_event;
+
 		mutable std::mutex m_mutex;
 		mutable std::condition_variable m_event;
 
+		// worker of current thread, if it's a thread_pool worker thread
+		static thread_local worker * ms_current_worker;
+
 	private:
 		static bool is_finished(const worker_ptr & wptr) noexcept { return wptr->is_ready(); }
 		static bool join_worker(worker_ptr & wptr);
-		void thread_func(std::atomic_bool & stop_request);
+		void thread_func(worker & self);
+		void work_stealing_thread_func(worker & self);
+		void lockfree_thread_func(worker & self);
+		void supervisor_func();
+		/// executes and releases task taken by worker, collects metrics
+		void execute_task(worker & self, task_base * task) noexcept;
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		/// marks task enqueue time for queue latency metric
+		static void stamp_task(task_base & task) noexcept;
+		/// moves metrics of finished worker into m_retired_metrics
+		void retire_metrics(worker & w) noexcept;
+	#endif
+
+		/// creates workers up to n, joining finished stopping ones, must be called under m_mutex
+		void add_workers(std::size_t n);
+		/// returns true if there are tasks not yet taken by workers, must be called under m_mutex
+		bool has_pending_tasks() const noexcept;
+		/// waits for tasks on m_event, must be called under m_mutex.
+		/// In autoscale mode waits no longer than idle_timeout since first call(deadline is initialized on first call),
+		/// on timeout retires worker if there are more than min_workers: worker stop request is set.
+		void idle_wait(worker & self, std::unique_lock<std::mutex> & lk, std::chrono::steady_clock::time_point & deadline);
+
+		/// places task into a queue of given lane and wakes worker, takes ownership of task
+		void push_task(task_base * task, priority prio = priority::normal) noexcept;
+		/// places all tasks into a queue of given lane under single lock and wakes min(count, sleeping) workers, takes ownership of tasks
+		void push_tasks(task_list_type & tasks, std::size_t count, priority prio = priority::normal) noexcept;
+		/// lane which worker tries first: high in strict mode, by lane_weights in weighted_priority mode
+		priority preferred_lane(const worker & self) const noexcept;
+		/// takes front task from high/low lane list or normal lane shared queues, must be called under m_mutex
+		bool pop_lane_task(const worker & self, priority lane, task_base * & task) noexcept;
+		/// takes task from shared queues: numa_aware mode - own node queue, m_tasks, other nodes queues; otherwise m_tasks.
+		/// Must be called under m_mutex
+		bool pop_shared_task(const worker & self, task_base * & task) noexcept;
+		/// shared queue for task submitted from current thread: node queue in numa_aware mode, otherwise m_tasks
+		task_list_type & submit_queue() noexcept;
+		/// pins worker thread to cpu set according to m_affinity or NUMA node, must be called under m_mutex
+		void pin_worker(worker & w) noexcept;
+		/// takes task from m_tasks and lane lists, preferred lane first, than in strict order, must be called under m_mutex
+		bool take_task_locked(const worker & self, task_base * & task) noexcept;
+		/// takes task from high or low lane, returns false if it's empty, locks m_mutex only if lane is not empty
+		bool take_lane_task(const worker & self, priority lane, task_base * & task) noexcept;
+		/// all lanes lists, m_tasks and node queues are empty, must be called under m_mutex
+		bool lanes_empty() const noexcept;
+		/// wakes min(count, sleeping) workers, must be called under m_mutex
+		void notify_workers(std::size_t count) noexcept;
+		/// wakes sleeping workers after tasks were pushed into lock-free deque/queue
+		void notify_sleeping(std::size_t count) noexcept;
+		/// takes task from shared queues, see pop_shared_task, returns false if they are empty
+		bool take_shared_task(const worker & self, task_base * & task) noexcept;
+		/// lockfree_queue mode: polls lock-free queue and deques of other workers spin_count times, returns false if nothing found
+		bool spin_for_task(const worker_deque * self, task_base * & task) noexcept;
+		/// abandons and releases all tasks in list
+		static void abandon_tasks(task_list_type & tasks) noexcept;
+		/// work_stealing mode: deque management
+		worker_deque * acquire_deque();
+		void release_deque(worker_deque * deque) noexcept;
+		bool steal_task(const worker_deque * self, task_base * & task) noexcept;
+		bool has_stealable_tasks() const noexcept;
+		/// steals and abandons all tasks from all deques
+		void clear_deques() noexcept;
 
 	public: // execution control
 		/// returns current number of workers
 		unsigned get_nworkers() const;
+		/// returns number of pending tasks in given lane, for normal lane - approximate, if there are concurrent operations
+		std::size_t queue_depth(priority prio) const;
 		/// sets number of workers:
 		/// if n == $current - does nothing and returns ready future
 		/// if n >  $current - creates more workers and returns ready future
@@ -175,25 +500,86 @@ namespace ext
 		/// stops all workers, returns future which become ready when all workers,
 		/// that were created in these thread pool at any time,
 		/// are completely stopped.
+		/// If autoscale is enabled supervisor can create workers again for pending tasks, call disable_autoscale first.
 		ext::future<void> stop() { return set_nworkers(0); }
 
+		/// enables auto scaling of workers with given policy, see class description.
+		/// Current number of workers is brought into [min_workers, max_workers].
+		/// set_nworkers still can be used, supervisor and idle workers will correct number of workers later.
+		void set_autoscale(const autoscale_options & opts);
+		/// disables auto scaling, current workers are kept
+		void disable_autoscale();
+
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		/// returns snapshot of metrics, does not block workers
+		metrics_type metrics() const;
+		/// installs hooks called by workers around every task, nullptr - removes hooks.
+		/// hooks object must live until it's replaced and all tasks started before that are finished
+		void set_task_hooks(ext::task_hooks * hooks) noexcept { m_hooks.store(hooks, std::memory_order_release); }
+	#endif
+
+		/// pins workers to CPUs: worker is pinned to sets[n % sets.size()], where n is position of worker at creation.
+		/// One set per worker pins every worker individually, single set - pins all workers to it,
+		/// ext::round_robin_affinity(mask) - pins workers round-robin over CPUs of mask.
+		/// Applied to running and future workers, empty sets - new workers are not pinned(or pinned to NUMA node in numa_aware mode).
+		/// Pinning failures are ignored.
+		void set_worker_affinity(std::vector<ext::cpu_set> sets);
+
 	public: // job control
 		/// submits task for execution, returns future representing result of execution.
 		template <class Functor, class ... Args>
 		auto submit(Functor && func, Args && ... args) ->
 		    ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>;
+
+		/// submits task with given priority, see class description
+		template <class Functor, class ... Args>
+		auto submit(priority prio, Functor && func, Args && ... args) ->
+		    ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>;
 		
 		template <class Future, class Functor, class ... Args>
 		auto submit(Future future, Functor && func, Args && ... args) ->
 			ext::future<std::invoke_result_t<std::decay_t<Functor>, std::enable_if_t<is_future_type_v<Future>, Future>, std::decay_t<Args>...>>;
 
+		/// submits task tied to cancellation token, see ext::with_cancellation:
+		/// when cancellation is requested returned future is cancelled,
+		/// if task is not yet started - it's dropped from queue without execution.
+		/// Functor can also check token itself to stop already running work.
+		template <class Functor, class ... Args>
+		auto submit(ext::cancellation_token token, Functor && func, Args && ... args) ->
+		    ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>;
+
+		template <class Functor, class ... Args>
+		auto submit(ext::cancellation_token token, priority prio, Functor && func, Args && ... args) ->
+		    ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>;
+
+		/// submits task for execution, without any result: no future and shared state are created,
+		/// which makes it noticeably cheaper than submit for pure side-effect work.
+		/// If task throws - std::terminate is called, same as for std::thread.
+		/// Clearing thread_pool just destroys not yet executed posted tasks.
+		template <class Functor, class ... Args>
+		void post(Functor && func, Args && ... args);
+
+		template <class Functor, class ... Args>
+		void post(priority prio, Functor && func, Args && ... args);
+
+		/// submits task func(*it) for every element of range [first, last), returns futures in same order.
+		/// Elements are copied into tasks, func is copied into every task.
+		/// All tasks are placed into queue under single lock acquisition, and only min(n, sleeping) workers are woken.
+		template <class InputIterator, class Functor>
+		auto submit_bulk(InputIterator first, InputIterator last, Functor func) ->
+			std::vector<ext::future<std::invoke_result_t<Functor, typename std::iterator_traits<InputIterator>::value_type>>>;
+
+		template <class InputIterator, class Functor>
+		auto submit_bulk(priority prio, InputIterator first, InputIterator last, Functor func) ->
+			std::vector<ext::future<std::invoke_result_t<Functor, typename std::iterator_traits<InputIterator>::value_type>>>;
+
 		/// clears all not already executed tasks.
 		/// Associated futures status become abandoned
 		void clear() noexcept;
 
 	public:
 		// 0 means 0, no workers at all, you must explicitly set number you want
-		thread_pool(unsigned nworkers = 0);
+		thread_pool(unsigned nworkers = 0, unsigned opts = fifo);
 		~thread_pool() noexcept;
 
 		thread_pool(thread_pool &&) = delete;
@@ -204,7 +590,14 @@ namespace ext
 	};
 
 	template <class Functor, class ... Args>
-	auto thread_pool::submit(Functor && func, Args && ... args) ->
+	inline auto thread_pool::submit(Functor && func, Args && ... args) ->
+		ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>
+	{
+		return submit(priority::normal, std::forward<Functor>(func), std::forward<Args>(args)...);
+	}
+
+	template <class Functor, class ... Args>
+	auto thread_pool::submit(priority prio, Functor && func, Args && ... args) ->
 		ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>
 	{
 		using result_type = std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>;
@@ -222,13 +615,44 @@ namespace ext
 		auto task = ext::make_intrusive<task_type>(std::move(closure));
 		future_type fut {task};
 
+		push_task(task.release(), prio);
+		return fut;
+	}
+
+	template <class Functor, class ... Args>
+	inline auto thread_pool::submit(ext::cancellation_token token, Functor && func, Args && ... args) ->
+		ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>
+	{
+		return submit(std::move(token), priority::normal, std::forward<Functor>(func), std::forward<Args>(args)...);
+	}
+
+	template <class Functor, class ... Args>
+	inline auto thread_pool::submit(ext::cancellation_token token, priority prio, Functor && func, Args && ... args) ->
+		ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>
+	{
+		// if cancellation is already requested - task is cancelled immediately and dropped by worker
+		return ext::with_cancellation(submit(prio, std::forward<Functor>(func), std::forward<Args>(args)...), token);
+	}
+
+	template <class Functor, class ... Args>
+	inline void thread_pool::post(Functor && func, Args && ... args)
+	{
+		post(priority::normal, std::forward<Functor>(func), std::forward<Args>(args)...);
+	}
+
+	template <class Functor, class ... Args>
+	void thread_pool::post(priority prio, Functor && func, Args && ... args)
+	{
+		auto closure = [func = std::forward<Functor>(func),
+		                args_tuple = std::make_tuple(std::forward<Args>(args)...)]() mutable
 		{
-			std::lock_guard lk(m_mutex);
-			m_tasks.push_back(*task.release());
-		}
+			ext::apply(std::move(func), std::move(args_tuple));
+		};
 
-		m_event.notify_one();
-		return fut;
+		using functor_type = decltype(closure);
+		using task_type = post_task_impl<functor_type>;
+
+		push_task(new task_type(std::move(closure)), prio);
 	}
 
 	template <class Future, class Functor, class ... Args>
@@ -239,42 +663,90 @@ namespace ext
 
 		auto handle = future.handle();
 		auto closure = [func = std::forward<Functor>(func),
-		                args_tuple = std::make_tuple(std::move(future), std::forward<Args>(args)...)]() mutable
+		                args_tuple = std::make_tuple(std::move(future), std::forward<Args>(args)...)](shared_state_basic *) mutable
 		{
 			return ext::apply(std::move(func), std::move(args_tuple));
 		};
 
 		using functor_type = decltype(closure);
-		using result_type = std::invoke_result_t<functor_type>;
-		using task_type = task_impl<functor_type, result_type>;
+		using result_type = std::invoke_result_t<functor_type, shared_state_basic *>;
+		using task_type = delayed_task_impl<functor_type, result_type>;
 		using future_type = ext::future<result_type>;
 
-		auto task = ext::make_intrusive<task_type>(std::move(closure));
+		auto task = ext::make_intrusive<task_type>(this, std::move(closure));
 		future_type fut {task};
+		ext::inherit_cancellation(*handle, *task);
 
 		if (handle->is_deferred())
 		{	// make it ready
 			handle->wait();
-
-			{
-				std::lock_guard lk(m_mutex);
-				m_tasks.push_back(*task.release());
-			}
-
-			m_event.notify_one();
+			push_task(task.release());
 		}
 		else
 		{
-			auto cont = ext::make_intrusive<delayed_task_continuation>(this, std::move(task));
-
-			{
+			{	// reference is transferred to m_delayed, and then to m_tasks
 				std::lock_guard lk(m_mutex);
-				m_delayed.push_back((cont.addref(), *cont.get()));
+				m_delayed.push_back((task.addref(), *task.get()));
 			}
 
-			handle->add_continuation(cont.get());
+			// unique parent future is consumed by task, so it's cancelled together with task
+			if constexpr (std::is_same_v<Future, ext::future<typename Future::value_type>>)
+				task->set_upstream(handle.get());
+
+			handle->add_continuation(task.get());
 		}
 		
 		return fut;
 	}
+
+	template <class InputIterator, class Functor>
+	inline auto thread_pool::submit_bulk(InputIterator first, InputIterator last, Functor func) ->
+		std::vector<ext::future<std::invoke_result_t<Functor, typename std::iterator_traits<InputIterator>::value_type>>>
+	{
+		return submit_bulk(priority::normal, std::move(first), std::move(last), std::move(func));
+	}
+
+	template <class InputIterator, class Functor>
+	auto thread_pool::submit_bulk(priority prio, InputIterator first, InputIterator last, Functor func) ->
+		std::vector<ext::future<std::invoke_result_t<Functor, typename std::iterator_traits<InputIterator>::value_type>>>
+	{
+		using value_type = typename std::iterator_traits<InputIterator>::value_type;
+		using result_type = std::invoke_result_t<Functor, value_type>;
+
+		auto make_closure = [&func](value_type arg)
+		{
+			return [func, arg = std::move(arg)]() mutable -> result_type
+			{
+				return ext::invoke(std::move(func), std::move(arg));
+			};
+		};
+
+		using functor_type = decltype(make_closure(std::declval<value_type>()));
+		using task_type = task_impl<functor_type, result_type>;
+		using future_type = ext::future<result_type>;
+
+		std::vector<future_type> futures;
+		ext::try_reserve(futures, first, last);
+
+		task_list_type tasks;
+		std::size_t count = 0;
+
+		try
+		{
+			for (; first != last; ++first, ++count)
+			{
+				auto task = ext::make_intrusive<task_type>(make_closure(*first));
+				futures.emplace_back(task);
+				tasks.push_back(*task.release());
+			}
+		}
+		catch (...)
+		{
+			abandon_tasks(tasks);
+			throw;
+		}
+
+		push_tasks(tasks, count, prio);
+		return futures;
+	}
 }
@@ -1,11 +1,16 @@
 ﻿#pragma once
-#include <queue>
+#include <vector>
+#include <memory>
+#include <cstdint>
 #include <atomic>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
+
+#include <boost/intrusive/list.hpp>
 #include <ext/intrusive_ptr.hpp>
 #include <ext/future.hpp>
+#include <ext/executor_metrics.hpp>
 
 namespace ext
 {
@@ -13,6 +18,16 @@ namespace ext
 	/// Task can be submitted via submit method.
 	/// For every task result of execution can be retrieved via associated future.
 	/// 
+	/// With timing_wheel option tasks are hold in hierarchical hashed timing wheel instead of priority_queue:
+	/// insertion is O(1) and all tasks expired on a tick are taken at once,
+	/// at cost of resolution - task is executed not earlier than it's time point, but can be up to one tick later.
+	/// 
+	/// Cancelling returned future removes task from scheduler immediately:
+	/// O(1) in timing_wheel mode, O(log n) in binary_heap mode.
+	/// 
+	/// If EXT_ENABLE_EXECUTOR_METRICS is defined, scheduler collects metrics, see metrics method,
+	/// and hooks can be installed, called around every task, see set_task_hooks.
+	/// 
 	/// All methods are thread-safe
 	class threaded_scheduler
 	{
@@ -20,11 +35,43 @@ namespace ext
 		typedef std::chrono::steady_clock::time_point time_point;
 		typedef std::chrono::steady_clock::duration   duration;
 
+		/// construction options
+		enum options : unsigned
+		{
+			/// tasks are hold in binary heap(std::priority_queue), O(log n) insertion, default
+			binary_heap  = 0,
+			/// tasks are hold in hierarchical timing wheel, see class description
+			timing_wheel = 1u << 0,
+		};
+
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		/// snapshot of scheduler metrics, see metrics method
+		struct metrics_type
+		{
+			std::uint64_t executed = 0;
+			/// delay of execution start after task time point
+			ext::latency_histogram lateness;
+			/// task execution time
+			ext::latency_histogram run_time;
+		};
+	#endif
+
 	private:
-		class task_base
+		// auto_unlink - cancelled task unlinks itself from wheel slot list, whichever it is
+		typedef boost::intrusive::list_base_hook<
+			boost::intrusive::link_mode<boost::intrusive::link_mode_type::auto_unlink>
+		> hook_type;
+
+		/// base interface for submitted tasks, in timing_wheel mode tasks are hold in intrusive linked lists
+		class task_base : public hook_type
 		{
 		public:
 			time_point point;
+			// binary_heap mode: index of task in m_heap
+			std::size_t heap_index;
+			// scheduler holding this task, 0 if task is not hold by scheduler(not yet placed, executed, cancelled, ...).
+			// Lowest bit is a spin lock, see threaded_scheduler::remove_task
+			std::atomic_uintptr_t owner = ATOMIC_VAR_INIT(0);
 
 		public:
 			virtual ~task_base() = default;
@@ -36,6 +83,7 @@ namespace ext
 			virtual void task_release()  noexcept = 0;
 			virtual void task_abandone() noexcept = 0;
 			virtual void task_execute()  noexcept = 0;
+			virtual bool task_cancelled() const noexcept = 0;
 
 		public:
 			friend inline void intrusive_ptr_add_ref(task_base * ptr) noexcept { ptr->task_addref(); }
@@ -55,6 +103,17 @@ namespace ext
 			void task_release()  noexcept override { base_type::release(); }
 			void task_abandone() noexcept override { base_type::release_promise(); }
 			void task_execute()  noexcept override { base_type::execute(); }
+			bool task_cancelled() const noexcept override { return base_type::is_cancelled(); }
+
+		public:
+			// cancelled task is removed from scheduler right away
+			bool cancel() noexcept override
+			{
+				if (not base_type::cancel()) return false;
+
+				remove_task(this);
+				return true;
+			}
 
 		public:
 			task_impl(time_point tp, Functor func)
@@ -66,33 +125,130 @@ namespace ext
 			friend inline void intrusive_ptr_use_count(const task_impl * ptr) noexcept {}
 		};
 		
+		/// implementation of task_base for post_at/post_after: no shared state and promise, just a functor.
+		/// Posted task can't be cancelled and is owned only by scheduler, so reference counter is not atomic.
+		template <class Functor>
+		class post_task_impl : public task_base
+		{
+			unsigned m_refs = 1;
+			Functor m_func;
+
+		public:
+			void task_addref()   noexcept override { ++m_refs; }
+			void task_release()  noexcept override { if (--m_refs == 0) delete this; }
+			void task_abandone() noexcept override {}
+			void task_execute()  noexcept override { m_func(); }
+			bool task_cancelled() const noexcept override { return false; }
+
+		public:
+			post_task_impl(time_point tp, Functor func)
+				: m_func(std::move(func)) { task_base::point = tp; }
+		};
+
 		typedef ext::intrusive_ptr<task_base> task_ptr;
 
-		class entry_comparer
+		typedef boost::intrusive::list<
+			task_base, boost::intrusive::base_hook<hook_type>,
+			boost::intrusive::constant_time_size<false>
+		> task_list_type;
+
+		/// binary min-heap of tasks by time point, every task knows it's index - so it can be removed from the middle
+		typedef std::vector<task_base *> heap_type;
+
+		/// Hierarchical hashed timing wheel, see:
+		///   "Hashed and Hierarchical Timing Wheels", G. Varghese, T. Lauck
+		///
+		/// Time is measured in ticks of resolution duration since construction.
+		/// There are levels of slots, slot on level l covers 256^l ticks, level 0 slot - single tick.
+		/// Task is placed on lowest level, where it's tick differs from current only in bits of that level;
+		/// when current tick crosses boundary of upper level slot - tasks from that slot are redistributed to lower levels.
+		/// Tasks too far in future for all levels are hold in overflow list, redistributed when top level wraps.
+		///
+		/// Slot lists own their tasks(hold a reference). Not thread safe, guarded by threaded_scheduler::m_mutex.
+		class wheel_type
 		{
+			typedef std::uint64_t tick_type;
+
+			static constexpr unsigned level_bits = 8;
+			static constexpr unsigned levels = 4;
+			static constexpr tick_type slot_count = 1u << level_bits;
+			static constexpr tick_type slot_mask = slot_count - 1;
+			static constexpr tick_type no_tick = static_cast<tick_type>(-1);
+
+		private:
+			time_point m_origin;
+			duration m_resolution;
+			// all ticks before current are processed
+			tick_type m_current = 0;
+
+			task_list_type m_slots[levels][slot_count];
+			task_list_type m_overflow;
+
+		private:
+			tick_type due_tick(time_point tp) const noexcept;
+			tick_type next_tick() const noexcept;
+			void place(task_base & task) noexcept;
+			void cascade() noexcept;
+
 		public:
-			typedef bool result_type;
-			bool operator()(const task_ptr & t1, const task_ptr & t2) const noexcept;
-		};
+			/// places task into wheel, takes ownership
+			void insert(task_base * task) noexcept;
+			/// advances wheel up to now, moves expired tasks into expired list
+			void advance(time_point now, task_list_type & expired) noexcept;
+			/// time point of next expiration or redistribution, time_point::max() if wheel is empty
+			time_point next_expiry() const noexcept;
+			/// moves all tasks into list
+			void take_all(task_list_type & tasks) noexcept;
 
-	private:
-		typedef std::priority_queue<
-			task_ptr,
-			std::deque<task_ptr>,
-			entry_comparer
-		> queue_type;
+		public:
+			wheel_type(duration resolution);
+		};
 
 	private:
-		queue_type m_queue;
+		// binary_heap mode: tasks, heap holds a reference to every task
+		heap_type m_heap;
+		// timing_wheel mode: wheel holding tasks, m_heap is unused
+		std::unique_ptr<wheel_type> m_wheel;
 		std::thread m_thread;
 		bool m_stopped = false;
 
 		mutable std::mutex m_mutex;
 		mutable std::condition_variable m_newdata;
 
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		// written only by scheduler thread, read by metrics
+		std::atomic<std::uint64_t> m_executed = ATOMIC_VAR_INIT(0);
+		ext::latency_histogram m_lateness, m_run_time;
+		std::atomic<ext::task_hooks *> m_hooks = ATOMIC_VAR_INIT(nullptr);
+	#endif
+
 	private:
 		void thread_func();
 		void run_passed_events();
+		/// places task into heap or wheel and wakes scheduler thread
+		void push_task(task_ptr task);
+		/// takes all tasks out of heap and wheel into list, must be called under m_mutex
+		void take_all(task_list_type & tasks) noexcept;
+
+		/// binary_heap mode: heap operations, must be called under m_mutex
+		void heap_push(task_base * task);
+		void heap_erase(std::size_t index) noexcept;
+		void heap_sift_up(std::size_t index) noexcept;
+		void heap_sift_down(std::size_t index) noexcept;
+		void heap_set(std::size_t index, task_base * task) noexcept { m_heap[index] = task, task->heap_index = index; }
+
+		/// task ownership protocol: task->owner points to scheduler, while task is hold by it.
+		/// attach_task - sets owner, returns false if task is already cancelled, must be called under m_mutex.
+		/// detach_task - resets owner, after that task can't be removed by cancellation, must be called under m_mutex.
+		/// remove_task - called by cancelled task, removes it from owner scheduler(if any) and releases it.
+		bool attach_task(task_base * task) noexcept;
+		static void detach_task(task_base * task) noexcept;
+		static void remove_task(task_base * task) noexcept;
+		static std::uintptr_t lock_owner(task_base * task) noexcept;
+		/// executes and releases tasks in list
+		void execute_tasks(task_list_type & tasks) noexcept;
+		/// abandons and releases tasks in list
+		static void abandon_tasks(task_list_type & tasks) noexcept;
 
 		template <class Lock>
 		time_point next_in(Lock & lk) const noexcept;
@@ -105,11 +261,29 @@ namespace ext
 		template <class Functor, class ... Args>
 		auto submit(duration  rel, Functor && func, Args && ... args) ->
 			ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>;
+
+		/// schedules task without any result: no future and shared state are created.
+		/// If task throws - std::terminate is called, same as for std::thread.
+		/// Clearing scheduler just destroys not yet executed posted tasks.
+		template <class Functor, class ... Args>
+		void post_at(time_point tp, Functor && func, Args && ... args);
+
+		template <class Functor, class ... Args>
+		void post_after(duration rel, Functor && func, Args && ... args);
 		
 		void clear() noexcept;
 
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		/// returns snapshot of metrics, does not block scheduler thread
+		metrics_type metrics() const;
+		/// installs hooks called by scheduler thread around every task, nullptr - removes hooks.
+		/// hooks object must live until it's replaced and all tasks started before that are finished
+		void set_task_hooks(ext::task_hooks * hooks) noexcept { m_hooks.store(hooks, std::memory_order_release); }
+	#endif
+
 	public:
-		threaded_scheduler();
+		/// resolution is used only in timing_wheel mode: duration of one wheel tick
+		threaded_scheduler(unsigned opts = binary_heap, duration resolution = std::chrono::milliseconds(1));
 		~threaded_scheduler() noexcept;
 
 		threaded_scheduler(threaded_scheduler &&) = delete;
@@ -119,6 +293,14 @@ namespace ext
 		threaded_scheduler & operator =(const threaded_scheduler &) = delete;
 	};
 
+	/// returns future, which becomes ready with result of f, or with future_error(future_errc::timeout),
+	/// if f does not become ready within timeout. No thread is blocked waiting:
+	/// timer task is scheduled in scheduler and cancelled, when f becomes ready.
+	/// On timeout f is not cancelled, it's result is discarded when it's ready.
+	template <class Future>
+	auto with_timeout(Future f, threaded_scheduler::duration timeout, threaded_scheduler & scheduler) ->
+		std::enable_if_t<is_future_type<Future>::value, ext::future<typename Future::value_type>>;
+
 	template <class Functor, class ... Args>
 	auto threaded_scheduler::submit(time_point tp, Functor && func, Args && ... args) ->
 		ext::future<std::invoke_result_t<std::decay_t<Functor>, std::decay_t<Args>...>>
@@ -137,12 +319,7 @@ namespace ext
 		auto task = ext::make_intrusive<task_type>(tp, std::move(closure));
 		future_type fut {task};
 
-		{
-			std::lock_guard lk(m_mutex);
-			m_queue.push(std::move(task));
-		}
-		
-		m_newdata.notify_one();
+		push_task(std::move(task));
 		return fut;
 	}
 
@@ -152,4 +329,72 @@ namespace ext
 	{
 		return submit(rel + time_point::clock::now(), std::forward<Functor>(func), std::forward<Args>(args)...);
 	}
+
+	template <class Functor, class ... Args>
+	void threaded_scheduler::post_at(time_point tp, Functor && func, Args && ... args)
+	{
+		auto closure = [func = std::forward<Functor>(func),
+		                args_tuple = std::make_tuple(std::forward<Args>(args)...)]() mutable
+		{
+			ext::apply(std::move(func), std::move(args_tuple));
+		};
+
+		using functor_type = decltype(closure);
+		using task_type = post_task_impl<functor_type>;
+
+		push_task(task_ptr(new task_type(tp, std::move(closure)), ext::noaddref));
+	}
+
+	template <class Functor, class ... Args>
+	inline void threaded_scheduler::post_after(duration rel, Functor && func, Args && ... args)
+	{
+		post_at(rel + time_point::clock::now(), std::forward<Functor>(func), std::forward<Args>(args)...);
+	}
+
+	template <class Future>
+	auto with_timeout(Future f, threaded_scheduler::duration timeout, threaded_scheduler & scheduler) ->
+		std::enable_if_t<is_future_type<Future>::value, ext::future<typename Future::value_type>>
+	{
+		using value_type = typename Future::value_type;
+
+		if constexpr (std::is_same_v<Future, ext::future<value_type>>)
+			if (f.is_ready()) return f;
+
+		// shared by timer and continuation, whichever comes first - satisfies promise
+		struct timeout_state
+		{
+			ext::promise<value_type> promise;
+			std::atomic_bool done = ATOMIC_VAR_INIT(false);
+		};
+
+		auto state = std::make_shared<timeout_state>();
+		auto result = state->promise.get_future();
+
+		auto timer = scheduler.submit(timeout, [state]
+		{
+			if (not state->done.exchange(true, std::memory_order_relaxed))
+				state->promise.set_exception(std::make_exception_ptr(ext::future_error(ext::make_error_code(ext::future_errc::timeout))));
+		});
+
+		f.then([state, timer = std::move(timer)](Future f) mutable
+		{
+			if (state->done.exchange(true, std::memory_order_relaxed))
+				return;
+
+			timer.cancel();
+			try
+			{
+				if constexpr (std::is_void_v<value_type>)
+					f.get(), state->promise.set_value();
+				else
+					state->promise.set_value(f.get());
+			}
+			catch (...)
+			{
+				state->promise.set_exception(std::current_exception());
+			}
+		});
+
+		return result;
+	}
 }
@@ -0,0 +1,172 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+namespace ext
+{
+	/// Chase-Lev work stealing deque, see:
+	///   "Dynamic Circular Work-Stealing Deque", D. Chase, Y. Lev
+	///   "Correct and Efficient Work-Stealing for Weak Memory Models", N. M. Le, A. Pop, A. Cohen, F. Zappa Nardelli
+	///
+	/// Owner thread pushes and pops items at bottom end(LIFO order), other threads steal items from top end(FIFO order).
+	/// push/pop must be called only by owner thread, steal can be called by any thread concurrently.
+	/// Ownership can be transferred to another thread, if transfer is properly synchronized(for example with a mutex).
+	///
+	/// Type must be trivially copyable, typically it is a pointer.
+	/// Buffer grows when it's full, old buffers are kept until destruction, because concurrent stealers can still read from them.
+	/// Items left in deque on destruction are just forgotten, it's up to user to dispose them.
+	template <class Type>
+	class work_stealing_deque
+	{
+		static_assert(std::is_trivially_copyable_v<Type>, "work_stealing_deque: Type must be trivially copyable");
+
+	public:
+		using value_type = Type;
+		using index_type = std::int64_t;
+
+	private:
+		// avoid false sharing between m_top and m_bottom
+		static constexpr std::size_t cache_line_size = 64;
+		static constexpr index_type default_capacity = 64;
+
+		struct buffer
+		{
+			index_type capacity;
+			std::unique_ptr<std::atomic<value_type>[]> items;
+			// previous(smaller) buffer, kept alive for concurrent stealers
+			std::unique_ptr<buffer> prev;
+
+			value_type get(index_type idx) const noexcept       { return items[idx & (capacity - 1)].load(std::memory_order_relaxed); }
+			void put(index_type idx, value_type val) noexcept   { items[idx & (capacity - 1)].store(val, std::memory_order_relaxed); }
+
+			buffer(index_type capacity)
+				: capacity(capacity), items(std::make_unique<std::atomic<value_type>[]>(capacity)) {}
+		};
+
+	private:
+		alignas(cache_line_size) std::atomic<index_type> m_top    = ATOMIC_VAR_INIT(0);
+		alignas(cache_line_size) std::atomic<index_type> m_bottom = ATOMIC_VAR_INIT(0);
+		alignas(cache_line_size) std::atomic<buffer *>   m_buffer = ATOMIC_VAR_INIT(nullptr);
+
+	private:
+		buffer * grow(buffer * buf, index_type bottom, index_type top);
+
+	public:
+		/// pushes item at bottom end, owner only.
+		/// Can throw std::bad_alloc if buffer must grow, in that case deque is unchanged
+		void push(value_type val);
+		/// pops item from bottom end, owner only. Returns false if deque is empty
+		bool pop(value_type & val) noexcept;
+		/// steals item from top end, can be called from any thread.
+		/// Returns false if deque is empty or stealing lost race with other thief or owner
+		bool steal(value_type & val) noexcept;
+
+		/// approximate number of items, exact only if there are no concurrent operations
+		std::size_t size() const noexcept;
+		bool empty() const noexcept { return size() == 0; }
+
+	public:
+		work_stealing_deque(std::size_t capacity = default_capacity);
+		~work_stealing_deque() noexcept;
+
+		work_stealing_deque(work_stealing_deque &&) = delete;
+		work_stealing_deque & operator =(work_stealing_deque &&) = delete;
+	};
+
+	template <class Type>
+	auto work_stealing_deque<Type>::grow(buffer * buf, index_type bottom, index_type top) -> buffer *
+	{
+		auto newbuf = std::make_unique<buffer>(buf->capacity * 2);
+		for (index_type idx = top; idx != bottom; ++idx)
+			newbuf->put(idx, buf->get(idx));
+
+		newbuf->prev.reset(buf);
+		buf = newbuf.release();
+		m_buffer.store(buf, std::memory_order_release);
+		return buf;
+	}
+
+	template <class Type>
+	void work_stealing_deque<Type>::push(value_type val)
+	{
+		auto bottom = m_bottom.load(std::memory_order_relaxed);
+		auto top = m_top.load(std::memory_order_acquire);
+		auto * buf = m_buffer.load(std::memory_order_relaxed);
+
+		if (bottom - top > buf->capacity - 1)
+			buf = grow(buf, bottom, top);
+
+		buf->put(bottom, val);
+		// release store instead of release fence + relaxed store from paper, same guarantees
+		m_bottom.store(bottom + 1, std::memory_order_release);
+	}
+
+	template <class Type>
+	bool work_stealing_deque<Type>::pop(value_type & val) noexcept
+	{
+		auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		auto * buf = m_buffer.load(std::memory_order_relaxed);
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{	// deque is empty
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		val = buf->get(bottom);
+		if (top != bottom) return true;
+
+		// last item, race with thieves
+		bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return won;
+	}
+
+	template <class Type>
+	bool work_stealing_deque<Type>::steal(value_type & val) noexcept
+	{
+		auto top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto bottom = m_bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom) return false;
+
+		auto * buf = m_buffer.load(std::memory_order_acquire);
+		auto item = buf->get(top);
+		if (not m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return false;
+
+		val = item;
+		return true;
+	}
+
+	template <class Type>
+	std::size_t work_stealing_deque<Type>::size() const noexcept
+	{
+		auto bottom = m_bottom.load(std::memory_order_relaxed);
+		auto top = m_top.load(std::memory_order_relaxed);
+		return bottom > top ? static_cast<std::size_t>(bottom - top) : 0;
+	}
+
+	template <class Type>
+	work_stealing_deque<Type>::work_stealing_deque(std::size_t capacity)
+	{
+		// capacity must be power of 2
+		index_type cap = 1;
+		while (cap < static_cast<index_type>(capacity)) cap *= 2;
+
+		m_buffer.store(new buffer(cap), std::memory_order_relaxed);
+	}
+
+	template <class Type>
+	work_stealing_deque<Type>::~work_stealing_deque() noexcept
+	{
+		delete m_buffer.load(std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,123 @@
+#include <cmath>
+#include <ext/executor_metrics.hpp>
+
+#if EXT_METRICS_CLOCK_TSC and BOOST_COMP_MSVC
+#include <intrin.h>
+#elif EXT_METRICS_CLOCK_TSC
+#include <cpuid.h>
+#endif
+
+#if EXT_METRICS_CLOCK_TSC and BOOST_OS_LINUX
+#include <fstream>
+#include <string>
+#endif
+
+namespace ext
+{
+	bool metrics_clock::detect_tsc() noexcept
+	{
+	#ifdef EXT_METRICS_CLOCK_TSC
+		// invariant TSC: CPUID.80000007H:EDX[8], ticks with constant rate regardless of frequency scaling and sleep states
+		unsigned regs[4] = {};
+	#if BOOST_COMP_MSVC
+		__cpuid(reinterpret_cast<int *>(regs), 0x80000000);
+		if (regs[0] < 0x80000007) return false;
+		__cpuid(reinterpret_cast<int *>(regs), 0x80000007);
+	#else
+		if (not __get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3])) return false;
+	#endif
+		if (not (regs[3] & (1u << 8))) return false;
+
+	#if BOOST_OS_LINUX
+		// kernel checks TSC synchronization between CPUs and switches clocksource if it's unreliable
+		std::ifstream file("/sys/devices/system/clocksource/clocksource0/current_clocksource");
+		std::string source;
+		if (not (file >> source) or source != "tsc") return false;
+	#endif
+
+		return true;
+	#else
+		return false;
+	#endif
+	}
+
+	double metrics_clock::calibrate() noexcept
+	{
+		if (not uses_tsc()) return 1.0;
+
+		using std::chrono::steady_clock;
+		auto steady_start = steady_clock::now();
+		auto tsc_start = now();
+
+		while (steady_clock::now() - steady_start < std::chrono::milliseconds(2))
+			continue;
+
+		auto tsc_end = now();
+		auto steady_end = steady_clock::now();
+
+		auto ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(steady_end - steady_start).count();
+		return tsc_end > tsc_start ? ns / static_cast<double>(tsc_end - tsc_start) : 1.0;
+	}
+
+	std::uint64_t latency_histogram::bucket_value(unsigned idx) noexcept
+	{
+		if (idx < sub_bucket_count) return idx;
+
+		unsigned magnitude = idx / sub_bucket_count;
+		std::uint64_t sub = idx % sub_bucket_count + sub_bucket_count;
+		std::uint64_t width = std::uint64_t(1) << (magnitude - 1);
+		return sub * width + (width - 1);
+	}
+
+	void latency_histogram::merge(const latency_histogram & other) noexcept
+	{
+		for (unsigned idx = 0; idx < bucket_count; ++idx)
+		{
+			auto val = other.m_counts[idx].load(std::memory_order_relaxed);
+			if (val) metric_add(m_counts[idx], val);
+		}
+	}
+
+	void latency_histogram::clear() noexcept
+	{
+		for (auto & counter : m_counts)
+			counter.store(0, std::memory_order_relaxed);
+	}
+
+	std::uint64_t latency_histogram::count() const noexcept
+	{
+		std::uint64_t total = 0;
+		for (auto & counter : m_counts)
+			total += counter.load(std::memory_order_relaxed);
+
+		return total;
+	}
+
+	std::chrono::nanoseconds latency_histogram::percentile(double pct) const noexcept
+	{
+		// take snapshot, so total and walk are consistent
+		std::uint64_t counts[bucket_count];
+		std::uint64_t total = 0;
+
+		for (unsigned idx = 0; idx < bucket_count; ++idx)
+			total += counts[idx] = m_counts[idx].load(std::memory_order_relaxed);
+
+		if (not total) return std::chrono::nanoseconds::zero();
+
+		pct = std::min(100.0, std::max(0.0, pct));
+		auto rank = static_cast<std::uint64_t>(std::ceil(pct / 100.0 * static_cast<double>(total)));
+		rank = std::max<std::uint64_t>(rank, 1);
+
+		std::uint64_t seen = 0;
+		unsigned idx = 0;
+		for (; idx < bucket_count; ++idx)
+		{
+			seen += counts[idx];
+			if (seen >= rank) break;
+		}
+
+		auto value = bucket_value(std::min(idx, bucket_count - 1));
+		constexpr auto max_rep = static_cast<std::uint64_t>(std::chrono::nanoseconds::max().count());
+		return std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(std::min(value, max_rep)));
+	}
+}
@@ -4,11 +4,27 @@
 //          http://www.boost.org/LICENSE_1_0.txt
 
 #include <ext/future.hpp>
+#include <algorithm>
 #include <vector>
 #include <thread>
+#include <mutex>
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 namespace ext
 {
+	/// hint to processor, that we are in a spin-wait loop
+	static inline void cpu_relax() noexcept
+	{
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
 	struct future_errc_category_impl : std::error_category
 	{
 		const char * name() const noexcept override { return "ext::future_errc"; }
@@ -24,6 +40,7 @@ namespace ext
 			case future_errc::promise_already_satisfied:     return "promise_already_satisfied";
 			case future_errc::no_state:                      return "no_state";
 			case future_errc::cancelled:                     return "cancelled";
+			case future_errc::timeout:                       return "timeout";
 			default:
 				return "unknown sock_errc code";
 		}
@@ -113,12 +130,12 @@ namespace ext
 		auto fstate = fstnext.load(std::memory_order_relaxed);
 		fstate &= ~lock_mask;
 
-		// compare_exchange only not locked value.
+		// compare_exchange only not locked value, lock is held only by waiter management - briefly.
 		// release data set in promise: m_val, m_exception;
 		// acquire continuation list
 		while (not fstnext.compare_exchange_weak(fstate, ready, std::memory_order_acq_rel, std::memory_order_relaxed))
 		{
-			backoff();
+			if (fstate & lock_mask) backoff();
 			fstate &= ~lock_mask;
 		}
 
@@ -130,58 +147,53 @@ namespace ext
 		assert(not dynamic_cast<continuation_waiter *>(continuation));
 		assert(not is_continuation(continuation->m_fstnext.load(std::memory_order_relaxed)));
 
-		auto fstate = lock_ptr(head);
+		// std::memory_order_acquire - if ready, continuation will access result
+		auto fstate = head.load(std::memory_order_acquire);
 		if (fstate == ready)
-		{   // state became ready. just execute continuation.
+		{   // state is ready. just execute continuation.
 			continuation->continuate(caller); // it's defined as noexcept
 			return false;
 		}
 
-		auto * head_ptr = reinterpret_cast<continuation_type *>(fstate);
-		if (is_continuation(fstate) && is_waiter(head_ptr))
-		{
-			continuation->addref();
-			auto next = head_ptr->m_fstnext.load(std::memory_order_relaxed);
-			continuation->m_fstnext.store(next, std::memory_order_relaxed);
-			head_ptr->m_fstnext.store(reinterpret_cast<std::uintptr_t>(continuation), std::memory_order_relaxed);
-		}
-		else
+		// reference for continuation chain, must be taken before continuation becomes visible to signal_future
+		continuation->addref();
+		auto newval = reinterpret_cast<std::uintptr_t>(continuation);
+
+		// Treiber stack push, lock bit is preserved - it guards only waiter management, see class description.
+		// std::memory_order_release - publish continuation to thread running continuation chain
+		do
 		{
-			continuation->addref();
-			continuation->m_fstnext.store(fstate, std::memory_order_relaxed);
-			fstate = reinterpret_cast<std::uintptr_t>(continuation);
-		}
+			continuation->m_fstnext.store(fstate & ~lock_mask, std::memory_order_relaxed);
+			if (head.compare_exchange_weak(fstate, newval | (fstate & lock_mask), std::memory_order_release, std::memory_order_acquire))
+				return true;
 
-		unlock_ptr(head, fstate);
-		return true;
+		} while (fstate != ready);
+
+		// became ready concurrently, reference is already taken - run continuation as continuation chain would do
+		continuation->continuate(caller);
+		continuation->release();
+		return false;
 	}
 
 	void shared_state_basic::run_continuations(std::uintptr_t addr, shared_state_basic * caller) noexcept
 	{
-		if (not is_continuation(addr)) return;
-
-		auto * ptr = reinterpret_cast<continuation_type *>(addr);
-		if (is_waiter(ptr))
+		while (is_continuation(addr))
 		{
-			auto * waiter = static_cast<continuation_waiter *>(ptr);
-			addr = waiter->m_fstnext.load(std::memory_order_acquire);
-			waiter->continuate(caller);
-
-			if (waiter->release() == 1)
-				ext::release_waiter(waiter);
-
-			goto loop;
-		}
+			auto * ptr = reinterpret_cast<continuation_type *>(addr & ~waiter_mask);
+			bool waiter = is_waiter(addr);
 
-		do
-		{
 			addr = ptr->m_fstnext.load(std::memory_order_acquire);
 			ptr->continuate(caller);
-			ptr->release();
 
-		loop:
-			ptr = reinterpret_cast<continuation_type *>(addr);
-		} while (is_continuation(addr));
+			if (not waiter)
+				ptr->release();
+			else
+			{
+				auto * wptr = static_cast<continuation_waiter *>(ptr);
+				if (wptr->release() == 1)
+					ext::release_waiter(wptr);
+			}
+		}
 	}
 
 	auto shared_state_basic::acquire_waiter(std::atomic_uintptr_t & head) -> continuation_waiter *
@@ -190,27 +202,33 @@ namespace ext
 		if (fstate == ready) return nullptr;
 
 		continuation_waiter * waiter;
-		auto continuation = reinterpret_cast<continuation_type *>(fstate);
-		if (is_continuation(fstate) && is_waiter(continuation))
+		if (is_waiter(fstate))
 		{
-			waiter = static_cast<continuation_waiter *>(continuation);
+			// waiter at head can't be detached or signaled, while we hold the lock
+			waiter = reinterpret_cast<continuation_waiter *>(fstate & ~waiter_mask);
 			waiter->addref();
+			unlock_ptr(head);
+			return waiter;
 		}
-		else
+		
 		{
 			auto_unlocker lock(head);
 			waiter = ext::acquire_waiter();
 			assert(waiter);
 			lock.release();
-			
-			// one for wait call, one for continuation chain running after set_value call.
-			// it will decrement refcount for all continuations in chain, so we must increment for them too
-			waiter->addref(2);
-			waiter->m_fstnext.store(fstate);
-			fstate = reinterpret_cast<std::uintptr_t>(waiter);
 		}
 
-		unlock_ptr(head, fstate);
+		// one for wait call, one for continuation chain running after set_value call.
+		// it will decrement refcount for all continuations in chain, so we must increment for them too
+		waiter->addref(2);
+		auto newval = reinterpret_cast<std::uintptr_t>(waiter) | waiter_mask;
+
+		// continuations could be pushed concurrently, head can't become ready - signal_future waits for lock.
+		// Push waiter and unlock in one step.
+		fstate = head.load(std::memory_order_relaxed);
+		do waiter->m_fstnext.store(fstate & ~lock_mask, std::memory_order_relaxed);
+		while (not head.compare_exchange_weak(fstate, newval, std::memory_order_release, std::memory_order_relaxed));
+
 		return waiter;
 	}
 
@@ -224,23 +242,24 @@ namespace ext
 			return ext::release_waiter(waiter);
 		};
 
-		assert(is_continuation(fstate));
-		assert(is_waiter(reinterpret_cast<continuation_type *>(fstate)));
-		assert(waiter == reinterpret_cast<continuation_type *>(fstate));
-
-		if (waiter->release() > 2)
-			unlock_ptr(head, fstate);
-		else
-		{	// we are the last one using this waiter, one was reserved to set_value call,
-			// but we holding pointer lock, so they will not traverse concurrently.
-			// remove waiter from chain and unlock pointer.
-			unlock_ptr(head, waiter->m_fstnext.load(std::memory_order_relaxed));
-			waiter->release();
-			
-			ext::release_waiter(waiter);
+		auto waiter_val = reinterpret_cast<std::uintptr_t>(waiter) | waiter_mask;
+		// one reference is reserved to set_value call, one is held by pool
+		if (waiter->release() > 2 or fstate != waiter_val)
+		{
+			// still used by others, or continuations were pushed over waiter - it can't be detached lock-free,
+			// it stays in chain until state becomes ready and then returned to pool by run_continuations.
+			return unlock_ptr(head);
 		}
 
-		return;
+		// we are the last one using this waiter and it's at head, nobody traverses chain concurrently.
+		// Detach waiter and unlock pointer, unless continuation was pushed concurrently.
+		auto expected = waiter_val | lock_mask;
+		auto next = waiter->m_fstnext.load(std::memory_order_relaxed);
+		if (not head.compare_exchange_strong(expected, next, std::memory_order_release, std::memory_order_relaxed))
+			return unlock_ptr(head);
+
+		waiter->release();
+		ext::release_waiter(waiter);
 	}
 
 	void shared_state_basic::set_future_ready() noexcept
@@ -503,7 +522,7 @@ namespace ext
 		state->release();
 
 		// add_continuation(this) have memory_order_release semantics on this pointer
-		// (unlock_ptr in attach_continuation)
+		// (compare_exchange in attach_continuation)
 		// so std::atomic_thread_fence(std::memory_order_release) is already done
 	}
 
@@ -547,6 +566,232 @@ namespace ext
 	}
 
 
+	/************************************************************************/
+	/*             cancellation_state/cancellation_link                     */
+	/************************************************************************/
+	/// shared state of cancellation_source, see cancellation_token description.
+	/// Besides callbacks it's continuation list holds cancellation_link's of with_cancellation ties.
+	/// Link becomes dead when tied future becomes ready, and dead links are detached in batches,
+	/// once they are at least half of all links - so list does not grow with number of ever tied futures.
+	class cancellation_state : public shared_state<void>
+	{
+		/// dead links count starting from which they are detached, smaller batches are not worth locking the list
+		static constexpr std::ptrdiff_t purge_threshold = 16;
+
+	protected:
+		/// links in continuation list
+		std::atomic_ptrdiff_t m_links = ATOMIC_VAR_INIT(0);
+		/// dead links still in continuation list,
+		/// can be transiently negative - purge can detach link before it's counted here
+		std::atomic_ptrdiff_t m_dead = ATOMIC_VAR_INIT(0);
+		/// purge is in progress, concurrent requests are skipped
+		std::atomic_bool m_purging = ATOMIC_VAR_INIT(false);
+
+	protected:
+		/// detaches dead links from continuation list, except head one: head can be replaced by concurrent push.
+		void purge() noexcept;
+
+	public:
+		/// ties state to this cancellation state, see ext::with_cancellation
+		void tie(shared_state_basic & state);
+		/// called by link, when it's future became ready
+		void link_dead() noexcept;
+	};
+
+	/// with_cancellation tie: link itself is continuation of cancellation_state, and it's m_detach is continuation of tied future.
+	/// Tied future is held by link until first of: source state becomes ready(future is cancelled, if cancellation was requested),
+	/// or future becomes ready - link becomes dead and is detached from source state later.
+	class cancellation_link : public continuation_base
+	{
+	public:
+		/// continuation of tied future placed in link, like when_all_slot_continuation it forwards addref/release to link
+		class detach_continuation : public continuation_base
+		{
+			cancellation_link * m_link;
+
+		public:
+			cancellation_link * link() const noexcept { return m_link; }
+			void continuate(shared_state_basic * caller) noexcept override { m_link->future_ready(); }
+
+		public:
+			unsigned addref() noexcept override           { return m_link->addref(); }
+			unsigned addref(unsigned n) noexcept override { return m_link->addref(n); }
+			unsigned release() noexcept override          { return m_link->release(); }
+			unsigned use_count() const noexcept override  { return m_link->use_count(); }
+
+		public:
+			detach_continuation(cancellation_link * link) noexcept : m_link(link) {}
+		};
+
+	protected:
+		ext::intrusive_ptr<cancellation_state> m_source;
+		std::atomic<shared_state_basic *> m_state;
+		detach_continuation m_detach;
+
+	public:
+		const ext::intrusive_ptr<cancellation_state> & source() const noexcept { return m_source; }
+		detach_continuation * detach() noexcept { return &m_detach; }
+		bool is_dead() const noexcept { return m_state.load(std::memory_order_relaxed) == nullptr; }
+
+		/// source state became ready: cancels future, if cancellation was requested
+		void continuate(shared_state_basic * caller) noexcept override;
+		/// tied future became ready
+		void future_ready() noexcept;
+
+	public:
+		cancellation_link(cancellation_state * source, shared_state_basic * state) noexcept
+			: m_source(source), m_state(state), m_detach(this) { state->addref(); }
+		~cancellation_link() noexcept;
+	};
+
+	void cancellation_link::continuate(shared_state_basic * caller) noexcept
+	{
+		// whoever comes first: continuate or future_ready, takes future
+		if (auto * state = m_state.exchange(nullptr, std::memory_order_acq_rel))
+		{
+			if (caller->is_cancelled()) state->cancel();
+			state->release();
+		}
+	}
+
+	void cancellation_link::future_ready() noexcept
+	{
+		if (auto * state = m_state.exchange(nullptr, std::memory_order_acq_rel))
+		{
+			state->release();
+			m_source->link_dead();
+		}
+	}
+
+	cancellation_link::~cancellation_link() noexcept
+	{
+		// link was never attached to future
+		if (auto * state = m_state.load(std::memory_order_relaxed))
+			state->release();
+	}
+
+	void cancellation_state::tie(shared_state_basic & state)
+	{
+		auto link = ext::make_intrusive<cancellation_link>(this, &state);
+
+		// if cancellation is already requested - future is cancelled right here
+		m_links.fetch_add(1, std::memory_order_relaxed);
+		if (not add_continuation(link.get()))
+		{
+			m_links.fetch_sub(1, std::memory_order_relaxed);
+			return;
+		}
+
+		// if future is already ready - link becomes dead right here
+		state.add_continuation(link->detach());
+	}
+
+	void cancellation_state::link_dead() noexcept
+	{
+		auto dead = m_dead.fetch_add(1, std::memory_order_relaxed) + 1;
+		if (dead >= purge_threshold and dead * 2 >= m_links.load(std::memory_order_relaxed))
+			purge();
+	}
+
+	void cancellation_state::purge() noexcept
+	{
+		if (m_purging.exchange(true, std::memory_order_acquire))
+			return;
+
+		// while list is locked, it can't become ready or be traversed by others, pushes touch only head,
+		// so links after head can be unlinked without further synchronization
+		auto fstate = lock_ptr(m_fstnext);
+		if (fstate != ready)
+		{
+			std::ptrdiff_t removed = 0;
+			if (is_continuation(fstate))
+			{
+				auto * prev = reinterpret_cast<continuation_type *>(fstate & ~waiter_mask);
+				auto addr = prev->m_fstnext.load(std::memory_order_relaxed);
+
+				while (is_continuation(addr))
+				{
+					auto * ptr = reinterpret_cast<continuation_type *>(addr & ~waiter_mask);
+					auto next = ptr->m_fstnext.load(std::memory_order_relaxed);
+					auto * link = is_waiter(addr) ? nullptr : dynamic_cast<cancellation_link *>(ptr);
+
+					if (link and link->is_dead())
+					{
+						prev->m_fstnext.store(next, std::memory_order_relaxed);
+						link->release();
+						++removed;
+					}
+					else
+						prev = ptr;
+
+					addr = next;
+				}
+			}
+
+			unlock_ptr(m_fstnext);
+			m_links.fetch_sub(removed, std::memory_order_relaxed);
+			m_dead.fetch_sub(removed, std::memory_order_relaxed);
+		}
+
+		m_purging.store(false, std::memory_order_release);
+	}
+
+	auto shared_state_basic::tied_cancellation(std::atomic_uintptr_t & head) -> ext::intrusive_ptr<shared_state_basic>
+	{
+		// typical future has no continuations at all - nothing to look for, do not lock
+		auto fstate = head.load(std::memory_order_relaxed);
+		if (fstate == ready or not is_continuation(fstate & ~lock_mask))
+			return nullptr;
+
+		fstate = lock_ptr(head);
+		if (fstate == ready) return nullptr;
+
+		auto_unlocker lock(head);
+		for (auto addr = fstate; is_continuation(addr);)
+		{
+			auto * ptr = reinterpret_cast<continuation_type *>(addr & ~waiter_mask);
+			if (not is_waiter(addr))
+			{
+				// link is held by it's detach continuation, while it's in the list
+				if (auto * detach = dynamic_cast<cancellation_link::detach_continuation *>(ptr))
+					return detach->link()->source();
+			}
+
+			addr = ptr->m_fstnext.load(std::memory_order_relaxed);
+		}
+
+		return nullptr;
+	}
+
+	auto shared_state_basic::tied_cancellation() -> ext::intrusive_ptr<shared_state_basic>
+	{
+		return tied_cancellation(m_fstnext);
+	}
+
+	void tie_cancellation(shared_state_basic & state, shared_state_basic & source)
+	{
+		// token can only be obtained from cancellation_source, so it's state is always cancellation_state
+		static_cast<cancellation_state &>(source).tie(state);
+	}
+
+	bool inherit_cancellation(shared_state_basic & parent, shared_state_basic & derived)
+	{
+		auto source = parent.tied_cancellation();
+		if (not source) return false;
+
+		if (not derived.is_ready())
+			static_cast<cancellation_state &>(*source).tie(derived);
+
+		return true;
+	}
+
+	cancellation_source::cancellation_source()
+		: m_promise(ext::make_intrusive<cancellation_state>())
+	{
+
+	}
+
+
 	void continuation_waiter_impl::continuate(shared_state_basic * caller) noexcept
 	{
 		{
@@ -584,20 +829,96 @@ namespace ext
 
 
 
+	bool adaptive_continuation_waiter::spin(std::chrono::steady_clock::time_point timeout_point) noexcept
+	{
+		// clock is not cheap, check it only once in a while
+		constexpr unsigned clock_check_mask = 63;
+		for (unsigned i = 0; i < m_spin_count; ++i)
+		{
+			if (m_ready.load(std::memory_order_acquire)) return true;
+			if ((i & clock_check_mask) == clock_check_mask and std::chrono::steady_clock::now() >= timeout_point)
+				break;
+
+			cpu_relax();
+		}
+
+		return m_ready.load(std::memory_order_acquire);
+	}
+
+	void adaptive_continuation_waiter::continuate(shared_state_basic * caller) noexcept
+	{
+		// seq_cst store of m_ready and load of m_parked, paired with seq_cst store of m_parked and load of m_ready in waiting functions:
+		// either waiter sees m_ready, or we see m_parked and notify under mutex.
+		m_ready.store(true, std::memory_order_seq_cst);
+		if (not m_parked.load(std::memory_order_seq_cst)) return;
+
+		{
+			unique_lock lk(m_mutex);
+		}
+
+		m_var.notify_all();
+	}
+
+	void adaptive_continuation_waiter::wait_ready() noexcept
+	{
+		if (spin(std::chrono::steady_clock::time_point::max())) return;
+
+		unique_lock lk(m_mutex);
+		m_parked.store(true, std::memory_order_seq_cst);
+		m_var.wait(lk, [this] { return m_ready.load(std::memory_order_seq_cst); });
+	}
+
+	bool adaptive_continuation_waiter::wait_ready(std::chrono::steady_clock::time_point timeout_point) noexcept
+	{
+		if (spin(timeout_point)) return true;
+
+		unique_lock lk(m_mutex);
+		m_parked.store(true, std::memory_order_seq_cst);
+		return m_var.wait_until(lk, timeout_point, [this] { return m_ready.load(std::memory_order_seq_cst); });
+	}
+
+	bool adaptive_continuation_waiter::wait_ready(std::chrono::steady_clock::duration timeout_duration) noexcept
+	{
+		return wait_ready(std::chrono::steady_clock::now() + timeout_duration);
+	}
+
+	void adaptive_continuation_waiter::reset() noexcept
+	{
+		m_ready.store(false, std::memory_order_relaxed);
+		m_parked.store(false, std::memory_order_relaxed);
+		m_fstnext.store(fsnext_init, std::memory_order_relaxed);
+		m_promise_state.store(static_cast<unsigned>(future_state::unsatisfied), std::memory_order_relaxed);
+	}
+
+	/// creates waiter: adaptive_continuation_waiter if spin_count > 0, continuation_waiter_impl otherwise
+	static auto make_waiter(unsigned spin_count) -> continuation_waiters_pool::waiter_ptr
+	{
+		if (spin_count)
+			return ext::make_intrusive<ext::adaptive_continuation_waiter>(spin_count);
+		else
+			return ext::make_intrusive<ext::continuation_waiter_impl>();
+	}
+
+
 	class default_continuation_waiters_pool : public continuation_waiters_pool
 	{
 	protected:
 		std::atomic_uint m_usecount = ATOMIC_VAR_INIT(0);
+		unsigned m_spin_count = 0;
 
 	public:
 		void take(waiter_ptr & ptr) override;
 		void putback(waiter_ptr & ptr) override;
 		bool used() const noexcept override { return m_usecount.load(std::memory_order_relaxed); }
+
+	public:
+		default_continuation_waiters_pool(unsigned spin_count = 0) noexcept
+			: m_spin_count(spin_count) {}
 	};
 
 	void default_continuation_waiters_pool::take(waiter_ptr & ptr)
 	{
-		ptr = ext::make_intrusive<ext::continuation_waiter_impl>();
+		ptr = make_waiter(m_spin_count);
 		m_usecount.fetch_add(1, std::memory_order_relaxed);
 	}
 
@@ -615,6 +936,7 @@ namespace ext
 		std::atomic<std::size_t> m_last_avail;
 		std::atomic<std::size_t> m_first_free;
 		std::atomic<std::size_t> m_usecount = 0;
+		unsigned m_spin_count = 0;
 		
 		std::vector<waiter_ptr> m_objects;
 	
@@ -628,7 +950,8 @@ namespace ext
 		bool used() const noexcept override;
 	
 	public:
-		arena_continuation_pool(std::size_t num) { init(num); }
+		arena_continuation_pool(std::size_t num, unsigned spin_count = 0)
+			: m_spin_count(spin_count) { init(num); }
 		~arena_continuation_pool() { free(); }
 
 	protected:
@@ -639,7 +962,7 @@ namespace ext
 	{
 		m_objects.resize(num);
 		for (auto & val : m_objects)
-			val = ext::make_intrusive<ext::continuation_waiter_impl>();
+			val = make_waiter(m_spin_count);
 	
 		// Strictly speaking lockfree_continuation_pool should be created and initiated before any thread are created,
 		// any new threads will happen later and see anything done here, without any memory_fence. so this one is unneeded.
@@ -669,7 +992,7 @@ namespace ext
 			if (new_first == last)
 			{
 				//throw std::runtime_error("ext::future: waiter pool exhausted, see init_future_library");
-				ptr = ext::make_intrusive<ext::continuation_waiter_impl>();
+				ptr = make_waiter(m_spin_count);
 				m_usecount.fetch_add(1, std::memory_order_relaxed);
 				return;
 			}
@@ -716,6 +1039,271 @@ namespace ext
 			backoff();
 	}
 
+	namespace
+	{
+		constexpr unsigned waiter_cache_size = 8;
+
+		struct waiter_thread_cache;
+
+		/// state shared by thread_cached_continuation_pool and thread caches bound to it,
+		/// outlives pool while there are bound thread caches
+		struct waiter_cache_registry
+		{
+			std::atomic<unsigned> refs = ATOMIC_VAR_INIT(1);
+			std::size_t slots;
+			unsigned spin_count;
+
+			std::mutex mutex;
+			// shared free list of up to slots waiters, guarded by mutex.
+			// Accessed only on thread cache overflow/underflow, when empty - new waiters are allocated, so take never fails
+			std::vector<continuation_waiter *> depot;
+			std::vector<waiter_thread_cache *> caches; // bound thread caches, guarded by mutex
+			std::int64_t retired_balance = 0;          // balance of unbound caches and closed threads, guarded by mutex
+
+			/// takes waiter from depot or allocates new one
+			void take(continuation_waiters_pool::waiter_ptr & ptr);
+			/// moves up to count waiters from depot into items, returns number of moved
+			unsigned take(continuation_waiter ** items, unsigned count) noexcept;
+			/// returns waiter into depot, or frees it if depot is full
+			void putback(continuation_waiters_pool::waiter_ptr & ptr) noexcept;
+			/// returns count waiters into depot, ones not fitting are freed
+			void putback(continuation_waiter ** items, unsigned count) noexcept;
+
+			waiter_cache_registry(std::size_t slots, unsigned spin_count);
+			~waiter_cache_registry();
+		};
+
+		/// per thread cache, trivially constructible and destructible, so it's zero initialized
+		/// and can be safely accessed at any time during thread life, even from other thread_local destructors.
+		/// It's flushed by waiter_cache_flusher on thread exit, after that all requests are forwarded to arena.
+		struct waiter_thread_cache
+		{
+			waiter_cache_registry * registry;          // registry cache is bound to, holds reference
+			continuation_waiter * items[waiter_cache_size];
+			unsigned count;
+			std::atomic<std::int64_t> balance;         // waiters taken minus returned by this thread, written only by owner thread
+			bool registered;                           // waiter_cache_flusher is constructed for this thread
+			bool closed;                               // waiter_cache_flusher already flushed this cache
+		};
+
+		struct waiter_cache_flusher
+		{
+			~waiter_cache_flusher() noexcept;
+		};
+
+		class thread_cached_continuation_pool : public continuation_waiters_pool
+		{
+		protected:
+			waiter_cache_registry * m_registry;
+
+		protected:
+			void adjust_retired(std::int64_t val) noexcept;
+
+		public:
+			void take(waiter_ptr & ptr) override;
+			void putback(waiter_ptr & ptr) noexcept override;
+			bool used() const noexcept override;
+
+		public:
+			thread_cached_continuation_pool(std::size_t slots, unsigned spin_count)
+				: m_registry(new waiter_cache_registry(slots, spin_count)) {}
+			~thread_cached_continuation_pool();
+		};
+	}
+
+	static thread_local waiter_thread_cache ts_waiter_cache;
+	static thread_local waiter_cache_flusher ts_waiter_flusher;
+
+	waiter_cache_registry::waiter_cache_registry(std::size_t slots, unsigned spin_count)
+		: slots(slots), spin_count(spin_count)
+	{
+		// reserved, so putback never allocates
+		depot.reserve(slots);
+		for (std::size_t idx = 0; idx < slots; ++idx)
+			depot.push_back(make_waiter(spin_count).release());
+	}
+
+	waiter_cache_registry::~waiter_cache_registry()
+	{
+		for (auto * waiter : depot)
+			continuation_waiters_pool::waiter_ptr(waiter, ext::noaddref);
+	}
+
+	void waiter_cache_registry::take(continuation_waiters_pool::waiter_ptr & ptr)
+	{
+		{
+			std::lock_guard lk(mutex);
+			if (not depot.empty())
+			{
+				ptr = continuation_waiters_pool::waiter_ptr(depot.back(), ext::noaddref);
+				depot.pop_back();
+				return;
+			}
+		}
+
+		ptr = make_waiter(spin_count);
+	}
+
+	unsigned waiter_cache_registry::take(continuation_waiter ** items, unsigned count) noexcept
+	{
+		std::lock_guard lk(mutex);
+		count = static_cast<unsigned>(std::min<std::size_t>(count, depot.size()));
+		std::copy(depot.end() - count, depot.end(), items);
+		depot.resize(depot.size() - count);
+		return count;
+	}
+
+	void waiter_cache_registry::putback(continuation_waiters_pool::waiter_ptr & ptr) noexcept
+	{
+		{
+			std::lock_guard lk(mutex);
+			if (depot.size() < slots)
+				return depot.push_back(ptr.release());
+		}
+
+		ptr = nullptr;
+	}
+
+	void waiter_cache_registry::putback(continuation_waiter ** items, unsigned count) noexcept
+	{
+		unsigned idx = 0;
+		{
+			std::lock_guard lk(mutex);
+			for (; idx < count and depot.size() < slots; ++idx)
+				depot.push_back(items[idx]);
+		}
+
+		// depot is full, free the rest outside of lock
+		for (; idx < count; ++idx)
+			continuation_waiters_pool::waiter_ptr(items[idx], ext::noaddref);
+	}
+
+	static void release_registry(waiter_cache_registry * registry) noexcept
+	{
+		if (registry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete registry;
+	}
+
+	/// returns cached waiters into depot, moves balance into registry and unbinds cache
+	static void unbind_cache(waiter_thread_cache & cache) noexcept
+	{
+		auto * registry = cache.registry;
+		if (not registry) return;
+
+		registry->putback(cache.items, cache.count);
+
+		{
+			std::lock_guard lk(registry->mutex);
+			auto & caches = registry->caches;
+			caches.erase(std::find(caches.begin(), caches.end(), &cache));
+			registry->retired_balance += cache.balance.load(std::memory_order_relaxed);
+		}
+
+		cache.count = 0;
+		cache.balance.store(0, std::memory_order_relaxed);
+		cache.registry = nullptr;
+		release_registry(registry);
+	}
+
+	static void bind_cache(waiter_thread_cache & cache, waiter_cache_registry * registry)
+	{
+		if (not cache.registered)
+		{
+			cache.registered = true;
+			// odr-use of thread_local constructs it and registers it's destructor
+			static_cast<void>(&ts_waiter_flusher);
+		}
+
+		{
+			std::lock_guard lk(registry->mutex);
+			registry->caches.push_back(&cache);
+		}
+
+		// cache can be bound to registry of already destroyed pool
+		unbind_cache(cache);
+		registry->refs.fetch_add(1, std::memory_order_relaxed);
+		cache.registry = registry;
+	}
+
+	waiter_cache_flusher::~waiter_cache_flusher() noexcept
+	{
+		auto & cache = ts_waiter_cache;
+		cache.closed = true;
+		unbind_cache(cache);
+	}
+
+	thread_cached_continuation_pool::~thread_cached_continuation_pool()
+	{
+		// thread caches bound to registry will release it on thread exit or rebinding to other pool
+		release_registry(m_registry);
+	}
+
+	void thread_cached_continuation_pool::adjust_retired(std::int64_t val) noexcept
+	{
+		std::lock_guard lk(m_registry->mutex);
+		m_registry->retired_balance += val;
+	}
+
+	void thread_cached_continuation_pool::take(waiter_ptr & ptr)
+	{
+		auto & cache = ts_waiter_cache;
+		if (cache.closed)
+		{
+			m_registry->take(ptr);
+			return adjust_retired(1);
+		}
+
+		if (cache.registry != m_registry)
+			bind_cache(cache, m_registry);
+
+		// refill half of cache at once, so next takes do not touch depot
+		if (not cache.count)
+			cache.count = m_registry->take(cache.items, waiter_cache_size / 2);
+
+		if (cache.count)
+			ptr = waiter_ptr(cache.items[--cache.count], ext::noaddref);
+		else
+			m_registry->take(ptr);
+
+		cache.balance.store(cache.balance.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void thread_cached_continuation_pool::putback(waiter_ptr & ptr) noexcept
+	{
+		auto & cache = ts_waiter_cache;
+		if (cache.registry != m_registry)
+		{	// closed or never bound thread, binding can throw - forward to depot
+			m_registry->putback(ptr);
+			return adjust_retired(-1);
+		}
+
+		// cache is full - return half of it into depot at once
+		if (cache.count == waiter_cache_size)
+		{
+			cache.count -= waiter_cache_size / 2;
+			m_registry->putback(cache.items + cache.count, waiter_cache_size / 2);
+		}
+
+		cache.items[cache.count++] = ptr.release();
+
+		cache.balance.store(cache.balance.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	}
+
+	bool thread_cached_continuation_pool::used() const noexcept
+	{
+		std::lock_guard lk(m_registry->mutex);
+		auto balance = m_registry->retired_balance;
+		for (auto * cache : m_registry->caches)
+			balance += cache->balance.load(std::memory_order_relaxed);
+
+		return balance != 0;
+	}
+
+	std::unique_ptr<continuation_waiters_pool> make_thread_cached_waiters_pool(unsigned waiter_slots, unsigned spin_count)
+	{
+		return std::make_unique<thread_cached_continuation_pool>(waiter_slots, spin_count);
+	}
+
 	// global object pool of continuation_waiters.
 	static default_continuation_waiters_pool g_default_pool;
 	static continuation_waiters_pool * g_pool = &g_default_pool;
@@ -735,6 +1323,9 @@ namespace ext
 	static void release_waiter(continuation_waiter * ptr) noexcept
 	{
 		assert(ptr->use_count() == 1);
+		// last user released waiter with std::memory_order_release, but refcount did not drop to 0 - no acquire was done.
+		// Synchronize with other users before reset
+		std::atomic_thread_fence(std::memory_order_acquire);
 		continuation_waiters_pool::waiter_ptr wptr {ptr, ext::noaddref};
 		wptr->reset();
 		g_pool->putback(wptr);
@@ -751,7 +1342,7 @@ namespace ext
 		return true;
 	}
 
-	bool init_future_library(unsigned waiter_slots)
+	bool init_future_library(unsigned waiter_slots, unsigned spin_count)
 	{
 		if (g_pool->used()) return false;
 
@@ -761,11 +1352,11 @@ namespace ext
 		// waiter_slots == 0 - use default_continuation_waiters_pool: allocate waiters new/delete
 		if (waiter_slots == 0)
 		{
-			g_pool = &g_default_pool;
+			g_pool = spin_count ? new default_continuation_waiters_pool(spin_count) : &g_default_pool;
 			return true;
 		}
 		
-		g_pool = new arena_continuation_pool(waiter_slots);
+		g_pool = new arena_continuation_pool(waiter_slots, spin_count);
 		return true;
 	}
 
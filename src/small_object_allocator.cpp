@@ -0,0 +1,189 @@
+#include <mutex>
+#include <ext/small_object_allocator.hpp>
+
+namespace ext
+{
+	namespace
+	{
+		/// free block, while in cache or depot
+		struct free_block
+		{
+			free_block * next;       // next block in thread cache list or in batch
+			free_block * next_batch; // next batch in depot, valid only for first block of batch
+		};
+
+		static_assert(sizeof(free_block) <= small_object_allocator::granularity);
+
+		struct cache_list
+		{
+			free_block * head;
+			std::size_t count;
+		};
+
+		/// per thread cache, trivially constructible and destructible,
+		/// so it's zero initialized and can be safely accessed at any time during thread life, even from other thread_local destructors.
+		/// It's flushed by cache_flusher on thread exit, after that it's closed and all requests are forwarded to ::operator new/delete.
+		struct thread_cache
+		{
+			cache_list lists[small_object_allocator::size_classes];
+			bool registered; // cache_flusher is constructed for this thread
+			bool closed;     // cache_flusher already flushed this cache
+		};
+
+		struct depot_list
+		{
+			std::mutex mutex;
+			free_block * batches = nullptr;
+			std::size_t count = 0;
+		};
+
+		struct cache_flusher
+		{
+			~cache_flusher() noexcept;
+		};
+	}
+
+	static thread_local thread_cache ts_cache;
+	static thread_local cache_flusher ts_flusher;
+
+	static depot_list * depot()
+	{
+		// intentionally never destroyed, blocks can be freed by threads outliving static objects destruction
+		static auto * lists = new depot_list[small_object_allocator::size_classes];
+		return lists;
+	}
+
+	static inline std::size_t size_class(std::size_t size) noexcept
+	{
+		return size == 0 ? 0 : (size - 1) / small_object_allocator::granularity;
+	}
+
+	static inline std::size_t class_size(std::size_t idx) noexcept
+	{
+		return (idx + 1) * small_object_allocator::granularity;
+	}
+
+	static void register_cache(thread_cache & cache) noexcept
+	{
+		cache.registered = true;
+		// odr-use of thread_local constructs it and registers it's destructor
+		static_cast<void>(&ts_flusher);
+	}
+
+	/// moves batch_size blocks from cache list into depot, or frees them if depot is full.
+	/// list must hold at least batch_size blocks
+	static void flush_batch(cache_list & list, std::size_t idx) noexcept
+	{
+		auto * first = list.head;
+		auto * last = first;
+		for (std::size_t n = 1; n < small_object_allocator::batch_size; ++n)
+			last = last->next;
+
+		list.head = last->next;
+		list.count -= small_object_allocator::batch_size;
+		last->next = nullptr;
+
+		{
+			auto & dl = depot()[idx];
+			std::lock_guard lk(dl.mutex);
+			if (dl.count < small_object_allocator::depot_limit)
+			{
+				first->next_batch = dl.batches;
+				dl.batches = first;
+				++dl.count;
+				return;
+			}
+		}
+
+		while (first)
+		{
+			auto * next = first->next;
+			::operator delete(first);
+			first = next;
+		}
+	}
+
+	/// takes batch from depot into empty cache list, returns false if depot is empty
+	static bool refill(cache_list & list, std::size_t idx) noexcept
+	{
+		auto & dl = depot()[idx];
+		std::lock_guard lk(dl.mutex);
+		if (not dl.batches) return false;
+
+		list.head = dl.batches;
+		list.count = small_object_allocator::batch_size;
+		dl.batches = dl.batches->next_batch;
+		--dl.count;
+		return true;
+	}
+
+	cache_flusher::~cache_flusher() noexcept
+	{
+		auto & cache = ts_cache;
+		cache.closed = true;
+
+		for (std::size_t idx = 0; idx < small_object_allocator::size_classes; ++idx)
+		{
+			auto & list = cache.lists[idx];
+			while (list.count >= small_object_allocator::batch_size)
+				flush_batch(list, idx);
+
+			for (auto * block = list.head; block;)
+			{
+				auto * next = block->next;
+				::operator delete(block);
+				block = next;
+			}
+
+			list.head = nullptr;
+			list.count = 0;
+		}
+	}
+
+	void * small_object_allocator::allocate(std::size_t size)
+	{
+		if (size > max_size)
+			return ::operator new(size);
+
+		auto & cache = ts_cache;
+		auto idx = size_class(size);
+		auto & list = cache.lists[idx];
+
+		if (not list.head)
+		{
+			if (cache.closed)
+				return ::operator new(class_size(idx));
+
+			if (not cache.registered) register_cache(cache);
+			if (not refill(list, idx))
+				return ::operator new(class_size(idx));
+		}
+
+		auto * block = list.head;
+		list.head = block->next;
+		--list.count;
+		return block;
+	}
+
+	void small_object_allocator::deallocate(void * ptr, std::size_t size) noexcept
+	{
+		if (size > max_size or not ptr)
+			return ::operator delete(ptr);
+
+		auto & cache = ts_cache;
+		if (cache.closed)
+			return ::operator delete(ptr);
+
+		if (not cache.registered) register_cache(cache);
+
+		auto idx = size_class(size);
+		auto & list = cache.lists[idx];
+		auto * block = static_cast<free_block *>(ptr);
+
+		block->next = list.head;
+		list.head = block;
+
+		if (++list.count > cache_limit)
+			flush_batch(list, idx);
+	}
+}
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <ext/thread_affinity.hpp>
+#include <boost/predef.h>
+
+namespace ext
+{
+	static cpu_set all_cpus()
+	{
+		cpu_set cpus(std::max(1u, std::thread::hardware_concurrency()));
+		for (unsigned idx = 0; idx < cpus.size(); ++idx)
+			cpus[idx] = idx;
+
+		return cpus;
+	}
+
+	std::vector<cpu_set> round_robin_affinity(const cpu_set & cpus)
+	{
+		std::vector<cpu_set> result;
+		result.reserve(cpus.size());
+
+		for (unsigned cpu : cpus)
+			result.push_back(cpu_set {cpu});
+
+		return result;
+	}
+}
+
+
+#if BOOST_OS_WINDOWS
+#include <windows.h>
+
+namespace ext
+{
+	bool set_thread_affinity(std::thread & thr, const cpu_set & cpus)
+	{
+		DWORD_PTR mask = 0;
+		for (unsigned cpu : cpus)
+			if (cpu < sizeof(mask) * 8) mask |= DWORD_PTR(1) << cpu;
+
+		if (not mask) return false;
+		return ::SetThreadAffinityMask(thr.native_handle(), mask) != 0;
+	}
+
+	cpu_set get_thread_affinity()
+	{
+		// there is no GetThreadAffinityMask, previous mask is returned by SetThreadAffinityMask
+		DWORD_PTR process_mask, system_mask;
+		if (not ::GetProcessAffinityMask(::GetCurrentProcess(), &process_mask, &system_mask))
+			return {};
+
+		auto thread = ::GetCurrentThread();
+		DWORD_PTR mask = ::SetThreadAffinityMask(thread, process_mask);
+		if (not mask) return {};
+		::SetThreadAffinityMask(thread, mask);
+
+		cpu_set cpus;
+		for (unsigned cpu = 0; cpu < sizeof(mask) * 8; ++cpu)
+			if (mask & (DWORD_PTR(1) << cpu)) cpus.push_back(cpu);
+
+		return cpus;
+	}
+
+	int current_cpu() noexcept
+	{
+		return static_cast<int>(::GetCurrentProcessorNumber());
+	}
+
+	std::vector<cpu_set> numa_nodes()
+	{
+		ULONG highest;
+		if (not ::GetNumaHighestNodeNumber(&highest))
+			return {all_cpus()};
+
+		std::vector<cpu_set> nodes;
+		for (ULONG node = 0; node <= highest; ++node)
+		{
+			ULONGLONG mask;
+			cpu_set cpus;
+			if (::GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+			{
+				for (unsigned cpu = 0; cpu < sizeof(mask) * 8; ++cpu)
+					if (mask & (ULONGLONG(1) << cpu)) cpus.push_back(cpu);
+			}
+
+			// node numbers can be sparse, memory only nodes have no CPUs
+			if (not cpus.empty()) nodes.push_back(std::move(cpus));
+		}
+
+		if (nodes.empty()) nodes.push_back(all_cpus());
+		return nodes;
+	}
+}
+
+#elif BOOST_OS_LINUX
+#include <cerrno>
+#include <cctype>
+#include <sched.h>
+#include <pthread.h>
+#include <fstream>
+#include <string>
+
+namespace ext
+{
+	bool set_thread_affinity(std::thread & thr, const cpu_set & cpus)
+	{
+		if (cpus.empty()) return false;
+
+		unsigned max_cpu = *std::max_element(cpus.begin(), cpus.end());
+		auto * set = CPU_ALLOC(max_cpu + 1);
+		if (not set) return false;
+
+		auto size = CPU_ALLOC_SIZE(max_cpu + 1);
+		CPU_ZERO_S(size, set);
+		for (unsigned cpu : cpus)
+			CPU_SET_S(cpu, size, set);
+
+		int res = ::pthread_setaffinity_np(thr.native_handle(), size, set);
+		CPU_FREE(set);
+		return res == 0;
+	}
+
+	cpu_set get_thread_affinity()
+	{
+		// kernel can support more CPUs than CPU_SETSIZE, grow set until it fits
+		for (unsigned count = CPU_SETSIZE;; count *= 2)
+		{
+			auto * set = CPU_ALLOC(count);
+			if (not set) return {};
+
+			auto size = CPU_ALLOC_SIZE(count);
+			CPU_ZERO_S(size, set);
+
+			if (::sched_getaffinity(0, size, set) != 0)
+			{
+				CPU_FREE(set);
+				if (errno == EINVAL and count < 1024 * 1024) continue;
+				return {};
+			}
+
+			cpu_set cpus;
+			for (unsigned cpu = 0; cpu < count; ++cpu)
+				if (CPU_ISSET_S(cpu, size, set)) cpus.push_back(cpu);
+
+			CPU_FREE(set);
+			return cpus;
+		}
+	}
+
+	int current_cpu() noexcept
+	{
+		return ::sched_getcpu();
+	}
+
+	/// parses list format of sysfs: "0-3,8,10-11"
+	static cpu_set parse_cpulist(const std::string & str)
+	{
+		cpu_set cpus;
+		std::size_t pos = 0;
+
+		while (pos < str.size())
+		{
+			std::size_t next;
+			unsigned first = std::stoul(str.substr(pos), &next);
+			unsigned last = first;
+			pos += next;
+
+			if (pos < str.size() and str[pos] == '-')
+			{
+				last = std::stoul(str.substr(++pos), &next);
+				pos += next;
+			}
+
+			for (unsigned cpu = first; cpu <= last; ++cpu)
+				cpus.push_back(cpu);
+
+			// skip ',' and trailing whitespace
+			while (pos < str.size() and not std::isdigit(static_cast<unsigned char>(str[pos])))
+				++pos;
+		}
+
+		return cpus;
+	}
+
+	/// reads first line of sysfs file, returns false if there is no such file
+	static bool read_sysfs_line(const std::string & path, std::string & line)
+	{
+		std::ifstream file(path);
+		return file and std::getline(file, line);
+	}
+
+	std::vector<cpu_set> numa_nodes()
+	{
+		const std::string root = "/sys/devices/system/node/";
+		std::vector<cpu_set> nodes;
+		std::string line;
+
+		// node numbers can be sparse: "0-1,4"
+		if (not read_sysfs_line(root + "online", line))
+			return {all_cpus()};
+
+		try
+		{
+			for (unsigned node : parse_cpulist(line))
+			{
+				if (not read_sysfs_line(root + "node" + std::to_string(node) + "/cpulist", line))
+					continue;
+
+				// memory only nodes have empty cpulist, workers can't be placed there
+				auto cpus = parse_cpulist(line);
+				if (not cpus.empty()) nodes.push_back(std::move(cpus));
+			}
+		}
+		catch (std::logic_error &)
+		{
+			return {all_cpus()};
+		}
+
+		if (nodes.empty()) nodes.push_back(all_cpus());
+		return nodes;
+	}
+}
+
+#else
+
+namespace ext
+{
+	bool set_thread_affinity(std::thread & thr, const cpu_set & cpus) { return false; }
+	cpu_set get_thread_affinity() { return {}; }
+	int current_cpu() noexcept { return -1; }
+	std::vector<cpu_set> numa_nodes() { return {all_cpus()}; }
+}
+
+#endif
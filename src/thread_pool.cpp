@@ -2,17 +2,42 @@
 #include <ext/thread_pool.hpp>
 #include <boost/iterator/transform_iterator.hpp>
 
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
 namespace ext
 {
-	thread_pool::worker::worker(thread_pool * parent)
+	/// hint to processor, that we are in a spin-wait loop
+	static inline void cpu_relax() noexcept
+	{
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	thread_local thread_pool::worker * thread_pool::ms_current_worker = nullptr;
+
+	thread_pool::worker::worker(thread_pool * parent, unsigned slot)
 	{
 		m_parent = parent;
+		m_slot = slot;
+		if (not parent->m_nodes.empty())
+			m_node = slot % parent->m_nodes.size();
+
 		m_thread = std::thread(&worker::thread_func, worker_ptr(this));
 	}
 	
 	void thread_pool::worker::thread_func(worker_ptr self)
 	{
-		self->m_parent->thread_func(self->m_stop_request);
+		ms_current_worker = self.get();
+		self->m_parent->thread_func(*self);
+		ms_current_worker = nullptr;
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		self->m_parent->retire_metrics(*self);
+	#endif
 		// mark ready on exit
 		self->set_value();
 	}
@@ -22,48 +47,57 @@ namespace ext
 		return m_stop_request.exchange(true, std::memory_order_relaxed);
 	}
 
-	void thread_pool::delayed_task_continuation::continuate(shared_state_basic * caller) noexcept
+	void thread_pool::delayed_task_base::fire() noexcept
 	{
-		if (not mark_marked())
+		if (not take())
 			// thread_pool is destructed or destructing
 			return;
 			
-		// remove ourself from m_delayed and add m_task to thread_pool tasks list
-		{
-			std::lock_guard lk(m_owner->m_mutex);
-			
-			auto & list = m_owner->m_delayed;
-			auto & delayed_count = m_owner->m_delayed_count;
-			auto it = list.iterator_to(*this);
-			list.erase(it);
-			
-			m_owner->m_tasks.push_back(*m_task.release());
-			bool notify = delayed_count == 0 || --delayed_count == 0;
-			
-			// Notify thread_pool if needed
-			// NOTE: Notify have to be done under lock,
-			//  otherwise this thread_pool object can be destroyed between release of mutex and notify_one call,
-			//  and m_owner becomes dangling pointer, and call to m_event.notify_one() is ill-formed.
-			//  While this situation is very rare - it can happen.
-			//  See clear method and destructor.
-			if (notify) m_owner->m_event.notify_one();
-		}
-
-		// we were removed from m_delayed - intrusive list,
-		// which does not manage lifetime, decrement refcount
-		release();
+		// move ourself from m_delayed to thread_pool tasks list,
+		// reference held by m_delayed is transferred to m_tasks
+		std::lock_guard lk(m_owner->m_mutex);
+		
+		auto & list = m_owner->m_delayed;
+		auto & delayed_count = m_owner->m_delayed_count;
+		list.erase(list.iterator_to(*this));
+
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		stamp_task(*this);
+	#endif
+		m_owner->m_tasks.push_back(*this);
+		bool notify = delayed_count == 0 || --delayed_count == 0;
+		
+		// Notify thread_pool if needed
+		// NOTE: Notify have to be done under lock,
+		//  otherwise this thread_pool object can be destroyed between release of mutex and notify_one call,
+		//  and m_owner becomes dangling pointer, and call to m_event.notify_one() is ill-formed.
+		//  While this situation is very rare - it can happen.
+		//  See clear method and destructor.
+		if (notify) m_owner->m_event.notify_one();
 	}
 
-	void thread_pool::delayed_task_continuation::abandone() noexcept
+	unsigned thread_pool::get_nworkers() const
 	{
-		m_task->task_abandone();
-		m_task = nullptr;
+		std::lock_guard lk(m_mutex);
+		return static_cast<unsigned>(m_pending);
 	}
 
-	unsigned thread_pool::get_nworkers() const
+	std::size_t thread_pool::queue_depth(priority prio) const
 	{
 		std::lock_guard lk(m_mutex);
-		return static_cast<unsigned>(m_pending);
+		if (prio == priority::high) return m_high_tasks.size();
+		if (prio == priority::low)  return m_low_tasks.size();
+
+		std::size_t depth = m_tasks.size();
+		if (m_queue) depth += m_queue->size();
+
+		for (auto & node : m_nodes)
+			depth += node.tasks.size();
+
+		for (auto * deque = m_deques.load(std::memory_order_acquire); deque; deque = deque->m_next)
+			depth += deque->size();
+
+		return depth;
 	}
 
 	bool thread_pool::join_worker(worker_ptr & wptr)
@@ -77,36 +111,42 @@ namespace ext
 			return false;
 	}
 
-	ext::future<void> thread_pool::set_nworkers(unsigned n)
+	void thread_pool::add_workers(std::size_t n)
 	{
-		std::unique_lock lk(m_mutex);
-		if (n == m_pending) return ext::make_ready_future();
-		unsigned old_size = static_cast<unsigned>(m_workers.size());
+		// join and remove finished stopping workers
+		auto first = m_workers.begin() + m_pending;
+		m_workers.erase(std::remove_if(first, m_workers.end(), join_worker), m_workers.end());
 
-		auto first = m_workers.begin();
-		auto last = m_workers.end();
+		// make room for new workers, stopping workers are moved to the end
+		std::size_t old_pending = m_pending;
+		std::size_t stopping = m_workers.size() - m_pending;
+		m_workers.resize(n + stopping);
 
-		if (n > old_size - m_pending)
-		{
-			first = std::remove_if(last - m_pending, last, join_worker);
-			m_pending = last - first;
-			m_workers.resize(n + m_pending);
+		first = m_workers.begin() + old_pending;
+		std::move_backward(first, first + stopping, m_workers.end());
 
-			first = m_workers.begin() + old_size;
-			last = m_workers.end() - m_pending;
-
-			std::move(first, first + m_pending, last);
+		for (auto last = m_workers.begin() + n; first != last; ++first, ++m_pending)
+		{
+			*first = ext::make_intrusive<worker>(this, static_cast<unsigned>(m_pending));
+			pin_worker(**first);
+		}
+	}
 
-			for (; first != last; ++first)
-				*first = ext::make_intrusive<worker>(this);
+	ext::future<void> thread_pool::set_nworkers(unsigned n)
+	{
+		std::unique_lock lk(m_mutex);
+		if (n == m_pending) return ext::make_ready_future();
 
+		if (n > m_pending)
+		{
+			add_workers(n);
 			return ext::make_ready_future();
 		}
 		else
 		{
-			first += n;
-			last -= m_pending;
-			m_pending += old_size - n;
+			auto first = m_workers.begin() + n;
+			auto last = m_workers.begin() + m_pending;
+			m_pending = n;
 
 			auto func = [](const worker_ptr & wptr) { return ext::future<void>(wptr); };
 
@@ -124,31 +164,723 @@ namespace ext
 		}
 	}
 
-	void thread_pool::thread_func(std::atomic_bool & stop_request)
+	void thread_pool::set_autoscale(const autoscale_options & opts)
+	{
+		disable_autoscale();
+
+		std::unique_lock lk(m_mutex);
+		m_autoscale = opts;
+		m_autoscale->max_workers = std::max(m_autoscale->max_workers, m_autoscale->min_workers);
+		m_supervisor_stop = false;
+		m_supervisor = std::thread(&thread_pool::supervisor_func, this);
+
+		if (m_pending < opts.min_workers)
+			add_workers(opts.min_workers);
+		else if (m_pending > m_autoscale->max_workers)
+		{
+			lk.unlock();
+			set_nworkers(m_autoscale->max_workers);
+		}
+	}
+
+	void thread_pool::disable_autoscale()
+	{
+		std::unique_lock lk(m_mutex);
+		m_autoscale.reset();
+		if (not m_supervisor.joinable()) return;
+
+		m_supervisor_stop = true;
+		lk.unlock();
+
+		m_supervisor_event.notify_one();
+		m_supervisor.join();
+		// idle workers can wait with timeout, wake them so they switch to plain waiting
+		m_event.notify_all();
+	}
+
+	bool thread_pool::has_pending_tasks() const noexcept
+	{
+		return not lanes_empty() or (m_queue and not m_queue->empty()) or has_stealable_tasks();
+	}
+
+	void thread_pool::supervisor_func()
+	{
+		// tasks are pending with no idle workers on previous check
+		bool backlogged = false;
+		std::unique_lock lk(m_mutex);
+
+		for (;;)
+		{
+			auto period = m_autoscale->wait_threshold;
+			m_supervisor_event.wait_for(lk, period, [this] { return m_supervisor_stop; });
+			if (m_supervisor_stop) return;
+
+			// backlog persisted through whole period - tasks wait at least wait_threshold, add one worker
+			bool now_backlogged = m_sleeping.load(std::memory_order_relaxed) == 0 and has_pending_tasks();
+			if (now_backlogged and backlogged and m_pending < m_autoscale->max_workers)
+			{
+				try
+				{
+					add_workers(m_pending + 1);
+				}
+				catch (std::system_error &)
+				{
+					// failed to create thread, try on next check
+				}
+			}
+
+			backlogged = now_backlogged;
+		}
+	}
+
+	void thread_pool::idle_wait(worker & self, std::unique_lock<std::mutex> & lk, std::chrono::steady_clock::time_point & deadline)
+	{
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		auto idle_start = std::chrono::steady_clock::now();
+		if (not m_autoscale)
+		{
+			m_event.wait(lk);
+			ext::metric_add(self.m_idle_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - idle_start).count());
+			return;
+		}
+	#else
+		if (not m_autoscale)
+			return m_event.wait(lk);
+	#endif
+
+		if (deadline == std::chrono::steady_clock::time_point())
+			deadline = std::chrono::steady_clock::now() + m_autoscale->idle_timeout;
+
+		auto status = m_event.wait_until(lk, deadline);
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		ext::metric_add(self.m_idle_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - idle_start).count());
+	#endif
+
+		if (status == std::cv_status::no_timeout)
+			return;
+
+		// idle timeout expired, start new idle period
+		deadline = std::chrono::steady_clock::time_point();
+		if (not m_autoscale or m_pending <= m_autoscale->min_workers) return;
+		if (self.m_stop_request.load(std::memory_order_relaxed)) return;
+
+		// retire: move ourself to the end of working workers and become stopping one,
+		// our future becomes ready on thread exit, and thread is joined by add_workers or destructor
+		auto first = m_workers.begin();
+		auto last = first + m_pending;
+		auto it = std::find_if(first, last, [&self](const worker_ptr & wptr) { return wptr.get() == &self; });
+		assert(it != last);
+
+		std::iter_swap(it, --last);
+		--m_pending;
+		self.stop_request();
+	}
+
+	void thread_pool::thread_func(worker & self)
 	{
+		if (m_options & work_stealing)
+			return work_stealing_thread_func(self);
+
+		if (m_options & lockfree_queue)
+			return lockfree_thread_func(self);
+
+		auto & stop_request = self.m_stop_request;
 		std::unique_lock lk(m_mutex, std::defer_lock);
 
 		for (;;)
 		{
-			ext::intrusive_ptr<task_base> task_ptr;
+			task_base * task;
+			std::chrono::steady_clock::time_point deadline;
 			lk.lock();
 
 			if (stop_request.load(std::memory_order_relaxed)) return;
-			if (not m_tasks.empty()) goto avail;
+			if (take_task_locked(self, task)) goto avail;
 
 		again:
-			m_event.wait(lk);
+			m_sleeping.fetch_add(1, std::memory_order_relaxed);
+			idle_wait(self, lk, deadline);
+			m_sleeping.fetch_sub(1, std::memory_order_relaxed);
 
 			if (stop_request.load(std::memory_order_relaxed)) return;
-			if (m_tasks.empty()) goto again;
+			if (not take_task_locked(self, task)) goto again;
 			
 		avail:
-			task_ptr.reset(&m_tasks.front(), ext::noaddref);
-			m_tasks.pop_front();
+			lk.unlock();
+			execute_task(self, task);
+		}
+	}
+
+	void thread_pool::work_stealing_thread_func(worker & self)
+	{
+		auto & stop_request = self.m_stop_request;
+		auto * deque = acquire_deque();
+		std::unique_lock lk(m_mutex, std::defer_lock);
+
+		for (;;)
+		{
+			if (stop_request.load(std::memory_order_relaxed)) break;
+
+			// preferred priority lane first.
+			// Than normal lane: own deque, lock-free queue and shared queue, steal from others.
+			// Than high and low lanes and spin
+			task_base * task;
+			std::chrono::steady_clock::time_point deadline;
+			auto lane = preferred_lane(self);
+			if (lane != priority::normal and take_lane_task(self, lane, task)) goto execute;
+			if (lane == priority::low and take_lane_task(self, priority::high, task)) goto execute;
+
+			if (deque->pop(task)) goto execute;
+			if (m_queue and m_queue->try_pop(task)) goto execute;
+			if (take_shared_task(self, task)) goto execute;
+			if (steal_task(deque, task)) goto steal;
+			if (take_lane_task(self, priority::high, task)) goto execute;
+			if (take_lane_task(self, priority::low, task)) goto execute;
+			if (m_queue and spin_for_task(deque, task)) goto execute;
+
+			// nothing found - go to sleep.
+			// Announce ourself sleeping and recheck queues: submitter pushes task into deque and than checks m_sleeping,
+			// we increment m_sleeping and than check deques, seq_cst fences guarantee at least one of us sees other's write.
+			lk.lock();
+			m_sleeping.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			while (not stop_request.load(std::memory_order_relaxed) and lanes_empty()
+			       and (not m_queue or m_queue->empty()) and not has_stealable_tasks())
+			{
+				idle_wait(self, lk, deadline);
+			}
+
+			m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+			lk.unlock();
+			continue;
+
+		steal:
+		#ifdef EXT_ENABLE_EXECUTOR_METRICS
+			ext::metric_add(self.m_steals, 1);
+		#endif
+
+		execute:
+			execute_task(self, task);
+		}
+
+		release_deque(deque);
+	}
+
+	void thread_pool::lockfree_thread_func(worker & self)
+	{
+		auto & stop_request = self.m_stop_request;
+		std::unique_lock lk(m_mutex, std::defer_lock);
+		unsigned executed = 0;
+
+		for (;;)
+		{
+			if (stop_request.load(std::memory_order_relaxed)) return;
+
+			// same lanes order as in work_stealing_thread_func
+			task_base * task;
+			std::chrono::steady_clock::time_point deadline;
+			auto lane = preferred_lane(self);
+			if (lane != priority::normal and take_lane_task(self, lane, task)) goto execute;
+			if (lane == priority::low and take_lane_task(self, priority::high, task)) goto execute;
+
+			if (++executed % shared_queue_check_period == 0 and take_shared_task(self, task)) goto execute;
+			if (m_queue->try_pop(task)) goto execute;
+			if (take_lane_task(self, priority::high, task)) goto execute;
+			if (take_lane_task(self, priority::low, task)) goto execute;
+			if (spin_for_task(nullptr, task)) goto execute;
+
+			// nothing found - check shared queue and lanes and go to sleep,
+			// same protocol as in work_stealing_thread_func, but with lock-free queue instead of deques
+			lk.lock();
+			if (take_task_locked(self, task)) goto avail;
+
+			m_sleeping.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			while (not stop_request.load(std::memory_order_relaxed) and lanes_empty() and m_queue->empty())
+				idle_wait(self, lk, deadline);
+
+			m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+			if (not take_task_locked(self, task))
+			{
+				lk.unlock();
+				continue;
+			}
 
+		avail:
 			lk.unlock();
 
-			task_ptr->task_execute();
+		execute:
+			execute_task(self, task);
+		}
+	}
+
+#ifdef EXT_ENABLE_EXECUTOR_METRICS
+	inline void thread_pool::stamp_task(task_base & task) noexcept
+	{
+		task.enqueued = ext::metrics_clock::now();
+	}
+#endif
+
+	void thread_pool::execute_task(worker & self, task_base * task) noexcept
+	{
+		++self.m_dequeues;
+		ext::intrusive_ptr<task_base> task_ptr(task, ext::noaddref);
+
+		// cancelled while waiting in queue: nothing to execute, just release it
+		if (task_ptr->task_cancelled())
+		{
+		#ifdef EXT_ENABLE_EXECUTOR_METRICS
+			ext::metric_add(self.m_cancelled, 1);
+		#endif
+			return;
+		}
+
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		auto start = ext::metrics_clock::now();
+		self.m_queue_latency.record(ext::metrics_clock::elapsed(task->enqueued, start));
+
+		auto * hooks = m_hooks.load(std::memory_order_acquire);
+		if (hooks) hooks->task_begin();
+
+		task_ptr->task_execute();
+
+		if (hooks) hooks->task_end();
+		self.m_run_time.record(ext::metrics_clock::elapsed(start, ext::metrics_clock::now()));
+		ext::metric_add(self.m_executed, 1);
+	#else
+		task_ptr->task_execute();
+	#endif
+	}
+
+#ifdef EXT_ENABLE_EXECUTOR_METRICS
+	void thread_pool::retire_metrics(worker & w) noexcept
+	{
+		std::lock_guard lk(m_mutex);
+		m_retired_metrics.executed += w.m_executed.load(std::memory_order_relaxed);
+		m_retired_metrics.steals += w.m_steals.load(std::memory_order_relaxed);
+		m_retired_metrics.cancelled += w.m_cancelled.load(std::memory_order_relaxed);
+		m_retired_metrics.idle_time += std::chrono::nanoseconds(w.m_idle_ns.load(std::memory_order_relaxed));
+		m_retired_queue_latency.merge(w.m_queue_latency);
+		m_retired_run_time.merge(w.m_run_time);
+		w.m_metrics_retired = true;
+	}
+
+	auto thread_pool::metrics() const -> metrics_type
+	{
+		metrics_type result;
+		std::lock_guard lk(m_mutex);
+
+		result.retired = m_retired_metrics;
+		result.queue_latency = m_retired_queue_latency;
+		result.run_time = m_retired_run_time;
+		result.workers.reserve(m_pending);
+
+		for (std::size_t idx = 0; idx < m_workers.size(); ++idx)
+		{
+			auto & w = *m_workers[idx];
+			if (w.m_metrics_retired) continue;
+
+			worker_metrics wm;
+			wm.executed = w.m_executed.load(std::memory_order_relaxed);
+			wm.steals = w.m_steals.load(std::memory_order_relaxed);
+			wm.cancelled = w.m_cancelled.load(std::memory_order_relaxed);
+			wm.idle_time = std::chrono::nanoseconds(w.m_idle_ns.load(std::memory_order_relaxed));
+
+			result.queue_latency.merge(w.m_queue_latency);
+			result.run_time.merge(w.m_run_time);
+
+			if (idx < m_pending)
+				result.workers.push_back(wm);
+			else
+			{	// stopping, but not yet finished worker
+				result.retired.executed += wm.executed;
+				result.retired.steals += wm.steals;
+				result.retired.cancelled += wm.cancelled;
+				result.retired.idle_time += wm.idle_time;
+			}
+		}
+
+		return result;
+	}
+#endif
+
+	auto thread_pool::preferred_lane(const worker & self) const noexcept -> priority
+	{
+		if (not (m_options & weighted_priority))
+			return priority::high;
+
+		constexpr unsigned period = lane_weights[0] + lane_weights[1] + lane_weights[2];
+		unsigned slot = self.m_dequeues % period;
+
+		unsigned lane = 0;
+		while (slot >= lane_weights[lane])
+			slot -= lane_weights[lane++];
+
+		return static_cast<priority>(lane);
+	}
+
+	bool thread_pool::pop_lane_task(const worker & self, priority lane, task_base * & task) noexcept
+	{
+		switch (lane)
+		{
+			case priority::high:
+				if (m_high_tasks.empty()) return false;
+				task = &m_high_tasks.front();
+				m_high_tasks.pop_front();
+				m_high_count.store(m_high_tasks.size(), std::memory_order_relaxed);
+				return true;
+
+			case priority::low:
+				if (m_low_tasks.empty()) return false;
+				task = &m_low_tasks.front();
+				m_low_tasks.pop_front();
+				m_low_count.store(m_low_tasks.size(), std::memory_order_relaxed);
+				return true;
+
+			case priority::normal:
+			default:
+				return pop_shared_task(self, task);
+		}
+	}
+
+	bool thread_pool::pop_shared_task(const worker & self, task_base * & task) noexcept
+	{
+		auto pop = [&task](task_list_type & tasks)
+		{
+			if (tasks.empty()) return false;
+
+			task = &tasks.front();
+			tasks.pop_front();
+			return true;
+		};
+
+		if (m_nodes.empty())
+			return pop(m_tasks);
+
+		// own node first, than general shared queue, than other nodes starting with next one
+		auto count = m_nodes.size();
+		if (pop(m_nodes[self.m_node].tasks)) return true;
+		if (pop(m_tasks)) return true;
+
+		for (std::size_t idx = 1; idx < count; ++idx)
+			if (pop(m_nodes[(self.m_node + idx) % count].tasks)) return true;
+
+		return false;
+	}
+
+	auto thread_pool::submit_queue() noexcept -> task_list_type &
+	{
+		if (m_nodes.empty()) return m_tasks;
+
+		auto * self = ms_current_worker;
+		if (self and self->m_parent == this)
+			return m_nodes[self->m_node].tasks;
+
+		int cpu = ext::current_cpu();
+		if (cpu >= 0 and static_cast<unsigned>(cpu) < m_cpu_nodes.size())
+			return m_nodes[m_cpu_nodes[cpu]].tasks;
+
+		return m_tasks;
+	}
+
+	bool thread_pool::lanes_empty() const noexcept
+	{
+		if (not m_tasks.empty() or not m_high_tasks.empty() or not m_low_tasks.empty())
+			return false;
+
+		for (auto & node : m_nodes)
+			if (not node.tasks.empty()) return false;
+
+		return true;
+	}
+
+	void thread_pool::pin_worker(worker & w) noexcept
+	{
+		try
+		{
+			if (not m_affinity.empty())
+				ext::set_thread_affinity(w.m_thread, m_affinity[w.m_slot % m_affinity.size()]);
+			else if (not m_nodes.empty())
+				ext::set_thread_affinity(w.m_thread, m_nodes[w.m_node].cpus);
+		}
+		catch (std::bad_alloc &)
+		{
+			// pinning is best effort
+		}
+	}
+
+	void thread_pool::set_worker_affinity(std::vector<ext::cpu_set> sets)
+	{
+		std::lock_guard lk(m_mutex);
+		m_affinity = std::move(sets);
+
+		if (m_affinity.empty()) return;
+		for (std::size_t idx = 0; idx < m_pending; ++idx)
+			pin_worker(*m_workers[idx]);
+	}
+
+	bool thread_pool::take_task_locked(const worker & self, task_base * & task) noexcept
+	{
+		auto lane = preferred_lane(self);
+		if (pop_lane_task(self, lane, task)) return true;
+
+		for (auto other : {priority::high, priority::normal, priority::low})
+			if (other != lane and pop_lane_task(self, other, task)) return true;
+
+		return false;
+	}
+
+	bool thread_pool::take_lane_task(const worker & self, priority lane, task_base * & task) noexcept
+	{
+		auto & count = lane == priority::high ? m_high_count : m_low_count;
+		if (not count.load(std::memory_order_relaxed)) return false;
+
+		std::lock_guard lk(m_mutex);
+		return pop_lane_task(self, lane, task);
+	}
+
+	bool thread_pool::take_shared_task(const worker & self, task_base * & task) noexcept
+	{
+		std::lock_guard lk(m_mutex);
+		return pop_shared_task(self, task);
+	}
+
+	bool thread_pool::spin_for_task(const worker_deque * self, task_base * & task) noexcept
+	{
+		for (unsigned i = 0; i < spin_count; ++i)
+		{
+			cpu_relax();
+
+			if (m_queue->try_pop(task)) return true;
+			if (self and steal_task(self, task)) return true;
+		}
+
+		return false;
+	}
+
+	void thread_pool::notify_sleeping(std::size_t count) noexcept
+	{
+		// see work_stealing_thread_func
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleeping.load(std::memory_order_relaxed))
+		{
+			std::lock_guard lk(m_mutex);
+			notify_workers(count);
+		}
+	}
+
+	void thread_pool::push_task(task_base * task, priority prio) noexcept
+	{
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		stamp_task(*task);
+	#endif
+
+		if (prio != priority::normal)
+		{
+			{
+				std::lock_guard lk(m_mutex);
+				if (prio == priority::high)
+					m_high_tasks.push_back(*task), m_high_count.store(m_high_tasks.size(), std::memory_order_relaxed);
+				else
+					m_low_tasks.push_back(*task), m_low_count.store(m_low_tasks.size(), std::memory_order_relaxed);
+			}
+
+			return m_event.notify_one();
+		}
+
+		auto * self = ms_current_worker;
+		if (self and self->m_parent == this and self->m_deque)
+		{
+			try
+			{
+				self->m_deque->push(task);
+				return notify_sleeping(1);
+			}
+			catch (std::bad_alloc &)
+			{
+				// failed to grow deque, fallback to shared queue
+			}
+		}
+
+		if (m_queue and m_queue->try_push(task))
+			return notify_sleeping(1);
+
+		{
+			std::lock_guard lk(m_mutex);
+			submit_queue().push_back(*task);
+		}
+
+		m_event.notify_one();
+	}
+
+	void thread_pool::push_tasks(task_list_type & tasks, std::size_t count, priority prio) noexcept
+	{
+		if (tasks.empty()) return;
+
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		auto now = ext::metrics_clock::now();
+		for (auto & task : tasks) task.enqueued = now;
+	#endif
+
+		if (prio != priority::normal)
+		{
+			std::lock_guard lk(m_mutex);
+			if (prio == priority::high)
+				m_high_tasks.splice(m_high_tasks.end(), tasks), m_high_count.store(m_high_tasks.size(), std::memory_order_relaxed);
+			else
+				m_low_tasks.splice(m_low_tasks.end(), tasks), m_low_count.store(m_low_tasks.size(), std::memory_order_relaxed);
+
+			return notify_workers(count);
+		}
+
+		auto * self = ms_current_worker;
+		if (self and self->m_parent == this and self->m_deque)
+		{
+			// task must be unlinked before push: thief can execute and release it right away
+			while (not tasks.empty())
+			{
+				auto & task = tasks.front();
+				tasks.pop_front();
+
+				try
+				{
+					self->m_deque->push(&task);
+				}
+				catch (std::bad_alloc &)
+				{
+					// failed to grow deque, put rest into shared queue
+					tasks.push_front(task);
+					break;
+				}
+			}
+
+			if (tasks.empty())
+				return notify_sleeping(count);
+		}
+
+		if (m_queue)
+		{
+			while (not tasks.empty())
+			{
+				auto & task = tasks.front();
+				tasks.pop_front();
+
+				if (not m_queue->try_push(&task))
+				{
+					tasks.push_front(task);
+					break;
+				}
+			}
+
+			// lock-free queue is full, put rest into shared queue
+			if (tasks.empty())
+				return notify_sleeping(count);
+		}
+
+		std::lock_guard lk(m_mutex);
+		auto & queue = submit_queue();
+		queue.splice(queue.end(), tasks);
+		notify_workers(count);
+	}
+
+	void thread_pool::notify_workers(std::size_t count) noexcept
+	{
+		std::size_t sleeping = m_sleeping.load(std::memory_order_relaxed);
+		if (count >= sleeping)
+			return m_event.notify_all();
+
+		while (count--)
+			m_event.notify_one();
+	}
+
+	void thread_pool::abandon_tasks(task_list_type & tasks) noexcept
+	{
+		tasks.clear_and_dispose([](task_base * task)
+		{
+			task->task_abandone();
+			task->task_release();
+		});
+	}
+
+	auto thread_pool::acquire_deque() -> worker_deque *
+	{
+		auto * self = ms_current_worker;
+		std::lock_guard lk(m_mutex);
+
+		auto * head = m_deques.load(std::memory_order_relaxed);
+		for (auto * deque = head; deque; deque = deque->m_next)
+		{
+			if (deque->m_owned) continue;
+
+			deque->m_owned = true;
+			return self->m_deque = deque;
+		}
+
+		auto * deque = new worker_deque;
+		deque->m_owned = true;
+		deque->m_next = head;
+		m_deques.store(deque, std::memory_order_release);
+
+		return self->m_deque = deque;
+	}
+
+	void thread_pool::release_deque(worker_deque * deque) noexcept
+	{
+		// move not executed tasks into shared queue, so released deque is always empty
+		bool notify = false;
+		task_base * task;
+
+		std::lock_guard lk(m_mutex);
+		ms_current_worker->m_deque = nullptr;
+		deque->m_owned = false;
+
+		while (deque->pop(task))
+			m_tasks.push_back(*task), notify = true;
+
+		if (notify) m_event.notify_all();
+	}
+
+	bool thread_pool::steal_task(const worker_deque * self, task_base * & task) noexcept
+	{
+		// start with deque following ours, and wrap around
+		auto * head = m_deques.load(std::memory_order_acquire);
+		auto * first = self->m_next ? self->m_next : head;
+
+		auto * deque = first;
+		do {
+			if (deque != self and deque->steal(task))
+				return true;
+
+			deque = deque->m_next ? deque->m_next : head;
+		} while (deque != first);
+
+		return false;
+	}
+
+	bool thread_pool::has_stealable_tasks() const noexcept
+	{
+		auto * head = m_deques.load(std::memory_order_acquire);
+		for (auto * deque = head; deque; deque = deque->m_next)
+			if (not deque->empty()) return true;
+
+		return false;
+	}
+
+	void thread_pool::clear_deques() noexcept
+	{
+		auto * head = m_deques.load(std::memory_order_acquire);
+		for (auto * deque = head; deque; deque = deque->m_next)
+		{
+			task_base * task;
+			while (not deque->empty())
+			{
+				// steal can lose a race with owner, just retry
+				if (not deque->steal(task)) continue;
+
+				task->task_abandone();
+				task->task_release();
+			}
 		}
 	}
 
@@ -162,31 +894,72 @@ namespace ext
 			assert(m_delayed_count == 0);
 			for (auto it = m_delayed.begin(); it != m_delayed.end();)
 			{
-				if (not it->mark_marked())
+				if (not it->take())
 					++m_delayed_count, ++it;
 				else
 				{
 					auto & item = *it;
 					it = m_delayed.erase(it);
-					item.abandone();
-					item.release();
+					item.task_abandone();
+					item.task_release();
 				}
 			}
 
 			// wait until all delayed_tasks are finished, and take pending tasks
 			m_event.wait(lk, [this] { return m_delayed_count == 0; });
 			tasks.swap(m_tasks);
+			tasks.splice(tasks.end(), m_high_tasks);
+			tasks.splice(tasks.end(), m_low_tasks);
+			for (auto & node : m_nodes)
+				tasks.splice(tasks.end(), node.tasks);
+			m_high_count.store(0, std::memory_order_relaxed);
+			m_low_count.store(0, std::memory_order_relaxed);
 		}
 		
-		tasks.clear_and_dispose([](task_base * task)
+		abandon_tasks(tasks);
+
+		if (m_queue)
 		{
-			task->task_abandone();
-			task->task_release();
-		});
+			task_base * task;
+			while (m_queue->try_pop(task))
+			{
+				task->task_abandone();
+				task->task_release();
+			}
+		}
+
+		clear_deques();
 	}
 
-	thread_pool::thread_pool(unsigned nworkers)
+	thread_pool::thread_pool(unsigned nworkers, unsigned opts)
+		: m_options(opts)
 	{
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		// calibrate now, not on first task
+		ext::metrics_clock::tick_period();
+	#endif
+
+		if (m_options & lockfree_queue)
+			m_queue = std::make_unique<ext::mpmc_queue<task_base *>>(lockfree_queue_capacity);
+
+		if (m_options & numa_aware)
+		{
+			auto nodes = ext::numa_nodes();
+			m_nodes.resize(nodes.size());
+
+			for (unsigned node = 0; node < nodes.size(); ++node)
+			{
+				for (unsigned cpu : nodes[node])
+				{
+					if (cpu >= m_cpu_nodes.size()) m_cpu_nodes.resize(cpu + 1);
+					m_cpu_nodes[cpu] = node;
+				}
+
+				m_nodes[node].cpus = std::move(nodes[node]);
+			}
+		}
+
+
 		set_nworkers(nworkers);
 	}
 
@@ -194,12 +967,15 @@ namespace ext
 	{
 		// First we should signal threads to stop.
 		// If this object is destroyed nobody should be invoking any methods of this class
-		// (with exception our internal classes, like delayed_task_continuation, worker).
+		// (with exception our internal classes, like delayed_task_base, worker).
 		// but those do not access m_workers, so accessing m_workers should be safe without locking mutex.
 		// We still need to enforce memory ordering through, for now do it via locking mutex
 		//
 		// TODO: can std::atomic_memory_fence(std::memory_order_acquire/std::memory_order_seq_cst) used?
 
+		// supervisor must not create workers while we are stopping them
+		disable_autoscale();
+
 		decltype (m_workers) workers;
 		{
 			std::lock_guard lk(m_mutex);
@@ -222,5 +998,12 @@ namespace ext
 			worker_ptr->wait();
 			worker_ptr->m_thread.join();
 		}
+
+		// stopped workers could submit new tasks while executing last ones,
+		// and in work_stealing mode they move not executed tasks into shared queue - abandon those too
+		clear();
+
+		for (auto * deque = m_deques.load(std::memory_order_relaxed); deque;)
+			delete std::exchange(deque, deque->m_next);
 	}
 }
@@ -1,3 +1,5 @@
+#include <cassert>
+#include <algorithm>
 #include <ext/threaded_scheduler.hpp>
 
 namespace ext
@@ -15,38 +17,372 @@ namespace ext
 		};
 	}
 
-	bool threaded_scheduler::entry_comparer::operator()(const task_ptr & t1, const task_ptr & t2) const noexcept
+	/************************************************************************/
+	/*                 threaded_scheduler::wheel_type                       */
+	/************************************************************************/
+	auto threaded_scheduler::wheel_type::due_tick(time_point tp) const noexcept -> tick_type
 	{
-		// priority_queue with std::less provides constant lookup for greatest element, we need smallest
-		return t1->point > t2->point;
+		if (tp <= m_origin) return 0;
+		
+		// round up - task must not be executed earlier than it's time point
+		auto elapsed = tp - m_origin;
+		auto ticks = elapsed / m_resolution + (elapsed % m_resolution != duration::zero());
+		return static_cast<tick_type>(ticks);
+	}
+
+	void threaded_scheduler::wheel_type::place(task_base & task) noexcept
+	{
+		auto tick = std::max(due_tick(task.point), m_current);
+
+		for (unsigned level = 0; level < levels; ++level)
+		{
+			auto upper_shift = (level + 1) * level_bits;
+			if (tick >> upper_shift != m_current >> upper_shift) continue;
+
+			auto idx = (tick >> (level * level_bits)) & slot_mask;
+			m_slots[level][idx].push_back(task);
+			return;
+		}
+
+		m_overflow.push_back(task);
+	}
+
+	void threaded_scheduler::wheel_type::cascade() noexcept
+	{
+		// find highest level, which boundary current tick is on
+		unsigned level = 0;
+		while (level < levels and (m_current & ((tick_type(1) << ((level + 1) * level_bits)) - 1)) == 0)
+			++level;
+
+		task_list_type tasks;
+		if (level == levels)
+			tasks.splice(tasks.end(), m_overflow);
+
+		// redistribute from top to bottom, redistributed tasks go only to lower levels
+		for (unsigned l = std::min(level, levels - 1); l > 0; --l)
+			tasks.splice(tasks.end(), m_slots[l][(m_current >> (l * level_bits)) & slot_mask]);
+
+		tasks.clear_and_dispose([this](task_base * task) { place(*task); });
 	}
 
+	auto threaded_scheduler::wheel_type::next_tick() const noexcept -> tick_type
+	{
+		// On level l only slots after current can be non empty, level 0 - including current.
+		// Tasks on lower levels are always earlier than on upper ones,
+		// for upper levels - start of slot is returned, where tasks will be redistributed.
+		for (unsigned level = 0; level < levels; ++level)
+		{
+			auto shift = level * level_bits;
+			auto idx = (m_current >> shift) & slot_mask;
+			if (level != 0) ++idx;
+
+			for (; idx < slot_count; ++idx)
+			{
+				if (m_slots[level][idx].empty()) continue;
+
+				auto upper_shift = shift + level_bits;
+				return (m_current >> upper_shift << upper_shift) | (idx << shift);
+			}
+		}
+
+		if (m_overflow.empty()) return no_tick;
+
+		auto top_shift = levels * level_bits;
+		return ((m_current >> top_shift) + 1) << top_shift;
+	}
+
+	void threaded_scheduler::wheel_type::insert(task_base * task) noexcept
+	{
+		place(*task);
+	}
+
+	void threaded_scheduler::wheel_type::advance(time_point now, task_list_type & expired) noexcept
+	{
+		if (now < m_origin) return;
+		auto target = static_cast<tick_type>((now - m_origin) / m_resolution);
+
+		while (m_current <= target)
+		{
+			expired.splice(expired.end(), m_slots[0][m_current & slot_mask]);
+
+			// jump over empty ticks straight to next expiration or redistribution.
+			// Skipped upper level boundaries have empty slots, so redistribution is only needed on landing tick
+			m_current = std::min(next_tick(), target + 1);
+			cascade();
+		}
+	}
+
+	auto threaded_scheduler::wheel_type::next_expiry() const noexcept -> time_point
+	{
+		auto tick = next_tick();
+		if (tick == no_tick) return time_point::max();
+
+		return m_origin + m_resolution * static_cast<duration::rep>(tick);
+	}
+
+	void threaded_scheduler::wheel_type::take_all(task_list_type & tasks) noexcept
+	{
+		for (auto & level : m_slots)
+			for (auto & slot : level)
+				tasks.splice(tasks.end(), slot);
+
+		tasks.splice(tasks.end(), m_overflow);
+	}
+
+	threaded_scheduler::wheel_type::wheel_type(duration resolution)
+		: m_origin(time_point::clock::now()), m_resolution(resolution)
+	{
+		assert(resolution > duration::zero());
+	}
+
+	/************************************************************************/
+	/*                 threaded_scheduler                                   */
+	/************************************************************************/
 	template <class Lock>
 	inline auto threaded_scheduler::next_in(Lock & lk) const noexcept -> time_point
 	{
-		return m_queue.empty() ? max_timepoint() : m_queue.top()->point;
+		if (m_wheel) return std::min(m_wheel->next_expiry(), max_timepoint());
+		return m_heap.empty() ? max_timepoint() : m_heap.front()->point;
 	}
 
-	void threaded_scheduler::run_passed_events()
+	void threaded_scheduler::heap_push(task_base * task)
 	{
-		auto now = time_point::clock::now();
-		task_ptr item;
+		m_heap.push_back(task);
+		task->heap_index = m_heap.size() - 1;
+		heap_sift_up(task->heap_index);
+	}
+
+	void threaded_scheduler::heap_erase(std::size_t index) noexcept
+	{
+		auto * last = m_heap.back();
+		m_heap.pop_back();
+		if (index == m_heap.size()) return;
+
+		// put last element in place of removed one and restore heap property in whichever direction is needed
+		heap_set(index, last);
+		heap_sift_up(index);
+		heap_sift_down(last->heap_index);
+	}
+
+	void threaded_scheduler::heap_sift_up(std::size_t index) noexcept
+	{
+		auto * task = m_heap[index];
+		while (index > 0)
+		{
+			auto parent = (index - 1) / 2;
+			if (not (task->point < m_heap[parent]->point)) break;
+
+			heap_set(index, m_heap[parent]);
+			index = parent;
+		}
+
+		heap_set(index, task);
+	}
+
+	void threaded_scheduler::heap_sift_down(std::size_t index) noexcept
+	{
+		auto * task = m_heap[index];
+		auto size = m_heap.size();
 
 		for (;;)
 		{
+			auto child = 2 * index + 1;
+			if (child >= size) break;
+			if (child + 1 < size and m_heap[child + 1]->point < m_heap[child]->point) ++child;
+			if (not (m_heap[child]->point < task->point)) break;
+
+			heap_set(index, m_heap[child]);
+			index = child;
+		}
+
+		heap_set(index, task);
+	}
+
+	std::uintptr_t threaded_scheduler::lock_owner(task_base * task) noexcept
+	{
+		// lock is held only for short periods, without blocking, so spin
+		auto owner = task->owner.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			if (owner & 1)
 			{
-				std::lock_guard lk(m_mutex);
-				if (m_queue.empty()) return;
-
-				auto & top = m_queue.top();
-				if (now < top->point) break;
-			
-				item = std::move(top);
-				m_queue.pop();
+				std::this_thread::yield();
+				owner = task->owner.load(std::memory_order_relaxed);
+				continue;
 			}
-		
+
+			if (task->owner.compare_exchange_weak(owner, owner | 1, std::memory_order_acquire, std::memory_order_relaxed))
+				return owner;
+		}
+	}
+
+	bool threaded_scheduler::attach_task(task_base * task) noexcept
+	{
+		lock_owner(task);
+
+		// cancel could happen before we set owner, in that case task must not be placed.
+		// Cancellation state is set before remove_task locks owner, so under lock we see it
+		if (task->task_cancelled())
+		{
+			task->owner.store(0, std::memory_order_release);
+			return false;
+		}
+
+		task->owner.store(reinterpret_cast<std::uintptr_t>(this), std::memory_order_release);
+		return true;
+	}
+
+	void threaded_scheduler::detach_task(task_base * task) noexcept
+	{
+		lock_owner(task);
+		task->owner.store(0, std::memory_order_release);
+	}
+
+	void threaded_scheduler::remove_task(task_base * task) noexcept
+	{
+		// Lock order is m_mutex -> task owner lock: scheduler detaches tasks under m_mutex.
+		// Here we go in reverse order, so m_mutex is only tried, on failure owner lock is released and we retry.
+		// While owner lock is held - scheduler can't detach task, and so can't be destroyed, because it detaches all tasks on destruction.
+		for (;;)
+		{
+			auto owner = lock_owner(task);
+			auto * self = reinterpret_cast<threaded_scheduler *>(owner);
+
+			if (not self)
+			{
+				task->owner.store(0, std::memory_order_release);
+				return;
+			}
+
+			std::unique_lock lk(self->m_mutex, std::try_to_lock);
+			if (not lk.owns_lock())
+			{
+				task->owner.store(owner, std::memory_order_release);
+				std::this_thread::yield();
+				continue;
+			}
+
+			if (self->m_wheel)
+				task->unlink();
+			else
+				self->heap_erase(task->heap_index);
+
+			task->owner.store(0, std::memory_order_release);
+			lk.unlock();
+
+			// scheduler held a reference, caller holds another one, so this never destroys task
+			task->task_release();
+			return;
+		}
+	}
+
+	void threaded_scheduler::take_all(task_list_type & tasks) noexcept
+	{
+		for (auto * task : m_heap)
+			tasks.push_back(*task);
+
+		m_heap.clear();
+		if (m_wheel) m_wheel->take_all(tasks);
+
+		for (auto & task : tasks)
+			detach_task(&task);
+	}
+
+	void threaded_scheduler::execute_tasks(task_list_type & tasks) noexcept
+	{
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		auto * hooks = m_hooks.load(std::memory_order_acquire);
+		tasks.clear_and_dispose([this, hooks](task_base * task)
+		{
+			task_ptr item(task, ext::noaddref);
+
+			auto start = time_point::clock::now();
+			m_lateness.record(start - item->point);
+			if (hooks) hooks->task_begin();
+
 			item->task_execute();
+
+			if (hooks) hooks->task_end();
+			m_run_time.record(time_point::clock::now() - start);
+			ext::metric_add(m_executed, 1);
+		});
+	#else
+		tasks.clear_and_dispose([](task_base * task)
+		{
+			task_ptr item(task, ext::noaddref);
+			item->task_execute();
+		});
+	#endif
+	}
+
+#ifdef EXT_ENABLE_EXECUTOR_METRICS
+	auto threaded_scheduler::metrics() const -> metrics_type
+	{
+		metrics_type result;
+		result.executed = m_executed.load(std::memory_order_relaxed);
+		result.lateness = m_lateness;
+		result.run_time = m_run_time;
+		return result;
+	}
+#endif
+
+	void threaded_scheduler::abandon_tasks(task_list_type & tasks) noexcept
+	{
+		tasks.clear_and_dispose([](task_base * task)
+		{
+			task->task_abandone();
+			task->task_release();
+		});
+	}
+
+	void threaded_scheduler::push_task(task_ptr task)
+	{
+		{
+			std::lock_guard lk(m_mutex);
+			if (m_wheel)
+			{
+				if (not attach_task(task.get())) return;
+				m_wheel->insert(task.release());
+			}
+			else
+			{
+				// reserve first, so heap_push does not throw after task is attached
+				m_heap.reserve(m_heap.size() + 1);
+				if (not attach_task(task.get())) return;
+				heap_push(task.release());
+			}
+		}
+
+		m_newdata.notify_one();
+	}
+
+	void threaded_scheduler::run_passed_events()
+	{
+		auto now = time_point::clock::now();
+		task_list_type expired;
+
+		if (m_wheel)
+		{
+			// all expired tasks are taken at once
+			std::lock_guard lk(m_mutex);
+			m_wheel->advance(now, expired);
+
+			for (auto & task : expired)
+				detach_task(&task);
 		}
+		else
+		{
+			std::lock_guard lk(m_mutex);
+			while (not m_heap.empty() and not (now < m_heap.front()->point))
+			{
+				auto * task = m_heap.front();
+				heap_erase(0);
+				detach_task(task);
+				expired.push_back(*task);
+			}
+		}
+
+		execute_tasks(expired);
 	}
 
 	void threaded_scheduler::thread_func()
@@ -65,39 +401,35 @@ namespace ext
 
 	void threaded_scheduler::clear() noexcept
 	{
-		queue_type queue;
+		task_list_type tasks;
 		{
 			std::lock_guard lk(m_mutex);
-			queue = std::move(m_queue);
-		}
-
-		while (!queue.empty())
-		{
-			queue.top()->task_abandone();
-			queue.pop();
+			take_all(tasks);
 		}
 
+		abandon_tasks(tasks);
 		m_newdata.notify_one();
 	}
 
-	threaded_scheduler::threaded_scheduler()
+	threaded_scheduler::threaded_scheduler(unsigned opts, duration resolution)
 	{
+		if (opts & timing_wheel)
+			m_wheel = std::make_unique<wheel_type>(resolution);
+
 		m_thread = std::thread(&threaded_scheduler::thread_func, this);
 	}
 
 	threaded_scheduler::~threaded_scheduler() noexcept
 	{
+		task_list_type tasks;
 		{
 			std::lock_guard lk(m_mutex);
 			m_stopped = true;
-			
-			while (!m_queue.empty())
-			{
-				m_queue.top()->task_abandone();
-				m_queue.pop();
-			}
+			take_all(tasks);
 		}
 		
+		abandon_tasks(tasks);
+
 		m_newdata.notify_one();
 		m_thread.join();
 	}
@@ -0,0 +1,99 @@
+#include <ext/config.hpp>
+
+#if EXT_HAS_COROUTINES
+#include <thread>
+#include <stdexcept>
+#include <ext/future.hpp>
+#include <ext/future_coroutine.hpp>
+#include <ext/thread_pool.hpp>
+#include <boost/test/unit_test.hpp>
+
+struct future_coroutine_fixture
+{
+	future_coroutine_fixture()  { ext::init_future_library(); }
+	~future_coroutine_fixture() { ext::free_future_library(); }
+};
+
+namespace
+{
+	ext::task<int> add_one(ext::future<int> f)
+	{
+		int val = co_await std::move(f);
+		co_return val + 1;
+	}
+
+	ext::task<int> sum_twice(ext::shared_future<int> f)
+	{
+		int first = co_await f;
+		int second = co_await f;
+		co_return first + second;
+	}
+
+	ext::task<void> rethrow(ext::future<int> f)
+	{
+		co_await f;
+	}
+
+	ext::task<long long> pool_chain(ext::thread_pool & pool, int count)
+	{
+		long long sum = 0;
+		for (int i = 0; i < count; ++i)
+			sum += co_await pool.submit([i] { return i; });
+
+		co_return sum;
+	}
+}
+
+BOOST_FIXTURE_TEST_SUITE(future_coroutine_tests, future_coroutine_fixture)
+
+BOOST_AUTO_TEST_CASE(future_coroutine_simple_test)
+{
+	// ready future - no suspension
+	auto fready = add_one(ext::make_ready_future(1));
+	BOOST_CHECK(fready.is_ready());
+	BOOST_CHECK_EQUAL(fready.get(), 2);
+
+	// resumed by thread fulfilling promise
+	ext::promise<int> p;
+	ext::future<int> f = add_one(p.get_future());
+	BOOST_CHECK(not f.is_ready());
+
+	std::thread thr([&p] { p.set_value(10); });
+	BOOST_CHECK_EQUAL(f.get(), 11);
+	thr.join();
+
+	// shared_future can be awaited several times
+	ext::promise<int> sp;
+	auto fsum = sum_twice(sp.get_future().share());
+	sp.set_value(5);
+	BOOST_CHECK_EQUAL(fsum.get(), 10);
+
+	// deferred future is evaluated by awaiting coroutine
+	auto fdeferred = add_one(ext::async(ext::launch::deferred, [] { return 20; }));
+	BOOST_CHECK_EQUAL(fdeferred.get(), 21);
+}
+
+BOOST_AUTO_TEST_CASE(future_coroutine_exception_test)
+{
+	auto fex = rethrow(ext::make_exceptional_future<int>(std::runtime_error("test")));
+	BOOST_CHECK_THROW(fex.get(), std::runtime_error);
+
+	ext::future<void> fabandoned;
+	{
+		ext::promise<int> p;
+		fabandoned = rethrow(p.get_future());
+	}
+
+	BOOST_CHECK_THROW(fabandoned.get(), ext::future_error);
+}
+
+BOOST_AUTO_TEST_CASE(future_coroutine_thread_pool_test)
+{
+	ext::thread_pool pool(4);
+	auto f = pool_chain(pool, 1000);
+	BOOST_CHECK_EQUAL(f.get(), 999 * 1000 / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // EXT_HAS_COROUTINES
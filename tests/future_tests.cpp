@@ -1,4 +1,8 @@
 ﻿#include <future>
+#include <array>
+#include <thread>
+#include <vector>
+#include <atomic>
 #include <ext/future.hpp>
 #include <ext/thread_pool.hpp>
 #include <ext/threaded_scheduler.hpp>
@@ -140,6 +144,73 @@ BOOST_AUTO_TEST_CASE(future_when_all_tests)
 	}
 }
 
+BOOST_AUTO_TEST_CASE(future_when_all_array_tests)
+{
+	{
+		std::array<ext::promise<int>, 8> promises;
+		std::array<ext::future<int>, 8> futures;
+		for (unsigned i = 0; i < 8; ++i)
+			futures[i] = promises[i].get_future();
+
+		// mix of ready and pending inputs
+		promises[3].set_value(3);
+		auto fres = ext::when_all(std::move(futures));
+		BOOST_CHECK(fres.is_pending());
+
+		for (unsigned i = 0; i < 8; ++i)
+			if (i != 3) promises[i].set_value(i);
+
+		BOOST_REQUIRE(fres.is_ready());
+		auto res = fres.get();
+		for (unsigned i = 0; i < 8; ++i)
+			BOOST_CHECK_EQUAL(res[i].get(), i);
+	}
+
+	{	// result future released before inputs are satisfied
+		std::array<ext::promise<int>, 2> promises;
+		std::array<ext::future<int>, 2> futures = {promises[0].get_future(), promises[1].get_future()};
+		ext::when_all(std::move(futures));
+
+		promises[0].set_value(1);
+		promises[1].set_value(2);
+	}
+
+	{
+		auto fres = ext::when_all(std::array<ext::future<int>, 0> {});
+		BOOST_CHECK(fres.is_ready());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(future_when_each_tests)
+{
+	std::vector<ext::promise<int>> promises(4);
+	std::vector<ext::future<int>> futures;
+	for (auto & p : promises)
+		futures.push_back(p.get_future());
+
+	std::vector<std::size_t> order;
+	int sum = 0;
+	auto fres = ext::when_each(std::make_move_iterator(futures.begin()), std::make_move_iterator(futures.end()), [&](std::size_t index, ext::future<int> f)
+	{
+		order.push_back(index);
+		sum += f.get();
+	});
+
+	// results are delivered as they complete, without waiting for slowest
+	promises[2].set_value(2);
+	promises[0].set_value(0);
+	BOOST_CHECK((order == std::vector<std::size_t> {2, 0}));
+	BOOST_CHECK(fres.is_pending());
+
+	promises[3].set_value(3);
+	promises[1].set_exception(std::make_exception_ptr(std::runtime_error("fail")));
+	BOOST_REQUIRE(fres.is_ready());
+	BOOST_CHECK((order == std::vector<std::size_t> {2, 0, 3, 1}));
+	BOOST_CHECK_EQUAL(sum, 5);
+	// exception thrown by functor from f.get() is stored into result
+	BOOST_CHECK_THROW(fres.get(), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_CASE(future_when_any_tests)
 {
 	using namespace std;
@@ -361,4 +432,263 @@ BOOST_AUTO_TEST_CASE(thread_pool_tests)
 	BOOST_CHECK_EQUAL(result, 122);
 }
 
+BOOST_AUTO_TEST_CASE(adaptive_waiter_tests)
+{
+	using namespace std::chrono_literals;
+
+	for (unsigned slots : {0u, 16u})
+	{
+		ext::free_future_library();
+		BOOST_REQUIRE(ext::init_future_library(slots, ext::adaptive_continuation_waiter::default_spin_count));
+
+		{
+			ext::thread_pool pool(2);
+
+			// completes while spinning, and after blocking
+			for (auto delay : {0ms, 20ms})
+			{
+				std::vector<ext::future<int>> futures;
+				for (int i = 0; i < 100; ++i)
+					futures.push_back(pool.submit([delay, i] { std::this_thread::sleep_for(delay / 100); return i; }));
+
+				int sum = 0;
+				for (auto & f : futures) sum += f.get();
+				BOOST_CHECK_EQUAL(sum, 4950);
+			}
+
+			// several threads waiting on same shared_future
+			ext::promise<int> promise;
+			ext::shared_future<int> sf = promise.get_future();
+			std::vector<ext::future<int>> waiters;
+			for (int i = 0; i < 2; ++i)
+				waiters.push_back(ext::async(ext::launch::async, [sf]() mutable { return sf.get(); }));
+
+			BOOST_CHECK(sf.wait_for(1ms) == ext::future_status::timeout);
+			std::this_thread::sleep_for(10ms);
+			promise.set_value(12);
+			for (auto & f : waiters) BOOST_CHECK_EQUAL(f.get(), 12);
+		}
+	}
+
+	ext::free_future_library();
+	ext::init_future_library();
+}
+
+BOOST_AUTO_TEST_CASE(thread_cached_waiters_pool_tests)
+{
+	ext::free_future_library();
+	BOOST_REQUIRE(ext::init_future_library(ext::make_thread_cached_waiters_pool(16)));
+
+	{
+		ext::thread_pool pool(2);
+		std::atomic_int sum = 0;
+
+		// more waiting threads and waits than thread caches and arena can hold
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; ++t)
+		{
+			threads.emplace_back([&pool, &sum]
+			{
+				for (int i = 0; i < 200; ++i)
+				{
+					std::vector<ext::future<int>> futures;
+					for (int k = 0; k < 20; ++k)
+						futures.push_back(pool.submit([k] { return k; }));
+
+					for (auto & f : futures) sum += f.get();
+				}
+			});
+		}
+
+		for (auto & thr : threads) thr.join();
+		BOOST_CHECK_EQUAL(sum.load(), 4 * 200 * 190);
+	}
+
+	// all waiters are returned, even ones cached by exited threads, so pool can be replaced
+	BOOST_CHECK(ext::init_future_library());
+}
+
+BOOST_AUTO_TEST_CASE(future_concurrent_continuations_tests)
+{
+	using namespace std::chrono_literals;
+	constexpr int nthreads = 8, count = 200;
+
+	for (int round = 0; round < 20; ++round)
+	{
+		ext::promise<int> promise;
+		ext::shared_future<int> sf = promise.get_future();
+		std::atomic_int executed = 0, waited = 0;
+
+		// threads concurrently attach continuations and wait, while future becomes ready
+		std::vector<std::thread> threads;
+		for (int t = 0; t < nthreads; ++t)
+		{
+			threads.emplace_back([sf, &executed, &waited, t]() mutable
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					sf.then([&executed](auto f) { executed += f.get(); });
+					if (i % 16 == t % 16 and sf.wait_for(0ms) == ext::future_status::ready)
+						++waited;
+				}
+
+				sf.wait();
+				++waited;
+			});
+		}
+
+		std::this_thread::yield();
+		promise.set_value(1);
+
+		for (auto & thr : threads) thr.join();
+		BOOST_CHECK_EQUAL(executed.load(), nthreads * count);
+		BOOST_CHECK_GE(waited.load(), nthreads);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(future_cancellation_propagation_tests)
+{
+	// cancelling tail of then chain cancels whole chain: each continuation is only consumer of it's parent
+	{
+		ext::promise<int> p;
+		auto tail = p.get_future().then([](auto f) { return f.get(); }).then([](auto f) { return f.get(); });
+		BOOST_CHECK(tail.cancel());
+		BOOST_CHECK(p.is_cancelled());
+	}
+
+	// shared future can have other consumers - it's not cancelled
+	{
+		ext::promise<int> p;
+		ext::shared_future<int> sf = p.get_future();
+		auto cont = sf.then([](auto f) { return f.get(); });
+		BOOST_CHECK(cont.cancel());
+		BOOST_CHECK(not p.is_cancelled());
+	}
+
+	// when_all cancels it's inputs, except shared ones
+	{
+		ext::promise<int> p1, p2;
+		ext::shared_future<int> sf = p2.get_future();
+		auto all = ext::when_all(p1.get_future(), sf);
+		BOOST_CHECK(all.cancel());
+		BOOST_CHECK(p1.is_cancelled());
+		BOOST_CHECK(not p2.is_cancelled());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(cancellation_token_tests)
+{
+	// cancellation propagates to every tied future of chain, upstream and downstream
+	{
+		ext::cancellation_source source;
+		auto token = source.token();
+		BOOST_CHECK(token.can_be_cancelled());
+		BOOST_CHECK(not token.is_cancellation_requested());
+
+		ext::promise<int> p1, p2;
+		auto f1 = ext::with_cancellation(p1.get_future(), token);
+		auto f2 = ext::with_cancellation(p2.get_future(), token);
+
+		// derived futures inherit token and are cancelled first, so continuation is never run
+		int executed = 0;
+		auto chain = f1.then([&executed](auto f) { ++executed; return f.get(); });
+		auto all = ext::when_all(std::move(chain), std::move(f2));
+
+		int called = 0;
+		token.on_cancellation([&called] { ++called; });
+
+		BOOST_CHECK(source.request_cancellation());
+		BOOST_CHECK(not source.request_cancellation());
+		BOOST_CHECK(token.is_cancellation_requested());
+		BOOST_CHECK_EQUAL(called, 1);
+
+		BOOST_CHECK(p1.is_cancelled());
+		BOOST_CHECK(p2.is_cancelled());
+		BOOST_CHECK(all.is_cancelled());
+		BOOST_CHECK_EQUAL(executed, 0);
+
+		// already cancelled token runs callback immediately
+		token.on_cancellation([&called] { ++called; });
+		BOOST_CHECK_EQUAL(called, 2);
+	}
+
+	// destroyed source releases callbacks without calling them
+	{
+		auto guard = std::make_shared<int>(0);
+		bool called = false;
+		ext::cancellation_token token;
+		BOOST_CHECK(not token.can_be_cancelled());
+
+		{
+			ext::cancellation_source source;
+			token = source.token();
+			token.on_cancellation([guard, &called] { called = true; });
+			BOOST_CHECK_EQUAL(guard.use_count(), 2);
+		}
+
+		BOOST_CHECK_EQUAL(guard.use_count(), 1);
+		BOOST_CHECK(not called);
+		BOOST_CHECK(not token.is_cancellation_requested());
+	}
+
+	// ready future is not affected
+	{
+		ext::cancellation_source source;
+		auto f = ext::with_cancellation(ext::make_ready_future(1), source.token());
+		source.request_cancellation();
+		BOOST_CHECK_EQUAL(f.get(), 1);
+	}
+
+	// ties of ready futures are released, so long-lived source does not accumulate them
+	{
+		ext::cancellation_source source;
+		auto token = source.token();
+		for (int i = 0; i < 10000; ++i)
+		{
+			ext::promise<int> p;
+			auto f = ext::with_cancellation(p.get_future(), token);
+			p.set_value(i);
+		}
+
+		// every tie still attached to source holds reference to it's state
+		BOOST_CHECK_LT(token.handle()->use_count(), 100u);
+	}
+}
+
+// microbenchmark, run explicitly with --run_test=future_tests/future_attach_contention_benchmark --log_level=message
+BOOST_AUTO_TEST_CASE(future_attach_contention_benchmark, *boost::unit_test::disabled())
+{
+	using namespace std::chrono;
+	constexpr unsigned count = 100000;
+
+	for (unsigned nthreads : {1u, 2u, 4u, 8u, 16u})
+	{
+		ext::promise<void> promise;
+		ext::shared_future<void> sf = promise.get_future();
+		std::atomic_uint executed = 0;
+
+		std::vector<ext::future<void>> results[16];
+		for (unsigned t = 0; t < nthreads; ++t)
+			results[t].reserve(count);
+
+		auto start = steady_clock::now();
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < nthreads; ++t)
+		{
+			threads.emplace_back([&sf, &executed, &result = results[t]]
+			{
+				for (unsigned i = 0; i < count; ++i)
+					result.push_back(sf.then([&executed](auto) { executed.fetch_add(1, std::memory_order_relaxed); }));
+			});
+		}
+
+		for (auto & thr : threads) thr.join();
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / (count * nthreads);
+
+		promise.set_value();
+		BOOST_CHECK_EQUAL(executed.load(), count * nthreads);
+		BOOST_TEST_MESSAGE("shared_future::then, " << nthreads << " threads: " << ns << " ns/attach");
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,9 +1,23 @@
+#include <cstdint>
 #include <string>
 #include <map>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include <random>
+#include <cmath>
 #include <ext/lrucache.hpp>
+#include <ext/concurrent_lru_cache.hpp>
+#include <ext/flat_lru_cache.hpp>
 
 #include <boost/test/unit_test.hpp>
 
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
 BOOST_AUTO_TEST_CASE(manual_lru_cache_test)
 {
 	ext::manual_lru_cache<int, std::string> isc {5};
@@ -75,3 +89,484 @@ BOOST_AUTO_TEST_CASE(lru_cache_test)
 	BOOST_CHECK(counters[12] == 2);
 	BOOST_CHECK(counters[14] == 2);
 }
+
+template <class EvictionPolicy>
+static void eviction_policy_stress(unsigned capacity)
+{
+	ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, EvictionPolicy> cache {capacity};
+	std::mt19937 gen(capacity);
+	std::uniform_int_distribution<int> dist(0, 3 * capacity);
+
+	for (int i = 0; i < 20000; ++i)
+	{
+		int key = dist(gen);
+		if (auto * val = cache.find_ptr(key))
+			BOOST_REQUIRE_EQUAL(*val, key);
+		else
+			BOOST_REQUIRE_EQUAL(cache.insert(key, key), key);
+
+		BOOST_REQUIRE_LE(cache.size(), capacity);
+		// just inserted element is never evicted
+		BOOST_REQUIRE(cache.find_ptr(key));
+
+		if (i % 5000 == 4999) cache.set_maxsize(capacity / 2 + 1);
+		if (i % 5000 == 0)    cache.set_maxsize(capacity);
+	}
+
+	cache.drop_to(capacity / 3);
+	BOOST_CHECK_EQUAL(cache.size(), capacity / 3);
+	cache.clear();
+	BOOST_CHECK_EQUAL(cache.size(), 0);
+	cache.insert(1, 1);
+	BOOST_CHECK(cache.find_ptr(1));
+}
+
+BOOST_AUTO_TEST_CASE(lru_cache_eviction_policies_test)
+{
+	for (unsigned capacity : {1, 2, 3, 10, 200})
+	{
+		eviction_policy_stress<ext::lru_eviction>(capacity);
+		eviction_policy_stress<ext::clock_eviction>(capacity);
+		eviction_policy_stress<ext::slru_eviction>(capacity);
+		eviction_policy_stress<ext::tinylfu_eviction>(capacity);
+	}
+
+	// hot set survives one pass scan with scan resistant policies, but not with LRU
+	auto hot_after_scan = [](auto & cache)
+	{
+		for (int round = 0; round < 3; ++round)
+			for (int key = 0; key < 50; ++key)
+				if (not cache.find_ptr(key)) cache.insert(key, key);
+
+		for (int key = 1000; key < 1200; ++key)
+			if (not cache.find_ptr(key)) cache.insert(key, key);
+
+		int hot = 0;
+		for (int key = 0; key < 50; ++key)
+			hot += cache.find_ptr(key) != nullptr;
+
+		return hot;
+	};
+
+	ext::manual_lru_cache<int, int> lru {100};
+	ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::slru_eviction> slru {100};
+	ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::tinylfu_eviction> tinylfu {100};
+
+	BOOST_CHECK_EQUAL(hot_after_scan(lru), 0);
+	BOOST_CHECK_EQUAL(hot_after_scan(slru), 50);
+	BOOST_CHECK_EQUAL(hot_after_scan(tinylfu), 50);
+
+	// lru_cache with policy
+	ext::lru_cache<int, int, boost::hash<int>, std::equal_to<>, std::function<int(int)>, ext::clock_eviction> cache {2, [](int k) { return k; }};
+	BOOST_CHECK_EQUAL(cache.at(1), 1);
+	BOOST_CHECK_EQUAL(cache.at(2), 2);
+	BOOST_CHECK_EQUAL(cache.at(3), 3);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(lru_cache_weigher_test)
+{
+	auto string_weigher = [](int key, const std::string & value) { return value.size(); };
+	ext::manual_lru_cache<int, std::string, boost::hash<int>, std::equal_to<>, ext::lru_eviction, decltype(string_weigher)> cache {10, string_weigher};
+
+	cache.insert(1, "aaa");
+	cache.insert(2, "bbb");
+	cache.insert(3, "ccc");
+	BOOST_CHECK_EQUAL(cache.weight(), 9);
+	BOOST_CHECK_EQUAL(cache.size(), 3);
+
+	// 6 more units: 1 and 2 are evicted
+	cache.insert(4, "dddddd");
+	BOOST_CHECK_EQUAL(cache.weight(), 9);
+	BOOST_CHECK(not cache.find_ptr(1));
+	BOOST_CHECK(not cache.find_ptr(2));
+	BOOST_CHECK(cache.find_ptr(3));
+
+	// replacing value changes weight and can evict others
+	cache.insert(3, "cccccccc");
+	BOOST_CHECK_EQUAL(cache.weight(), 8);
+	BOOST_CHECK_EQUAL(cache.size(), 1);
+
+	// entry heavier than capacity stays alone
+	cache.insert(5, std::string(20, 'e'));
+	BOOST_CHECK_EQUAL(cache.size(), 1);
+	BOOST_CHECK_EQUAL(cache.weight(), 20);
+	BOOST_CHECK(cache.find_ptr(5));
+
+	cache.set_maxsize(30);
+	cache.insert(6, "ff");
+	BOOST_CHECK_EQUAL(cache.weight(), 22);
+	cache.set_maxsize(5);
+	BOOST_CHECK_EQUAL(cache.weight(), 2);
+	BOOST_CHECK(cache.find_ptr(6));
+
+	cache.clear();
+	BOOST_CHECK_EQUAL(cache.weight(), 0);
+
+	// default weigher counts entries
+	ext::manual_lru_cache<int, int> counted {3};
+	for (int i = 0; i < 10; ++i) counted.insert(i, i);
+	BOOST_CHECK_EQUAL(counted.weight(), 3);
+	BOOST_CHECK_EQUAL(counted.size(), 3);
+}
+
+namespace
+{
+	/// manually advanced clock for ttl tests
+	struct test_clock
+	{
+		typedef std::chrono::milliseconds duration;
+		typedef duration::rep rep;
+		typedef duration::period period;
+		typedef std::chrono::time_point<test_clock> time_point;
+		static constexpr bool is_steady = true;
+
+		static time_point current;
+		static time_point now() noexcept { return current; }
+		static void advance(duration d) noexcept { current += d; }
+	};
+
+	test_clock::time_point test_clock::current;
+}
+
+BOOST_AUTO_TEST_CASE(lru_cache_ttl_test)
+{
+	using namespace std::chrono_literals;
+	typedef ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::lru_eviction, ext::unit_weigher, ext::ttl_expiry<test_clock>> cache_type;
+
+	cache_type cache {100};
+	BOOST_CHECK(cache.ttl() == cache_type::duration::max());
+
+	// without ttl entries never expire
+	cache.insert(1, 1);
+	test_clock::advance(1000h);
+	BOOST_CHECK(cache.find_ptr(1));
+
+	// cache wide ttl, expired entry is removed lazily on lookup
+	cache.set_ttl(10ms);
+	cache.insert(2, 2);
+	test_clock::advance(5ms);
+	BOOST_CHECK(cache.find_ptr(2));
+	test_clock::advance(5ms);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+	BOOST_CHECK(not cache.find_ptr(2));
+	BOOST_CHECK_EQUAL(cache.size(), 1);
+
+	// per entry ttl overrides cache wide one, replace renews deadline
+	cache.insert(3, 3, 100ms);
+	cache.insert(4, 4);
+	test_clock::advance(50ms);
+	BOOST_CHECK(cache.find_ptr(3));
+	BOOST_CHECK(not cache.find_ptr(4));
+	cache.insert(3, 30);
+	test_clock::advance(9ms);
+	BOOST_CHECK_EQUAL(*cache.find_ptr(3), 30);
+	test_clock::advance(1ms);
+	BOOST_CHECK(not cache.find_ptr(3));
+
+	// expire removes expired entries, work is bounded by max_work
+	cache.clear();
+	for (int i = 0; i < 50; ++i) cache.insert(i, i);
+	for (int i = 50; i < 60; ++i) cache.insert(i, i, 1h);
+	test_clock::advance(10ms);
+
+	BOOST_CHECK_LE(cache.expire(10), 10);
+	std::size_t removed = 0, calls = 0;
+	while (cache.size() > 10 and calls++ < 1000)
+		removed += cache.expire(10);
+	BOOST_CHECK_EQUAL(cache.size(), 10);
+	BOOST_CHECK_EQUAL(cache.expire(), 0);
+	for (int i = 50; i < 60; ++i) BOOST_CHECK(cache.find_ptr(i));
+
+	// sweep on insert eventually cleans entries, that are never looked up
+	cache.clear();
+	cache.set_sweep_step(8);
+	for (int i = 0; i < 20; ++i) cache.insert(i, i);
+	test_clock::advance(10ms);
+	for (int i = 0; i < 200 and cache.size() > 20; ++i) cache.insert(100 + i, i, 1h);
+	BOOST_CHECK_EQUAL(cache.size(), 20);
+	for (int i = 0; i < 20; ++i) BOOST_CHECK(not cache.find_ptr(i));
+
+	// lru_cache acquires expired values again
+	int calls_count = 0;
+	auto acquire = [&calls_count](int key) { ++calls_count; return key * 10; };
+	ext::lru_cache<int, int, boost::hash<int>, std::equal_to<>, decltype(acquire), ext::lru_eviction, ext::unit_weigher, ext::ttl_expiry<test_clock>> lcache {10, acquire};
+	lcache.set_ttl(10ms);
+
+	BOOST_CHECK_EQUAL(lcache.at(1), 10);
+	BOOST_CHECK_EQUAL(lcache.at(1), 10);
+	BOOST_CHECK_EQUAL(calls_count, 1);
+	test_clock::advance(10ms);
+	BOOST_CHECK_EQUAL(lcache.at(1), 10);
+	BOOST_CHECK_EQUAL(calls_count, 2);
+}
+
+// trace replay benchmark, run explicitly with --run_test=lru_cache_policy_benchmark --log_level=message
+BOOST_AUTO_TEST_CASE(lru_cache_policy_benchmark, *boost::unit_test::disabled())
+{
+	using namespace std::chrono;
+	constexpr unsigned capacity = 10000, keyspace = 1000 * 1000, count = 10 * 1000 * 1000;
+
+	// zipf-like hot keys, interleaved with long sequential scans
+	std::vector<int> trace;
+	trace.reserve(count);
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<double> real(0, 1);
+	int scan = 0;
+	while (trace.size() < count)
+	{
+		if (trace.size() % 200000 < 20000)
+			trace.push_back(keyspace + scan++);
+		else
+			trace.push_back(static_cast<int>(std::pow(keyspace, real(gen))));
+	}
+
+	auto replay = [&trace](auto cache, const char * name)
+	{
+		std::size_t hits = 0;
+		auto start = steady_clock::now();
+		for (int key : trace)
+		{
+			if (cache.find_ptr(key)) ++hits;
+			else cache.insert(key, key);
+		}
+
+		auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+		BOOST_TEST_MESSAGE(name << ": hit ratio " << 100.0 * hits / trace.size() << "%, "
+		                   << static_cast<std::uint64_t>(trace.size() / elapsed) << " ops/sec");
+	};
+
+	replay(ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::lru_eviction>(capacity), "lru");
+	replay(ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::clock_eviction>(capacity), "clock");
+	replay(ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::slru_eviction>(capacity), "slru");
+	replay(ext::manual_lru_cache<int, int, boost::hash<int>, std::equal_to<>, ext::tinylfu_eviction>(capacity), "w-tinylfu");
+}
+
+BOOST_AUTO_TEST_CASE(flat_lru_cache_test)
+{
+	ext::flat_lru_cache<int, std::string> cache {3};
+	BOOST_CHECK(not cache.find_ptr(1));
+	BOOST_CHECK_THROW(cache.at(1), std::out_of_range);
+
+	cache.insert(1, "1");
+	cache.insert(2, "2");
+	cache.insert(3, "3");
+	BOOST_CHECK_EQUAL(cache.at(1), "1");
+
+	// 2 is least recently used
+	cache.insert(4, "4");
+	BOOST_CHECK_EQUAL(cache.size(), 3);
+	BOOST_CHECK(not cache.find_ptr(2));
+	BOOST_CHECK(cache.find_ptr(3));
+
+	cache.insert(1, "11");
+	BOOST_CHECK_EQUAL(cache.at(1), "11");
+	BOOST_CHECK_EQUAL(cache.size(), 3);
+
+	BOOST_CHECK(cache.erase(3));
+	BOOST_CHECK(not cache.erase(3));
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+
+	// 4 is least recently used
+	cache.drop_last();
+	BOOST_CHECK(not cache.find_ptr(4));
+	BOOST_CHECK(cache.find_ptr(1));
+
+	cache.set_maxsize(10);
+	for (int i = 10; i < 20; ++i) cache.insert(i, std::to_string(i));
+	BOOST_CHECK_EQUAL(cache.size(), 10);
+	cache.set_maxsize(2);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+	BOOST_CHECK_EQUAL(cache.at(18), "18");
+	BOOST_CHECK_EQUAL(cache.at(19), "19");
+
+	cache.clear();
+	BOOST_CHECK_EQUAL(cache.size(), 0);
+
+	typedef ext::flat_lru_cache<int, int> int_cache;
+	BOOST_CHECK_THROW(int_cache(0), std::invalid_argument);
+
+	// random operations must give same results as manual_lru_cache with lru eviction
+	int_cache flat {100};
+	ext::manual_lru_cache<int, int> reference {100};
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> key_dist(0, 300), op_dist(0, 9);
+
+	std::size_t mismatches = 0;
+	for (int i = 0; i < 100000; ++i)
+	{
+		int key = key_dist(gen), op = op_dist(gen);
+		if (op < 5)
+		{
+			auto * p1 = flat.find_ptr(key);
+			auto * p2 = reference.find_ptr(key);
+			if (bool(p1) != bool(p2) or (p1 and *p1 != *p2)) ++mismatches;
+		}
+		else if (op < 9)
+		{
+			flat.insert(key, i);
+			reference.insert(key, i);
+		}
+		else
+		{
+			flat.drop_last();
+			reference.drop_last();
+		}
+
+		if (flat.size() != reference.size()) ++mismatches;
+	}
+
+	BOOST_CHECK_EQUAL(mismatches, 0);
+
+	int_cache other {5};
+	other.insert(-1, -1);
+	swap(flat, other);
+	BOOST_CHECK_EQUAL(flat.size(), 1);
+	BOOST_CHECK_EQUAL(flat.at(-1), -1);
+	BOOST_CHECK_EQUAL(other.maxsize(), 100);
+}
+
+// memory/throughput comparison, run explicitly with --run_test=flat_lru_cache_benchmark --log_level=message
+BOOST_AUTO_TEST_CASE(flat_lru_cache_benchmark, *boost::unit_test::disabled())
+{
+	using namespace std::chrono;
+	constexpr std::size_t capacity = 1000 * 1000, count = 10 * 1000 * 1000;
+	constexpr std::int64_t keyspace = 2 * capacity;
+
+	std::vector<std::int64_t> trace;
+	trace.reserve(count);
+	std::mt19937_64 gen(1);
+	std::uniform_int_distribution<std::int64_t> dist(0, keyspace - 1);
+	for (std::size_t i = 0; i < count; ++i)
+		trace.push_back(dist(gen));
+
+	// heap bytes in use, 0 if not available on this platform
+	auto heap_used = []() -> std::size_t
+	{
+	#if defined(__GLIBC__) and (__GLIBC__ > 2 or __GLIBC_MINOR__ >= 33)
+		// big blocks are mmaped and are not counted in uordblks
+		auto info = ::mallinfo2();
+		return info.uordblks + info.hblkhd;
+	#else
+		return 0;
+	#endif
+	};
+
+	auto run = [&](auto make_cache, const char * name)
+	{
+		auto heap_before = heap_used();
+		auto cache = make_cache();
+		for (std::int64_t key = 0; key < static_cast<std::int64_t>(capacity); ++key)
+			cache.insert(key, key);
+		auto heap_after = heap_used();
+
+		std::size_t hits = 0;
+		auto start = steady_clock::now();
+		for (auto key : trace)
+		{
+			if (cache.find_ptr(key)) ++hits;
+			else cache.insert(key, key);
+		}
+
+		auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+		BOOST_TEST_MESSAGE(name << ": " << (heap_after - heap_before) / capacity << " heap bytes per entry, "
+		                   << "hit ratio " << 100.0 * hits / trace.size() << "%, "
+		                   << static_cast<std::uint64_t>(trace.size() / elapsed) << " ops/sec");
+	};
+
+	run([] { return ext::manual_lru_cache<std::int64_t, std::int64_t>(capacity); }, "manual_lru_cache");
+	run([] { return ext::flat_lru_cache<std::int64_t, std::int64_t>(capacity); }, "flat_lru_cache");
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_lru_cache_test)
+{
+	// single shard - exact CLOCK behaviour
+	ext::concurrent_lru_cache<int, std::string> cache {3, 1};
+	BOOST_CHECK_EQUAL(cache.shards(), 1);
+	BOOST_CHECK(not cache.find(1));
+
+	cache.insert(1, "1");
+	cache.insert(2, "2");
+	cache.insert(3, "3");
+	BOOST_CHECK(*cache.find(1) == "1");
+
+	// 1 is referenced, gets second chance, 2 is evicted
+	cache.insert(4, "4");
+	BOOST_CHECK_EQUAL(cache.size(), 3);
+	BOOST_CHECK(cache.contains(1));
+	BOOST_CHECK(not cache.contains(2));
+	BOOST_CHECK(cache.contains(3));
+
+	cache.insert(3, "33");
+	BOOST_CHECK(*cache.find(3) == "33");
+
+	BOOST_CHECK(cache.erase(1));
+	BOOST_CHECK(not cache.erase(1));
+	cache.insert(5, "5");
+	BOOST_CHECK_EQUAL(cache.size(), 3);
+	BOOST_CHECK(cache.contains(4));
+
+	cache.clear();
+	BOOST_CHECK_EQUAL(cache.size(), 0);
+
+	// many shards, capacity is never exceeded
+	ext::concurrent_lru_cache<int, int> sharded {100, 8};
+	for (int i = 0; i < 1000; ++i)
+		sharded.insert(i, i);
+
+	BOOST_CHECK_LE(sharded.size(), 100 + sharded.shards());
+	BOOST_CHECK(*sharded.find(999) == 999);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_lru_cache_get_or_load_test)
+{
+	using namespace std::chrono_literals;
+
+	ext::concurrent_lru_cache<int, int> cache {1000};
+	std::atomic_int loads = 0;
+
+	auto loader = [&loads](int key)
+	{
+		++loads;
+		std::this_thread::sleep_for(50ms);
+		return key * 2;
+	};
+
+	// concurrent misses of same key - single load
+	std::vector<std::thread> threads;
+	std::atomic_int sum = 0;
+	for (int i = 0; i < 8; ++i)
+		threads.emplace_back([&] { sum += cache.get_or_load(12, loader); });
+
+	for (auto & thr : threads) thr.join();
+	BOOST_CHECK_EQUAL(loads.load(), 1);
+	BOOST_CHECK_EQUAL(sum.load(), 8 * 24);
+	BOOST_CHECK_EQUAL(cache.get_or_load(12, loader), 24);
+	BOOST_CHECK_EQUAL(loads.load(), 1);
+
+	// failed load is not cached
+	auto failing = [](int) -> int { throw std::runtime_error("load failed"); };
+	BOOST_CHECK_THROW(cache.get_or_load(13, failing), std::runtime_error);
+	BOOST_CHECK(not cache.contains(13));
+	BOOST_CHECK_EQUAL(cache.get_or_load(13, loader), 26);
+
+	// concurrent readers and writers
+	threads.clear();
+	std::atomic_int mismatches = 0;
+	for (int t = 0; t < 4; ++t)
+	{
+		threads.emplace_back([&cache, &mismatches, t]
+		{
+			for (int i = 0; i < 10000; ++i)
+			{
+				int key = 100 + (i * 7 + t) % 2000;
+				if (auto val = cache.find(key)) mismatches += *val != key;
+				else cache.insert(key, key);
+			}
+		});
+	}
+
+	for (auto & thr : threads) thr.join();
+	BOOST_CHECK_EQUAL(mismatches.load(), 0);
+	BOOST_CHECK_LE(cache.size(), 1000 + cache.shards());
+}
@@ -0,0 +1,151 @@
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <stdexcept>
+#include <ext/parallel_algorithm.hpp>
+#include <boost/test/unit_test.hpp>
+
+// libstdc++ parallel algorithms require linking with TBB, so comparison with std::execution::par is opt-in
+#ifdef EXT_BENCHMARK_STD_EXECUTION
+#include <execution>
+#endif
+
+BOOST_AUTO_TEST_SUITE(parallel_algorithm_tests)
+
+BOOST_AUTO_TEST_CASE(parallel_for_test)
+{
+	ext::thread_pool pool(4);
+	std::vector<int> data(100000);
+	std::iota(data.begin(), data.end(), 0);
+
+	auto f = ext::parallel_for(pool, data.begin(), data.end(), [](int & val) { val *= 2; });
+	f.get();
+
+	bool ok = true;
+	for (std::size_t i = 0; i < data.size(); ++i)
+		ok &= data[i] == static_cast<int>(i * 2);
+
+	BOOST_CHECK(ok);
+
+	// empty range and pool without workers - calling thread does everything
+	ext::thread_pool empty_pool;
+	BOOST_CHECK(ext::parallel_for(empty_pool, data.begin(), data.begin(), [](int &) {}).is_ready());
+
+	auto f2 = ext::parallel_for(empty_pool, data.begin(), data.end(), [](int & val) { val /= 2; });
+	BOOST_CHECK(f2.is_ready());
+	BOOST_CHECK_EQUAL(data.back(), static_cast<int>(data.size() - 1));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_transform_test)
+{
+	ext::thread_pool pool(4);
+	std::vector<int> input(50000);
+	std::vector<long long> output(input.size());
+	std::iota(input.begin(), input.end(), 0);
+
+	auto f = ext::parallel_transform(pool, input.begin(), input.end(), output.begin(),
+	                                 [](int val) { return static_cast<long long>(val) * val; }, 100);
+
+	BOOST_CHECK(f.get() == output.end());
+
+	bool ok = true;
+	for (std::size_t i = 0; i < input.size(); ++i)
+		ok &= output[i] == static_cast<long long>(i) * static_cast<long long>(i);
+
+	BOOST_CHECK(ok);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_reduce_test)
+{
+	ext::thread_pool pool(4);
+	std::vector<long long> data(123457);
+	std::iota(data.begin(), data.end(), 1);
+
+	auto size = static_cast<long long>(data.size());
+	auto expected = size * (size + 1) / 2;
+	BOOST_CHECK_EQUAL(ext::parallel_reduce(pool, data.begin(), data.end(), 0LL).get(), expected);
+	BOOST_CHECK_EQUAL(ext::parallel_reduce(pool, data.begin(), data.end(), 10LL, std::plus<>(), 1).get(), expected + 10);
+	BOOST_CHECK_EQUAL(ext::parallel_reduce(pool, data.begin(), data.begin(), 10LL).get(), 10);
+
+	auto fmax = ext::parallel_reduce(pool, data.begin(), data.end(), 0LL, [](long long a, long long b) { return std::max(a, b); });
+	BOOST_CHECK_EQUAL(fmax.get(), size);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_exception_test)
+{
+	ext::thread_pool pool(4);
+	std::vector<int> data(10000);
+	std::iota(data.begin(), data.end(), 0);
+
+	auto f = ext::parallel_for(pool, data.begin(), data.end(), [](int val)
+	{
+		if (val == 5000) throw std::runtime_error("test");
+	});
+
+	BOOST_CHECK_THROW(f.get(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_abandoned_helpers_test)
+{
+	// the only worker is busy, so helpers stay queued; calling thread processes whole range
+	ext::thread_pool pool(1);
+	ext::promise<void> blocker, started;
+	auto started_future = started.get_future();
+	auto busy = pool.submit([&started, f = blocker.get_future()]() mutable { started.set_value(); f.get(); });
+	started_future.get();
+
+	std::vector<int> data(1000, 1);
+	auto f = ext::parallel_for(pool, data.begin(), data.end(), [](int & val) { val = 2; }, 10);
+	BOOST_CHECK(not f.is_ready());
+
+	// abandoned helpers must not hold result forever
+	pool.clear();
+	BOOST_CHECK(f.is_ready());
+	BOOST_CHECK_NO_THROW(f.get());
+	BOOST_CHECK(std::all_of(data.begin(), data.end(), [](int val) { return val == 2; }));
+
+	blocker.set_value();
+	busy.get();
+}
+
+// comparison with serial loop, run explicitly with --run_test=parallel_algorithm_tests/parallel_algorithm_benchmark --log_level=message
+BOOST_AUTO_TEST_CASE(parallel_algorithm_benchmark, *boost::unit_test::disabled())
+{
+	using namespace std::chrono;
+	constexpr std::size_t size = 10 * 1000 * 1000;
+	constexpr unsigned rounds = 10;
+
+	ext::thread_pool pool(std::thread::hardware_concurrency());
+	std::vector<double> data(size);
+	std::iota(data.begin(), data.end(), 0.0);
+
+	auto heavy = [](double & val) { val = std::sqrt(val) * 1.0001 + 1; };
+	auto light = [](double & val) { val += 1; };
+	volatile double sink; // keeps reduce results from being optimized away
+
+	auto measure = [&](const char * name, auto && body)
+	{
+		auto start = steady_clock::now();
+		for (unsigned i = 0; i < rounds; ++i) body();
+		auto ms = duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count() / rounds;
+		BOOST_TEST_MESSAGE(name << ": " << ms << " ms");
+	};
+
+	measure("for_each sqrt serial", [&] { std::for_each(data.begin(), data.end(), heavy); });
+	measure("for_each sqrt parallel_for", [&] { ext::parallel_for(pool, data.begin(), data.end(), heavy).get(); });
+	measure("for_each +1 serial", [&] { std::for_each(data.begin(), data.end(), light); });
+	measure("for_each +1 parallel_for", [&] { ext::parallel_for(pool, data.begin(), data.end(), light).get(); });
+	measure("reduce serial", [&] { sink = std::accumulate(data.begin(), data.end(), 0.0); });
+	measure("reduce parallel_reduce", [&] { sink = ext::parallel_reduce(pool, data.begin(), data.end(), 0.0).get(); });
+
+#ifdef EXT_BENCHMARK_STD_EXECUTION
+	measure("for_each sqrt std::execution::par", [&] { std::for_each(std::execution::par, data.begin(), data.end(), heavy); });
+	measure("for_each +1 std::execution::par", [&] { std::for_each(std::execution::par, data.begin(), data.end(), light); });
+	measure("reduce std::execution::par", [&] { sink = std::reduce(std::execution::par, data.begin(), data.end(), 0.0); });
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,803 @@
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <chrono>
+#include <ext/future.hpp>
+#include <ext/thread_pool.hpp>
+#include <ext/work_stealing_deque.hpp>
+#include <ext/mpmc_queue.hpp>
+#include <ext/small_object_allocator.hpp>
+#include <ext/thread_affinity.hpp>
+#include <ext/executor_metrics.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(thread_pool_tests)
+
+BOOST_AUTO_TEST_CASE(work_stealing_deque_simple_test)
+{
+	ext::work_stealing_deque<int> deque(2);
+	int val;
+
+	BOOST_CHECK(deque.empty());
+	BOOST_CHECK(not deque.pop(val));
+	BOOST_CHECK(not deque.steal(val));
+
+	// forces buffer to grow several times
+	for (int i = 0; i < 10; ++i)
+		deque.push(i);
+
+	BOOST_CHECK_EQUAL(deque.size(), 10);
+
+	// owner pops LIFO, thieves steal FIFO
+	BOOST_CHECK(deque.pop(val));   BOOST_CHECK_EQUAL(val, 9);
+	BOOST_CHECK(deque.steal(val)); BOOST_CHECK_EQUAL(val, 0);
+	BOOST_CHECK(deque.steal(val)); BOOST_CHECK_EQUAL(val, 1);
+	BOOST_CHECK(deque.pop(val));   BOOST_CHECK_EQUAL(val, 8);
+
+	BOOST_CHECK_EQUAL(deque.size(), 6);
+}
+
+BOOST_AUTO_TEST_CASE(work_stealing_deque_concurrent_test)
+{
+	constexpr int count = 100000;
+	constexpr int nthieves = 3;
+
+	ext::work_stealing_deque<int> deque;
+	std::atomic_bool done = false;
+	std::atomic<long long> sum = 0;
+	std::atomic_int taken = 0;
+
+	auto thief = [&]
+	{
+		int val;
+		while (not done.load())
+			if (deque.steal(val)) sum += val, ++taken;
+	};
+
+	std::vector<std::thread> thieves;
+	for (int i = 0; i < nthieves; ++i)
+		thieves.emplace_back(thief);
+
+	int val;
+	for (int i = 1; i <= count; ++i)
+	{
+		deque.push(i);
+		if (i % 3 == 0 and deque.pop(val))
+			sum += val, ++taken;
+	}
+
+	while (deque.pop(val))
+		sum += val, ++taken;
+
+	while (taken.load() != count)
+		std::this_thread::yield();
+
+	done = true;
+	for (auto & thr : thieves) thr.join();
+
+	BOOST_CHECK_EQUAL(sum.load(), static_cast<long long>(count) * (count + 1) / 2);
+}
+
+BOOST_AUTO_TEST_CASE(mpmc_queue_simple_test)
+{
+	ext::mpmc_queue<std::unique_ptr<int>> queue(3);
+	std::unique_ptr<int> val;
+
+	BOOST_CHECK_EQUAL(queue.capacity(), 4);
+	BOOST_CHECK(queue.empty());
+	BOOST_CHECK(not queue.try_pop(val));
+
+	for (int i = 0; i < 4; ++i)
+		BOOST_CHECK(queue.try_push(std::make_unique<int>(i)));
+
+	// full, value is not moved from
+	auto extra = std::make_unique<int>(4);
+	BOOST_CHECK(not queue.try_push(extra));
+	BOOST_CHECK(extra);
+	BOOST_CHECK_EQUAL(queue.size(), 4);
+
+	BOOST_CHECK(queue.try_pop(val)); BOOST_CHECK_EQUAL(*val, 0);
+	BOOST_CHECK(queue.try_push(extra));
+	BOOST_CHECK(queue.try_pop(val)); BOOST_CHECK_EQUAL(*val, 1);
+	BOOST_CHECK(queue.try_pop(val)); BOOST_CHECK_EQUAL(*val, 2);
+	BOOST_CHECK(queue.try_pop(val)); BOOST_CHECK_EQUAL(*val, 3);
+	BOOST_CHECK(queue.try_pop(val)); BOOST_CHECK_EQUAL(*val, 4);
+	BOOST_CHECK(not queue.try_pop(val));
+
+	// items left in queue are destroyed with it
+	BOOST_CHECK(queue.try_push(std::make_unique<int>(5)));
+}
+
+BOOST_AUTO_TEST_CASE(mpmc_queue_concurrent_test)
+{
+	constexpr int count = 100000;
+	constexpr int nproducers = 2;
+	constexpr int nconsumers = 2;
+
+	ext::mpmc_queue<int> queue(64);
+	std::atomic<long long> sum = 0;
+	std::atomic_int taken = 0;
+
+	auto producer = [&](int start)
+	{
+		for (int i = start; i <= count; i += nproducers)
+			while (not queue.try_push(i))
+				std::this_thread::yield();
+	};
+
+	auto consumer = [&]
+	{
+		int val;
+		while (taken.load() != count)
+			if (queue.try_pop(val)) sum += val, ++taken;
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nproducers; ++i)
+		threads.emplace_back(producer, i + 1);
+	for (int i = 0; i < nconsumers; ++i)
+		threads.emplace_back(consumer);
+
+	for (auto & thr : threads) thr.join();
+	BOOST_CHECK_EQUAL(sum.load(), static_cast<long long>(count) * (count + 1) / 2);
+}
+
+BOOST_AUTO_TEST_CASE(lockfree_queue_thread_pool_test)
+{
+	ext::thread_pool pool(0, ext::thread_pool::lockfree_queue);
+
+	// more tasks than lock-free queue can hold, rest go to shared queue
+	std::vector<ext::future<int>> futures;
+	for (int i = 0; i < 5000; ++i)
+		futures.push_back(pool.submit([i] { return i; }));
+
+	pool.set_nworkers(4);
+
+	// concurrent submitters
+	std::atomic_int executed = 0;
+	std::vector<std::thread> submitters;
+	for (int i = 0; i < 4; ++i)
+	{
+		submitters.emplace_back([&pool, &executed]
+		{
+			for (int i = 0; i < 10000; ++i)
+				pool.submit([&executed] { ++executed; });
+		});
+	}
+
+	for (auto & thr : submitters) thr.join();
+
+	long long sum = 0;
+	for (auto & f : futures) sum += f.get();
+	BOOST_CHECK_EQUAL(sum, 4999 * 5000 / 2);
+
+	while (executed.load() != 40000)
+		std::this_thread::yield();
+
+	BOOST_CHECK_EQUAL(executed.load(), 40000);
+
+	// not executed tasks are abandoned
+	pool.set_nworkers(0).wait();
+	auto f = pool.submit([] { return 1; });
+	pool.clear();
+	BOOST_CHECK_THROW(f.get(), ext::future_error);
+}
+
+BOOST_AUTO_TEST_CASE(work_stealing_thread_pool_test)
+{
+	// every task spawns 2 child tasks from worker thread until depth is reached,
+	// child tasks go into local deques and are stolen by other workers
+	constexpr unsigned depth = 12;
+	constexpr unsigned total = (1u << (depth + 1)) - 1;
+
+	ext::thread_pool pool(4, ext::thread_pool::work_stealing);
+	std::atomic_uint executed = 0;
+	ext::promise<void> done;
+
+	std::function<void(unsigned)> spawn = [&](unsigned level)
+	{
+		if (level < depth)
+		{
+			pool.submit(spawn, level + 1);
+			pool.submit(spawn, level + 1);
+		}
+
+		if (executed.fetch_add(1) + 1 == total)
+			done.set_value();
+	};
+
+	pool.submit(spawn, 0);
+
+	auto fdone = done.get_future();
+	BOOST_REQUIRE(fdone.wait_for(std::chrono::seconds(30)) == ext::future_status::ready);
+	BOOST_CHECK_EQUAL(executed.load(), total);
+
+	// external submits still work
+	auto f = pool.submit([] { return 12; });
+	BOOST_CHECK_EQUAL(f.get(), 12);
+}
+
+BOOST_AUTO_TEST_CASE(work_stealing_thread_pool_stop_test)
+{
+	// workers are stopped while there are pending tasks in their deques - those must not be lost
+	ext::thread_pool pool(2, ext::thread_pool::work_stealing);
+
+	auto fouter = pool.submit([&pool]
+	{
+		std::vector<ext::future<int>> futures;
+		for (int i = 0; i < 100; ++i)
+			futures.push_back(pool.submit([i] { return i; }));
+
+		return futures;
+	});
+
+	auto futures = fouter.get();
+	pool.set_nworkers(0).wait();
+	pool.set_nworkers(1);
+
+	int sum = 0;
+	for (auto & f : futures) sum += f.get();
+	BOOST_CHECK_EQUAL(sum, 99 * 100 / 2);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_submit_bulk_test)
+{
+	std::vector<int> input(1000);
+	std::iota(input.begin(), input.end(), 0);
+
+	std::initializer_list<unsigned> all_options = {
+		ext::thread_pool::fifo, ext::thread_pool::work_stealing, ext::thread_pool::lockfree_queue,
+		ext::thread_pool::work_stealing | ext::thread_pool::lockfree_queue,
+	};
+
+	for (unsigned opts : all_options)
+	{
+		ext::thread_pool pool(4, opts);
+
+		auto futures = pool.submit_bulk(input.begin(), input.end(), [](int val) { return val * 2; });
+		BOOST_REQUIRE_EQUAL(futures.size(), input.size());
+
+		for (std::size_t i = 0; i < futures.size(); ++i)
+			BOOST_CHECK_EQUAL(futures[i].get(), input[i] * 2);
+
+		// bulk submit from worker thread
+		auto fouter = pool.submit([&pool, &input]
+		{
+			return pool.submit_bulk(input.begin(), input.end(), [](int val) { return val; });
+		});
+
+		long long sum = 0;
+		for (auto & f : fouter.get()) sum += f.get();
+		BOOST_CHECK_EQUAL(sum, 999 * 1000 / 2);
+
+		auto fempty = pool.submit_bulk(input.end(), input.end(), [](int val) {});
+		BOOST_CHECK(fempty.empty());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(future_then_executor_test)
+{
+	ext::thread_pool pool(2);
+
+	// continuation runs on pool thread, not on one which fulfills promise
+	ext::promise<int> p1;
+	auto f1 = p1.get_future().then(pool, [](ext::future<int> f)
+	{
+		return std::make_pair(f.get() * 2, std::this_thread::get_id());
+	});
+
+	std::thread([&p1] { p1.set_value(21); }).join();
+	auto [val, id] = f1.get();
+	BOOST_CHECK_EQUAL(val, 42);
+	BOOST_CHECK(id != std::this_thread::get_id());
+
+	// shared_future, already ready parent
+	ext::shared_future<int> sf = ext::make_ready_future(1).share();
+	auto f2 = sf.then(pool, [](ext::shared_future<int> f) { return f.get() + 1; });
+	auto f3 = sf.then(pool, [](ext::shared_future<int> f) { return f.get() + 2; });
+	BOOST_CHECK_EQUAL(f2.get(), 2);
+	BOOST_CHECK_EQUAL(f3.get(), 3);
+	BOOST_CHECK_EQUAL(sf.get(), 1);
+
+	// inline executor runs continuation in fulfilling thread
+	ext::inline_executor inl;
+	ext::promise<void> p4;
+	auto f4 = p4.get_future().then(inl, [](ext::future<void> f) { return std::this_thread::get_id(); });
+	p4.set_value();
+	BOOST_CHECK(f4.get() == std::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE(future_then_executor_abandon_test)
+{
+	ext::promise<int> p;
+	ext::future<int> f;
+
+	{
+		ext::thread_pool pool(1);
+		f = p.get_future().then(pool, [](ext::future<int> f) { return f.get(); });
+	}
+
+	// pool is gone, continuation is abandoned and parent firing does not touch pool
+	p.set_value(1);
+	BOOST_CHECK_THROW(f.get(), ext::future_error);
+
+	// clear abandons delayed tasks too
+	ext::thread_pool pool(1);
+	ext::promise<int> p2;
+	auto f2 = p2.get_future().then(pool, [](ext::future<int> f) { return f.get(); });
+	pool.clear();
+	p2.set_value(2);
+	BOOST_CHECK_THROW(f2.get(), ext::future_error);
+
+	// many concurrently fulfilled parents
+	std::vector<ext::promise<int>> promises(1000);
+	std::vector<ext::future<int>> futures;
+	for (auto & pr : promises)
+		futures.push_back(pr.get_future().then(pool, [](ext::future<int> f) { return f.get(); }));
+
+	std::thread thr([&promises] { for (int i = 0; i < 1000; i += 2) promises[i].set_value(i); });
+	for (int i = 1; i < 1000; i += 2) promises[i].set_value(i);
+	thr.join();
+
+	long long sum = 0;
+	for (auto & fut : futures) sum += fut.get();
+	BOOST_CHECK_EQUAL(sum, 999 * 1000 / 2);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_post_test)
+{
+	std::initializer_list<unsigned> all_options = {
+		ext::thread_pool::fifo, ext::thread_pool::work_stealing, ext::thread_pool::lockfree_queue,
+		ext::thread_pool::work_stealing | ext::thread_pool::lockfree_queue,
+	};
+
+	for (unsigned opts : all_options)
+	{
+		ext::thread_pool pool(4, opts);
+		std::atomic_int sum = 0;
+		ext::promise<void> done;
+
+		for (int i = 0; i < 1000; ++i)
+			pool.post([&sum, &done](int val) { if ((sum += val) == 1000) done.set_value(); }, 1);
+
+		done.get_future().get();
+		BOOST_CHECK_EQUAL(sum.load(), 1000);
+
+		// post from worker thread
+		ext::promise<void> inner;
+		pool.post([&pool, &inner] { pool.post([&inner] { inner.set_value(); }); });
+		inner.get_future().get();
+	}
+
+	// cleared posted task is destroyed without execution
+	ext::thread_pool pool;
+	auto guard = std::make_shared<int>(0);
+	bool executed = false;
+	pool.post([guard, &executed] { executed = true; });
+	BOOST_CHECK_EQUAL(guard.use_count(), 2);
+
+	pool.clear();
+	BOOST_CHECK_EQUAL(guard.use_count(), 1);
+	BOOST_CHECK(not executed);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_cancellation_test)
+{
+	std::initializer_list<unsigned> all_options = {
+		ext::thread_pool::fifo, ext::thread_pool::work_stealing, ext::thread_pool::lockfree_queue,
+	};
+
+	for (unsigned opts : all_options)
+	{
+		// no workers, so tasks wait in queue
+		ext::thread_pool pool(0, opts);
+		ext::cancellation_source source;
+		std::atomic_int executed = 0;
+
+		std::vector<ext::future<void>> cancelled, kept;
+		for (int i = 0; i < 100; ++i)
+		{
+			cancelled.push_back(pool.submit(source.token(), [&executed] { ++executed; }));
+			kept.push_back(pool.submit([&executed] { ++executed; }));
+		}
+
+		// continuation inherits token of task
+		auto derived = pool.submit(source.token(), [&executed] { ++executed; }).then([](auto f) { f.get(); });
+
+		source.request_cancellation();
+		for (auto & f : cancelled) BOOST_CHECK(f.is_cancelled());
+		BOOST_CHECK(derived.is_cancelled());
+
+		// cancelling continuation reaches queued task - continuation is it's only consumer
+		auto tail = pool.submit([&executed] { ++executed; }).then([](auto f) { f.get(); });
+		BOOST_CHECK(tail.cancel());
+
+		// and parent of delayed task
+		ext::promise<void> parent;
+		auto delayed = pool.submit(parent.get_future(), [&executed](auto f) { ++executed; });
+		BOOST_CHECK(delayed.cancel());
+		BOOST_CHECK(parent.is_cancelled());
+
+		// already cancelled token - task is dropped too
+		cancelled.push_back(pool.submit(source.token(), ext::thread_pool::priority::high, [&executed] { ++executed; }));
+		BOOST_CHECK(cancelled.back().is_cancelled());
+
+		pool.set_nworkers(2);
+		for (auto & f : kept) f.get();
+		pool.stop().get();
+
+		BOOST_CHECK_EQUAL(executed.load(), 100);
+	#ifdef EXT_ENABLE_EXECUTOR_METRICS
+		BOOST_CHECK_EQUAL(pool.metrics().retired.cancelled, 104);
+	#endif
+	}
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_priority_test)
+{
+	using priority = ext::thread_pool::priority;
+	std::initializer_list<unsigned> all_options = {
+		ext::thread_pool::fifo, ext::thread_pool::work_stealing, ext::thread_pool::lockfree_queue,
+		ext::thread_pool::work_stealing | ext::thread_pool::lockfree_queue,
+	};
+
+	for (unsigned opts : all_options)
+	{
+		for (bool weighted : {false, true})
+		{
+			ext::thread_pool pool(0, opts | (weighted ? ext::thread_pool::weighted_priority : 0));
+			// executed by single worker, no synchronization needed
+			std::string order;
+
+			for (int i = 0; i < 7; ++i)
+			{
+				pool.post(priority::low, [&order] { order += 'L'; });
+				pool.post([&order] { order += 'N'; });
+			}
+
+			std::vector<int> items(4);
+			auto futures = pool.submit_bulk(priority::high, items.begin(), items.end(), [&order](int) { order += 'H'; });
+			for (int i = 0; i < 3; ++i)
+				pool.submit(priority::high, [&order] { order += 'H'; });
+
+			BOOST_CHECK_EQUAL(pool.queue_depth(priority::high), 7);
+			BOOST_CHECK_EQUAL(pool.queue_depth(priority::normal), 7);
+			BOOST_CHECK_EQUAL(pool.queue_depth(priority::low), 7);
+
+			pool.set_nworkers(1);
+			pool.submit(priority::low, [] {}).get();
+
+			if (weighted)
+				BOOST_CHECK_EQUAL(order, "HHHHNNLHHHNNNLNNLLLLL");
+			else
+				BOOST_CHECK_EQUAL(order, "HHHHHHHNNNNNNNLLLLLLL");
+
+			BOOST_CHECK_EQUAL(pool.queue_depth(priority::high), 0);
+			BOOST_CHECK_EQUAL(pool.queue_depth(priority::normal), 0);
+			BOOST_CHECK_EQUAL(pool.queue_depth(priority::low), 0);
+		}
+	}
+
+	// clear abandons all lanes
+	ext::thread_pool pool;
+	auto fhigh = pool.submit(priority::high, [] { return 1; });
+	auto flow = pool.submit(priority::low, [] { return 2; });
+	pool.clear();
+	BOOST_CHECK_THROW(fhigh.get(), ext::future_error);
+	BOOST_CHECK_THROW(flow.get(), ext::future_error);
+	BOOST_CHECK_EQUAL(pool.queue_depth(priority::high), 0);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_set_nworkers_test)
+{
+	ext::thread_pool pool(4);
+	BOOST_CHECK_EQUAL(pool.get_nworkers(), 4);
+
+	auto f1 = pool.set_nworkers(2);
+	BOOST_CHECK_EQUAL(pool.get_nworkers(), 2);
+	auto f2 = pool.set_nworkers(0);
+	BOOST_CHECK_EQUAL(pool.get_nworkers(), 0);
+
+	f1.wait();
+	f2.wait();
+
+	pool.set_nworkers(3);
+	BOOST_CHECK_EQUAL(pool.get_nworkers(), 3);
+	BOOST_CHECK_EQUAL(pool.submit([] { return 1; }).get(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_autoscale_test)
+{
+	using namespace std::chrono_literals;
+
+	auto wait_nworkers = [](ext::thread_pool & pool, unsigned n)
+	{
+		for (int i = 0; i < 500 and pool.get_nworkers() != n; ++i)
+			std::this_thread::sleep_for(10ms);
+
+		return pool.get_nworkers();
+	};
+
+	for (unsigned opts : {ext::thread_pool::fifo, ext::thread_pool::work_stealing, ext::thread_pool::lockfree_queue})
+	{
+		ext::thread_pool pool(0, opts);
+
+		ext::thread_pool::autoscale_options autoscale;
+		autoscale.min_workers = 1;
+		autoscale.max_workers = 4;
+		autoscale.wait_threshold = 5ms;
+		autoscale.idle_timeout = 50ms;
+		pool.set_autoscale(autoscale);
+		BOOST_CHECK_EQUAL(pool.get_nworkers(), 1);
+
+		// blocked workers: pool grows up to max_workers
+		ext::promise<void> release;
+		auto blocker = release.get_future().share();
+
+		std::vector<ext::future<void>> futures;
+		for (int i = 0; i < 6; ++i)
+			futures.push_back(pool.submit([blocker] { blocker.wait(); }));
+
+		BOOST_CHECK_EQUAL(wait_nworkers(pool, 4), 4);
+
+		// idle workers retire down to min_workers
+		release.set_value();
+		for (auto & f : futures) f.get();
+		BOOST_CHECK_EQUAL(wait_nworkers(pool, 1), 1);
+		BOOST_CHECK_EQUAL(pool.submit([] { return 2; }).get(), 2);
+
+		pool.disable_autoscale();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_affinity_test)
+{
+	auto cpus = ext::get_thread_affinity();
+	// not supported on this platform
+	if (cpus.empty()) return;
+
+	auto in = [](const ext::cpu_set & set, unsigned cpu) { return std::find(set.begin(), set.end(), cpu) != set.end(); };
+
+	// all workers pinned to single cpu, including created later
+	ext::cpu_set first = {cpus.front()};
+	ext::thread_pool pool(2);
+	pool.set_worker_affinity({first});
+	BOOST_CHECK(pool.submit(ext::get_thread_affinity).get() == first);
+
+	pool.set_nworkers(4);
+	std::vector<ext::future<ext::cpu_set>> futures;
+	for (int i = 0; i < 16; ++i) futures.push_back(pool.submit(ext::get_thread_affinity));
+	for (auto & f : futures) BOOST_CHECK(f.get() == first);
+
+	// round-robin: every worker is pinned to one cpu of mask
+	pool.set_worker_affinity(ext::round_robin_affinity(cpus));
+	futures.clear();
+	for (int i = 0; i < 16; ++i) futures.push_back(pool.submit(ext::get_thread_affinity));
+	for (auto & f : futures)
+	{
+		auto set = f.get();
+		BOOST_REQUIRE_EQUAL(set.size(), 1);
+		BOOST_CHECK(in(cpus, set.front()));
+	}
+
+	// numa_aware: workers pinned within their node
+	auto nodes = ext::numa_nodes();
+	BOOST_REQUIRE(not nodes.empty());
+	BOOST_CHECK(std::none_of(nodes.begin(), nodes.end(), [](auto & node) { return node.empty(); }));
+
+	std::initializer_list<unsigned> numa_options = {
+		ext::thread_pool::numa_aware, ext::thread_pool::numa_aware | ext::thread_pool::work_stealing,
+	};
+
+	for (unsigned opts : numa_options)
+	{
+		ext::thread_pool npool(2, opts);
+		futures.clear();
+		for (int i = 0; i < 16; ++i) futures.push_back(npool.submit(ext::get_thread_affinity));
+		for (auto & f : futures)
+		{
+			auto set = f.get();
+			bool within_node = std::any_of(nodes.begin(), nodes.end(), [&](auto & node)
+			{
+				return std::all_of(set.begin(), set.end(), [&](unsigned cpu) { return in(node, cpu); });
+			});
+
+			BOOST_CHECK(within_node);
+		}
+
+		auto fsum = npool.submit([&npool]
+		{
+			// submitted from worker - goes into it's node queue
+			std::vector<ext::future<int>> inner;
+			for (int i = 0; i < 100; ++i) inner.push_back(npool.submit([i] { return i; }));
+
+			int sum = 0;
+			for (auto & f : inner) sum += f.get();
+			return sum;
+		});
+
+		BOOST_CHECK_EQUAL(fsum.get(), 99 * 100 / 2);
+		BOOST_CHECK_EQUAL(npool.queue_depth(ext::thread_pool::priority::normal), 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(small_object_allocator_test)
+{
+	using ext::small_object_allocator;
+
+	// freed block is reused for same size class
+	void * p1 = small_object_allocator::allocate(40);
+	small_object_allocator::deallocate(p1, 40);
+	void * p2 = small_object_allocator::allocate(48);
+	BOOST_CHECK_EQUAL(p1, p2);
+	small_object_allocator::deallocate(p2, 48);
+
+	// blocks allocated in one thread and freed in other circulate through depot
+	const std::size_t count = 10 * small_object_allocator::cache_limit;
+	std::vector<void *> blocks;
+	for (std::size_t i = 0; i < count; ++i)
+		blocks.push_back(small_object_allocator::allocate(500));
+
+	std::thread([&blocks] { for (auto * ptr : blocks) small_object_allocator::deallocate(ptr, 500); }).join();
+
+	std::vector<void *> reused;
+	for (std::size_t i = 0; i < small_object_allocator::batch_size; ++i)
+		reused.push_back(small_object_allocator::allocate(500));
+
+	BOOST_CHECK(std::find(blocks.begin(), blocks.end(), reused.front()) != blocks.end());
+	for (auto * ptr : reused) small_object_allocator::deallocate(ptr, 500);
+
+	// big sizes are forwarded to ::operator new
+	void * big = small_object_allocator::allocate(small_object_allocator::max_size + 1);
+	small_object_allocator::deallocate(big, small_object_allocator::max_size + 1);
+}
+
+BOOST_AUTO_TEST_CASE(latency_histogram_test)
+{
+	using ext::latency_histogram;
+
+	// every value falls into bucket, whose upper bound is not less than value and within 1/16 of it
+	for (std::uint64_t val : {0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, ~0ull})
+	{
+		auto idx = latency_histogram::bucket_index(val);
+		BOOST_REQUIRE_LT(idx, latency_histogram::bucket_count);
+
+		auto upper = latency_histogram::bucket_value(idx);
+		BOOST_CHECK_GE(upper, val);
+		BOOST_CHECK_LE(upper - val, val / 16);
+		if (idx) BOOST_CHECK_LT(latency_histogram::bucket_value(idx - 1), val);
+	}
+
+	latency_histogram hist;
+	BOOST_CHECK_EQUAL(hist.count(), 0);
+	BOOST_CHECK(hist.percentile(50) == std::chrono::nanoseconds::zero());
+
+	for (unsigned val = 1; val <= 1000; ++val)
+		hist.record(val);
+
+	BOOST_CHECK_EQUAL(hist.count(), 1000);
+	auto median = hist.percentile(50).count();
+	BOOST_CHECK_GE(median, 500);
+	BOOST_CHECK_LE(median, 500 + 500 / 16);
+	auto max = hist.max().count();
+	BOOST_CHECK_GE(max, 1000);
+	BOOST_CHECK_LE(max, 1000 + 1000 / 16);
+
+	latency_histogram other = hist;
+	other.record(std::chrono::nanoseconds(-5)); // clamped to 0
+	other.merge(hist);
+	BOOST_CHECK_EQUAL(other.count(), 2001);
+	BOOST_CHECK(other.percentile(0) == std::chrono::nanoseconds::zero());
+
+	other.clear();
+	BOOST_CHECK_EQUAL(other.count(), 0);
+}
+
+#ifdef EXT_ENABLE_EXECUTOR_METRICS
+BOOST_AUTO_TEST_CASE(thread_pool_metrics_test)
+{
+	struct counting_hooks : ext::task_hooks
+	{
+		std::atomic_int begins = 0, ends = 0;
+		void task_begin() noexcept override { ++begins; }
+		void task_end() noexcept override { ++ends; }
+	};
+
+	for (unsigned opts : {ext::thread_pool::fifo, ext::thread_pool::work_stealing, ext::thread_pool::lockfree_queue})
+	{
+		counting_hooks hooks;
+		ext::thread_pool pool(2, opts);
+		pool.set_task_hooks(&hooks);
+
+		std::vector<ext::future<void>> futures;
+		for (unsigned i = 0; i < 100; ++i)
+			futures.push_back(pool.submit([] { std::this_thread::sleep_for(std::chrono::microseconds(10)); }));
+
+		for (auto & f : futures) f.get();
+
+		auto metrics = pool.metrics();
+		BOOST_CHECK_EQUAL(metrics.workers.size(), 2);
+		BOOST_CHECK_EQUAL(hooks.begins.load(), 100);
+
+		// task_end and counters are updated after task result is set,
+		// stop waits for workers and moves their metrics into retired
+		pool.stop().get();
+		pool.set_task_hooks(nullptr);
+
+		metrics = pool.metrics();
+		BOOST_CHECK(metrics.workers.empty());
+		BOOST_CHECK_EQUAL(metrics.retired.executed, 100);
+		BOOST_CHECK_EQUAL(hooks.ends.load(), 100);
+		BOOST_CHECK_EQUAL(metrics.queue_latency.count(), 100);
+		BOOST_CHECK_EQUAL(metrics.run_time.count(), 100);
+		BOOST_CHECK(metrics.run_time.percentile(50) >= std::chrono::microseconds(10));
+	}
+}
+#endif
+
+// microbenchmark, run explicitly with --run_test=thread_pool_tests/thread_pool_submit_benchmark --log_level=message
+BOOST_AUTO_TEST_CASE(thread_pool_submit_benchmark, *boost::unit_test::disabled())
+{
+	using namespace std::chrono;
+	constexpr unsigned count = 1000 * 1000, batch = 1000;
+	int value = 0;
+	auto func = [](int * ptr, int n) { return *ptr + n; };
+
+	{	// no workers: submit and abandon by clear, measures task creation and destruction
+		ext::thread_pool pool;
+		auto start = steady_clock::now();
+		for (unsigned i = 0; i < count; i += batch)
+		{
+			for (unsigned k = 0; k < batch; ++k) pool.submit(func, &value, k);
+			pool.clear();
+		}
+
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / count;
+		BOOST_TEST_MESSAGE("thread_pool submit + clear: " << ns << " ns/task");
+	}
+
+	{	// same for post: no future and shared state
+		ext::thread_pool pool;
+		auto start = steady_clock::now();
+		for (unsigned i = 0; i < count; i += batch)
+		{
+			for (unsigned k = 0; k < batch; ++k) pool.post(func, &value, k);
+			pool.clear();
+		}
+
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / count;
+		BOOST_TEST_MESSAGE("thread_pool post + clear: " << ns << " ns/task");
+	}
+
+	{	// one worker: submitted in one thread, executed and destroyed in other
+		ext::thread_pool pool(1);
+		auto start = steady_clock::now();
+		for (unsigned i = 0; i < count; i += batch)
+		{
+			for (unsigned k = 0; k < batch; ++k) pool.submit(func, &value, k);
+			pool.submit([] {}).get();
+		}
+
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / count;
+		BOOST_TEST_MESSAGE("thread_pool submit + execute: " << ns << " ns/task");
+	}
+
+	{
+		ext::thread_pool pool(1);
+		auto start = steady_clock::now();
+		for (unsigned i = 0; i < count; i += batch)
+		{
+			for (unsigned k = 0; k < batch; ++k) pool.post(func, &value, k);
+			pool.submit([] {}).get();
+		}
+
+		auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / count;
+		BOOST_TEST_MESSAGE("thread_pool post + execute: " << ns << " ns/task");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,296 @@
+#include <atomic>
+#include <vector>
+#include <random>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <ext/future.hpp>
+#include <ext/threaded_scheduler.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(threaded_scheduler_tests)
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_order_test)
+{
+	using namespace std::chrono_literals;
+	using clock = ext::threaded_scheduler::time_point::clock;
+
+	for (unsigned opts : {ext::threaded_scheduler::binary_heap, ext::threaded_scheduler::timing_wheel})
+	{
+		ext::threaded_scheduler scheduler(opts);
+
+		// delays cross several wheel levels: level 0 covers 256 ticks
+		std::vector<std::chrono::milliseconds> delays = {0ms, 5ms, 1ms, 300ms, 30ms, 600ms, 257ms, 256ms, 3ms};
+		std::vector<ext::future<bool>> futures;
+
+		auto start = clock::now();
+		for (auto delay : delays)
+		{
+			auto tp = start + delay;
+			futures.push_back(scheduler.submit(tp, [tp] { return clock::now() >= tp; }));
+		}
+
+		// time point in the past is executed immediately
+		auto fpast = scheduler.submit(start - 1s, [] { return true; });
+		BOOST_CHECK(fpast.get());
+
+		for (auto & f : futures)
+			BOOST_CHECK(f.get()); // not executed earlier than requested
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_timing_wheel_bulk_test)
+{
+	using namespace std::chrono_literals;
+	using clock = ext::threaded_scheduler::time_point::clock;
+
+	// with 1us resolution delays cover 3 wheel levels
+	for (auto resolution : {ext::threaded_scheduler::duration(100us), ext::threaded_scheduler::duration(1us)})
+	{
+		ext::threaded_scheduler scheduler(ext::threaded_scheduler::timing_wheel, resolution);
+
+		std::mt19937 gen(12);
+		std::uniform_int_distribution<int> dist(0, 200);
+
+		std::atomic_int executed = 0, early = 0;
+		std::vector<ext::future<void>> futures;
+
+		auto start = clock::now();
+		for (int i = 0; i < 10000; ++i)
+		{
+			auto tp = start + std::chrono::milliseconds(dist(gen));
+			futures.push_back(scheduler.submit(tp, [tp, &executed, &early]
+			{
+				if (clock::now() < tp) ++early;
+				++executed;
+			}));
+		}
+
+		for (auto & f : futures) f.get();
+		BOOST_CHECK_EQUAL(executed.load(), 10000);
+		BOOST_CHECK_EQUAL(early.load(), 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_clear_test)
+{
+	using namespace std::chrono_literals;
+
+	for (unsigned opts : {ext::threaded_scheduler::binary_heap, ext::threaded_scheduler::timing_wheel})
+	{
+		ext::future<int> fnear, ffar;
+
+		{
+			ext::threaded_scheduler scheduler(opts);
+			fnear = scheduler.submit(1h, [] { return 1; });
+			scheduler.clear();
+			BOOST_CHECK_THROW(fnear.get(), ext::future_error);
+
+			// far enough to go into overflow list of timing wheel
+			ffar = scheduler.submit(24h * 100, [] { return 1; });
+			BOOST_CHECK_EQUAL(scheduler.submit(1ms, [] { return 2; }).get(), 2);
+		}
+
+		// abandoned on destruction
+		BOOST_CHECK_THROW(ffar.get(), ext::future_error);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_cancel_test)
+{
+	using namespace std::chrono_literals;
+
+	for (unsigned opts : {ext::threaded_scheduler::binary_heap, ext::threaded_scheduler::timing_wheel})
+	{
+		ext::threaded_scheduler scheduler(opts);
+
+		// every task holds a copy of token, when task is destroyed - copy is released
+		auto token = std::make_shared<int>(0);
+		std::vector<ext::future<int>> futures;
+
+		for (int i = 0; i < 1000; ++i)
+			futures.push_back(scheduler.submit(1h + std::chrono::seconds(i), [token, i] { return i; }));
+
+		BOOST_CHECK_EQUAL(token.use_count(), 1001);
+
+		// cancel every task except each 10th, cancelled tasks are removed from scheduler right away
+		for (int i = 0; i < 1000; ++i)
+		{
+			if (i % 10 == 0) continue;
+
+			BOOST_CHECK(futures[i].cancel());
+			BOOST_CHECK(futures[i].is_cancelled());
+			futures[i] = {};
+		}
+
+		BOOST_CHECK_EQUAL(token.use_count(), 101);
+
+		// remaining tasks are still there and work
+		auto fnear = scheduler.submit(1ms, [token] { return -1; });
+		BOOST_CHECK_EQUAL(fnear.get(), -1);
+
+		scheduler.clear();
+		BOOST_CHECK_THROW(futures[10].get(), ext::future_error);
+
+		futures.clear();
+		fnear = {};
+		BOOST_CHECK_EQUAL(token.use_count(), 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_concurrent_cancel_test)
+{
+	using namespace std::chrono_literals;
+
+	// tasks race between being executed and cancelled, every one must be either executed or cancelled
+	for (unsigned opts : {ext::threaded_scheduler::binary_heap, ext::threaded_scheduler::timing_wheel})
+	{
+		ext::threaded_scheduler scheduler(opts, 10us);
+		std::atomic_int executed = 0;
+		int cancelled = 0;
+
+		std::vector<ext::future<void>> futures;
+		for (int i = 0; i < 5000; ++i)
+			futures.push_back(scheduler.submit(std::chrono::microseconds(i % 100), [&executed] { ++executed; }));
+
+		for (auto & f : futures)
+			cancelled += f.cancel();
+
+		for (auto & f : futures)
+			f.wait();
+
+		BOOST_CHECK_EQUAL(executed.load() + cancelled, 5000);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_post_test)
+{
+	using namespace std::chrono_literals;
+	using clock = ext::threaded_scheduler::time_point::clock;
+
+	for (unsigned opts : {ext::threaded_scheduler::binary_heap, ext::threaded_scheduler::timing_wheel})
+	{
+		ext::threaded_scheduler scheduler(opts);
+		std::atomic_int executed = 0, early = 0;
+
+		auto start = clock::now();
+		for (int i = 0; i < 100; ++i)
+		{
+			auto tp = start + std::chrono::milliseconds(i % 10);
+			scheduler.post_at(tp, [tp, &executed, &early](int n)
+			{
+				if (clock::now() < tp) ++early;
+				executed += n;
+			}, 1);
+		}
+
+		scheduler.post_after(5ms, [&executed] { ++executed; });
+		// submitted after all posted tasks, so executed after them
+		scheduler.submit(start + 20ms, [] {}).get();
+
+		BOOST_CHECK_EQUAL(executed.load(), 101);
+		BOOST_CHECK_EQUAL(early.load(), 0);
+
+		// cleared posted task is destroyed without execution
+		auto guard = std::make_shared<int>(0);
+		scheduler.post_after(1h, [guard, &executed] { ++executed; });
+		BOOST_CHECK_EQUAL(guard.use_count(), 2);
+
+		scheduler.clear();
+		BOOST_CHECK_EQUAL(guard.use_count(), 1);
+		BOOST_CHECK_EQUAL(executed.load(), 101);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threaded_scheduler_with_timeout_test)
+{
+	using namespace std::chrono_literals;
+	ext::threaded_scheduler scheduler;
+
+	// completes before timeout, timer is cancelled
+	{
+		ext::promise<int> p;
+		auto f = ext::with_timeout(p.get_future(), 10s, scheduler);
+		BOOST_CHECK(not f.is_ready());
+
+		p.set_value(12);
+		BOOST_CHECK_EQUAL(f.get(), 12);
+	}
+
+	// exception is forwarded
+	{
+		ext::promise<void> p;
+		auto f = ext::with_timeout(p.get_future(), 10s, scheduler);
+		p.set_exception(std::make_exception_ptr(std::runtime_error("err")));
+		BOOST_CHECK_THROW(f.get(), std::runtime_error);
+	}
+
+	// times out, late value is discarded
+	{
+		ext::promise<int> p;
+		auto f = ext::with_timeout(p.get_future(), 10ms, scheduler);
+
+		try
+		{
+			f.get();
+			BOOST_ERROR("with_timeout future did not time out");
+		}
+		catch (ext::future_error & ex)
+		{
+			BOOST_CHECK(ex.code() == ext::make_error_code(ext::future_errc::timeout));
+		}
+
+		p.set_value(12);
+	}
+
+	// shared_future input
+	{
+		ext::promise<int> p;
+		auto f = ext::with_timeout(p.get_future().share(), 10s, scheduler);
+		p.set_value(1);
+		BOOST_CHECK_EQUAL(f.get(), 1);
+	}
+}
+
+#ifdef EXT_ENABLE_EXECUTOR_METRICS
+BOOST_AUTO_TEST_CASE(threaded_scheduler_metrics_test)
+{
+	using namespace std::chrono_literals;
+
+	struct counting_hooks : ext::task_hooks
+	{
+		std::atomic_int begins = 0, ends = 0;
+		void task_begin() noexcept override { ++begins; }
+		void task_end() noexcept override { ++ends; }
+	};
+
+	for (unsigned opts : {ext::threaded_scheduler::binary_heap, ext::threaded_scheduler::timing_wheel})
+	{
+		counting_hooks hooks;
+		ext::threaded_scheduler scheduler(opts);
+		scheduler.set_task_hooks(&hooks);
+
+		std::vector<ext::future<void>> futures;
+		for (int i = 0; i < 10; ++i)
+			futures.push_back(scheduler.submit(std::chrono::milliseconds(i), [] { std::this_thread::sleep_for(100us); }));
+
+		for (auto & f : futures) f.get();
+		BOOST_CHECK_EQUAL(hooks.begins.load(), 10);
+
+		// task_end and counters are updated after task result is set,
+		// tasks are executed sequentially, so they are complete when next task is executed
+		scheduler.set_task_hooks(nullptr);
+		scheduler.submit(0ms, [] {}).get();
+
+		auto metrics = scheduler.metrics();
+		BOOST_CHECK_GE(metrics.executed, 10);
+		BOOST_CHECK_EQUAL(hooks.ends.load(), 10);
+		BOOST_CHECK_GE(metrics.lateness.count(), 10);
+		BOOST_CHECK_GE(metrics.run_time.count(), 10);
+		BOOST_CHECK(metrics.run_time.percentile(50) >= 100us);
+	}
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()